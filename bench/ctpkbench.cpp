@@ -0,0 +1,1236 @@
+#include "ctpkbench.h"
+#include "arena.h"
+#include "ctpk.h"
+#include "etc1.h"
+#include "hash.h"
+#include "ktx.h"
+#include "mipmap.h"
+#include "pngwriter.h"
+#include "pixelformat.h"
+#include "swizzle.h"
+#include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <png.h>
+#include <thread>
+
+// every operator new of the process is counted, so verifyHeap sees the heap itself and not only what an arena reports,
+// the array and nothrow forms are replaced as well so that no runtime pairs its own new with this delete
+static atomic<n64> s_nOperatorNewCount(0);
+
+void* operator new(size_t a_uSize, const nothrow_t&) noexcept
+{
+	s_nOperatorNewCount++;
+	return malloc(a_uSize != 0 ? a_uSize : 1);
+}
+
+void* operator new(size_t a_uSize)
+{
+	void* pData = operator new(a_uSize, nothrow);
+	if (pData == nullptr)
+	{
+		throw bad_alloc();
+	}
+	return pData;
+}
+
+void* operator new[](size_t a_uSize, const nothrow_t&) noexcept
+{
+	return operator new(a_uSize, nothrow);
+}
+
+void* operator new[](size_t a_uSize)
+{
+	return operator new(a_uSize);
+}
+
+void operator delete(void* a_pData) noexcept
+{
+	free(a_pData);
+}
+
+void operator delete(void* a_pData, const nothrow_t&) noexcept
+{
+	free(a_pData);
+}
+
+void operator delete[](void* a_pData) noexcept
+{
+	free(a_pData);
+}
+
+void operator delete[](void* a_pData, const nothrow_t&) noexcept
+{
+	free(a_pData);
+}
+
+CCtpkBench::SOption CCtpkBench::s_Option[] =
+{
+	{ USTR("verify"), 0, USTR("export and import every format, mipmap chain and icon through --dir and check what comes back, then hold every etc1 quality against pvrtexlib") },
+	{ USTR("dir"), 0, USTR("the scratch dir of --verify, default is ctpk_verify") },
+	{ USTR("etc1-quality"), 0, USTR("encode etc1 with the built-in encoder, fast, medium or slow, default is the slow perceptual encoder of pvrtexlib") },
+	{ USTR("max-size"), 0, USTR("the largest texture size from 64 to 1024, default is 1024") },
+	{ USTR("min-time"), 0, USTR("the milliseconds every stage is repeated for, default is 200") },
+	{ USTR("json"), 0, USTR("write the results to the json file") },
+	{ USTR("baseline"), 0, USTR("compare the results with the json file of an earlier run") },
+	{ USTR("tolerance"), 0, USTR("the percentage below the baseline that counts as a regression, default is 10") },
+	{ USTR("help"), USTR('h'), USTR("show this help") },
+	{ nullptr, 0, nullptr }
+};
+
+const char* CCtpkBench::s_pFormatName[] = { "RGBA8888", "RGB888", "RGBA5551", "RGB565", "RGBA4444", "LA88", "HL8", "L8", "A8", "LA44", "L4", "A4", "ETC1", "ETC1_A4" };
+const char* CCtpkBench::s_pStageName[] = { "decode", "encode", "mipmap", "png-write", "png-read" };
+// etc1 of the synthetic image stays well above this, a broken block or nibble order falls far below it
+const double CCtpkBench::s_fEtc1MinPsnr = 30.0;
+// how far fast, medium and slow may fall below the slow perceptual encoder of pvrtexlib on the same image
+const double CCtpkBench::s_fEtc1PsnrMargin[] = { 3.0, 2.0, 1.0 };
+// the xxh64 of the rgba of both levels that the baseline decoder made of the noise in verifyGolden, per format
+const u64 CCtpkBench::s_uGoldenPixelHash[] =
+{
+	0xB2CD4406E4FD8E7AULL, 0xA184DE1EDB4C3431ULL, 0x457749A753CA1AD8ULL, 0xB2B2ADA8328A4E67ULL, 0xD19F4EFC9CC39EE5ULL, 0xDA447244B11BC6B9ULL, 0x4809469412CF82C2ULL,
+	0x6D5806912AD65E57ULL, 0xBD3D81D991D63207ULL, 0xCBD134833C8E3818ULL, 0xA42A7EF4A5B0D6E6ULL, 0x3342165125111E28ULL, 0x3CB5716BF1BCAE94ULL, 0xD0FCD3673256DB9EULL
+};
+// the xxh64 of the TexData that verifyGolden encodes from the synthetic image, per format
+const u64 CCtpkBench::s_uGoldenTexDataHash[] =
+{
+	0xB34FD0EBB2495E7BULL, 0xD70642E991556F08ULL, 0x18A4443759457774ULL, 0xD87AF100AD8CEC63ULL, 0x58E7561F6423F67DULL, 0x45E3FBA74E090B56ULL, 0xF30D072DA3D5C699ULL,
+	0x22200B93ADA601A2ULL, 0xA7AC20D6BA15CAB9ULL, 0x3BC48682B0C9ED78ULL, 0x37754B978CC78C32ULL, 0x637CD6C5C17A6D8EULL, 0xD45B86531554DAB6ULL, 0xCEAD98EBCB1A7BFDULL
+};
+
+CCtpkBench::CCtpkBench()
+	: m_bVerify(false)
+	, m_sDirName(USTR("ctpk_verify"))
+	, m_nEtc1Quality(-1)
+	, m_nMaxSize(1024)
+	, m_nMinTime(200)
+	, m_nTolerance(10)
+{
+}
+
+CCtpkBench::~CCtpkBench()
+{
+}
+
+int CCtpkBench::ParseOptions(int a_nArgc, UChar* a_pArgv[])
+{
+	for (int i = 1; i < a_nArgc; i++)
+	{
+		int nArgpc = static_cast<int>(UCslen(a_pArgv[i]));
+		if (nArgpc == 0)
+		{
+			continue;
+		}
+		int nIndex = i;
+		if (UCscmp(a_pArgv[i], USTR("-h")) == 0 || UCscmp(a_pArgv[i], USTR("--help")) == 0)
+		{
+			return 1;
+		}
+		if (nArgpc <= 2 || a_pArgv[i][0] != USTR('-') || a_pArgv[i][1] != USTR('-'))
+		{
+			UPrintf(USTR("ERROR: illegal option\n\n"));
+			return 1;
+		}
+		switch (parseOptions(a_pArgv[i] + 2, nIndex, a_nArgc, a_pArgv))
+		{
+		case kParseOptionReturnSuccess:
+			break;
+		case kParseOptionReturnIllegalOption:
+			UPrintf(USTR("ERROR: illegal option\n\n"));
+			return 1;
+		case kParseOptionReturnNoArgument:
+			UPrintf(USTR("ERROR: no argument\n\n"));
+			return 1;
+		case kParseOptionReturnUnknownArgument:
+			UPrintf(USTR("ERROR: unknown argument \"%") PRIUS USTR("\"\n\n"), m_sMessage.c_str());
+			return 1;
+		case kParseOptionReturnOptionConflict:
+			UPrintf(USTR("ERROR: option conflict\n\n"));
+			return 1;
+		}
+		i = nIndex;
+	}
+	return 0;
+}
+
+int CCtpkBench::CheckOptions()
+{
+	if (m_nMaxSize < 64 || m_nMaxSize > 1024 || (m_nMaxSize & (m_nMaxSize - 1)) != 0)
+	{
+		UPrintf(USTR("ERROR: --max-size is not a power of two from 64 to 1024\n\n"));
+		return 1;
+	}
+	return 0;
+}
+
+int CCtpkBench::Help()
+{
+	UPrintf(USTR("ctpk_bench %") PRIUS USTR(" by dnasdw\n\n"), AToU(CTPKTOOL_VERSION).c_str());
+	UPrintf(USTR("usage: ctpk_bench [option...] [option]...\n"));
+	UPrintf(USTR("sample:\n"));
+	UPrintf(USTR("  ctpk_bench --json baseline.json\n"));
+	UPrintf(USTR("  ctpk_bench --baseline baseline.json --tolerance 5\n"));
+	UPrintf(USTR("  ctpk_bench --etc1-quality fast --max-size 256\n"));
+	UPrintf(USTR("  ctpk_bench --verify --baseline baseline.json\n"));
+	UPrintf(USTR("\n"));
+	UPrintf(USTR("option:\n"));
+	SOption* pOption = s_Option;
+	while (pOption->Name != nullptr || pOption->Doc != nullptr)
+	{
+		if (pOption->Name != nullptr)
+		{
+			UPrintf(USTR("  "));
+			if (pOption->Key != 0)
+			{
+				UPrintf(USTR("-%c,"), pOption->Key);
+			}
+			else
+			{
+				UPrintf(USTR("   "));
+			}
+			UPrintf(USTR(" --%-8") PRIUS, pOption->Name);
+			if (UCslen(pOption->Name) >= 8 && pOption->Doc != nullptr)
+			{
+				UPrintf(USTR("\n%16") PRIUS, USTR(""));
+			}
+		}
+		if (pOption->Doc != nullptr)
+		{
+			UPrintf(USTR("%") PRIUS, pOption->Doc);
+		}
+		UPrintf(USTR("\n"));
+		pOption++;
+	}
+	return 0;
+}
+
+int CCtpkBench::Action()
+{
+	if (m_bVerify)
+	{
+		if (!verify())
+		{
+			return 1;
+		}
+		// the timings only matter to verify when there is a budget to hold them against
+		if (m_sBaselineFileName.empty())
+		{
+			return 0;
+		}
+	}
+	UPrintf(USTR("%-9") PRIUS USTR(" %5") PRIUS USTR(" %3") PRIUS USTR(" %-9") PRIUS USTR(" %12") PRIUS USTR(" %12") PRIUS USTR("\n"), USTR("format"), USTR("size"), USTR("mip"), USTR("stage"), USTR("MPix/s"), USTR("MB/s"));
+	for (n32 nFormat = CCtpk::kTextureFormatRGBA8888; nFormat <= CCtpk::kTextureFormatETC1_A4; nFormat++)
+	{
+		for (n32 nSize = 64; nSize <= m_nMaxSize; nSize *= 2)
+		{
+			// a single level, then the whole chain down to the last whole tile
+			n32 nMipLevel = 1;
+			while ((nSize >> nMipLevel) >= 8)
+			{
+				nMipLevel++;
+			}
+			if (!benchTexture(nFormat, nSize, 1) || !benchTexture(nFormat, nSize, nMipLevel))
+			{
+				return 1;
+			}
+		}
+	}
+	if (!m_sJsonFileName.empty() && !writeJson())
+	{
+		return 1;
+	}
+	if (!m_sBaselineFileName.empty() && !compareBaseline())
+	{
+		return 1;
+	}
+	return 0;
+}
+
+CCtpkBench::EParseOptionReturn CCtpkBench::parseOptions(const UChar* a_pName, int& a_nIndex, int a_nArgc, UChar* a_pArgv[])
+{
+	if (UCscmp(a_pName, USTR("verify")) == 0)
+	{
+		m_bVerify = true;
+	}
+	else if (UCscmp(a_pName, USTR("dir")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_sDirName = a_pArgv[++a_nIndex];
+	}
+	else if (UCscmp(a_pName, USTR("etc1-quality")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sEtc1Quality = a_pArgv[++a_nIndex];
+		if (sEtc1Quality == USTR("fast"))
+		{
+			m_nEtc1Quality = CEtc1::kQualityFast;
+		}
+		else if (sEtc1Quality == USTR("medium"))
+		{
+			m_nEtc1Quality = CEtc1::kQualityMedium;
+		}
+		else if (sEtc1Quality == USTR("slow"))
+		{
+			m_nEtc1Quality = CEtc1::kQualitySlow;
+		}
+		else
+		{
+			m_sMessage = sEtc1Quality;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("max-size")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_nMaxSize = SToN32(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(a_pName, USTR("min-time")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sMinTime = a_pArgv[++a_nIndex];
+		m_nMinTime = SToN32(sMinTime);
+		if (m_nMinTime < 0)
+		{
+			m_sMessage = sMinTime;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("json")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_sJsonFileName = a_pArgv[++a_nIndex];
+	}
+	else if (UCscmp(a_pName, USTR("baseline")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_sBaselineFileName = a_pArgv[++a_nIndex];
+	}
+	else if (UCscmp(a_pName, USTR("tolerance")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sTolerance = a_pArgv[++a_nIndex];
+		m_nTolerance = SToN32(sTolerance);
+		if (m_nTolerance < 0 || m_nTolerance >= 100)
+		{
+			m_sMessage = sTolerance;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else
+	{
+		return kParseOptionReturnIllegalOption;
+	}
+	return kParseOptionReturnSuccess;
+}
+
+// every stage runs on the same texture: the synthetic image is encoded into an in-memory ctpk,
+// decoded back level by level, mipmapped on its own, then every level goes through png and back
+bool CCtpkBench::benchTexture(n32 a_nFormat, n32 a_nSize, n32 a_nMipLevel)
+{
+	vector<u8> vCtpk;
+	makeCtpk(a_nFormat, a_nSize, a_nSize, a_nMipLevel, vCtpk);
+	CCtpk ctpk;
+	ctpk.SetEtc1Quality(m_nEtc1Quality);
+	if (!ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	n32 nTexDataSize = ctpk.GetTextureInfo(0)->TexDataSize;
+	n64 nPixelCount = 0;
+	vector<n32> vOffset(a_nMipLevel + 1);
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		nPixelCount += (a_nSize >> l) * (a_nSize >> l);
+		vOffset[l + 1] = static_cast<n32>(nPixelCount * 4);
+	}
+	vector<u8> vRGBA(static_cast<size_t>(nPixelCount * 4));
+	makeImage(a_nSize, a_nSize, vRGBA.data());
+	bool bResult = true;
+	double fSeconds = measure([&ctpk, &vRGBA, &bResult]()
+	{
+		bResult = ctpk.EncodeTexture(0, 0, vRGBA.data()) && bResult;
+	});
+	addResult(a_nFormat, a_nSize, a_nMipLevel, kStageEncode, fSeconds, nPixelCount, nTexDataSize);
+	fSeconds = measure([&ctpk, &vRGBA, &vOffset, &bResult, a_nMipLevel]()
+	{
+		for (n32 l = 0; l < a_nMipLevel; l++)
+		{
+			bResult = ctpk.DecodeTexture(0, l, vRGBA.data() + vOffset[l]) && bResult;
+		}
+	});
+	addResult(a_nFormat, a_nSize, a_nMipLevel, kStageDecode, fSeconds, nPixelCount, nTexDataSize);
+	if (a_nMipLevel > 1)
+	{
+		vector<u8> vMipmap(vRGBA.size());
+		CArena arena;
+		fSeconds = measure([&vRGBA, &vMipmap, &arena, a_nSize, a_nMipLevel]()
+		{
+			CMipmap::Generate(vRGBA.data(), vMipmap.data(), a_nSize, a_nSize, a_nMipLevel, CMipmap::kFilterBox, arena);
+			arena.Reset();
+		});
+		addResult(a_nFormat, a_nSize, a_nMipLevel, kStageMipmap, fSeconds, nPixelCount - a_nSize * a_nSize, vRGBA.size() - a_nSize * a_nSize * 4);
+	}
+	vector<FILE*> vPng(a_nMipLevel);
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		vPng[l] = tmpfile();
+		bResult = vPng[l] != nullptr && bResult;
+	}
+	if (bResult)
+	{
+		CThreadPool& threadPool = CThreadPool::GetThreadPool(1);
+		CArena arena;
+		fSeconds = measure([&vRGBA, &vOffset, &vPng, &threadPool, &arena, &bResult, a_nSize, a_nMipLevel]()
+		{
+			for (n32 l = 0; l < a_nMipLevel; l++)
+			{
+				rewind(vPng[l]);
+				bResult = CPngWriter::Write(vPng[l], vRGBA.data() + vOffset[l], a_nSize >> l, a_nSize >> l, CPngWriter::kEffortDefault, CPngWriter::kFilterPaeth, threadPool, arena) && bResult;
+				arena.Reset();
+			}
+		});
+		n64 nPngSize = 0;
+		for (n32 l = 0; l < a_nMipLevel; l++)
+		{
+			fflush(vPng[l]);
+			nPngSize += Ftell(vPng[l]);
+		}
+		addResult(a_nFormat, a_nSize, a_nMipLevel, kStagePngWrite, fSeconds, nPixelCount, nPngSize);
+		fSeconds = measure([&vRGBA, &vOffset, &vPng, &bResult, a_nSize, a_nMipLevel]()
+		{
+			for (n32 l = 0; l < a_nMipLevel; l++)
+			{
+				rewind(vPng[l]);
+				bResult = readPng(vPng[l], a_nSize >> l, a_nSize >> l, vRGBA.data() + vOffset[l]) && bResult;
+			}
+		});
+		addResult(a_nFormat, a_nSize, a_nMipLevel, kStagePngRead, fSeconds, nPixelCount, nPngSize);
+	}
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		if (vPng[l] != nullptr)
+		{
+			fclose(vPng[l]);
+		}
+	}
+	if (!bResult)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" %d mip %d failed\n\n"), AToU(s_pFormatName[a_nFormat]).c_str(), a_nSize, a_nMipLevel);
+	}
+	return bResult;
+}
+
+void CCtpkBench::addResult(n32 a_nFormat, n32 a_nSize, n32 a_nMipLevel, n32 a_nStage, double a_fSeconds, n64 a_nPixelCount, n64 a_nByteCount)
+{
+	SResult result;
+	result.Format = a_nFormat;
+	result.Size = a_nSize;
+	result.MipLevel = a_nMipLevel;
+	result.Stage = a_nStage;
+	result.MPixPerSecond = a_nPixelCount / a_fSeconds / 1e6;
+	result.MBytesPerSecond = a_nByteCount / a_fSeconds / 1e6;
+	m_vResult.push_back(result);
+	UPrintf(USTR("%-9") PRIUS USTR(" %5d %3d %-9") PRIUS USTR(" %12.2f %12.2f\n"), AToU(s_pFormatName[a_nFormat]).c_str(), a_nSize, a_nMipLevel, AToU(s_pStageName[a_nStage]).c_str(), result.MPixPerSecond, result.MBytesPerSecond);
+}
+
+// seconds per run, the stage is repeated until m_nMinTime has passed so that the small sizes are not just timer noise
+double CCtpkBench::measure(const function<void()>& a_fStage) const
+{
+	n32 nCount = 0;
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	double fSeconds = 0;
+	do
+	{
+		a_fStage();
+		nCount++;
+		fSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	} while (fSeconds * 1000 < m_nMinTime);
+	return fSeconds / nCount;
+}
+
+// one result per line, so that compareBaseline reads it back without a json parser
+bool CCtpkBench::writeJson() const
+{
+	FILE* fp = UFopen(m_sJsonFileName.c_str(), USTR("wb"));
+	if (fp == nullptr)
+	{
+		UPrintf(USTR("ERROR: open %") PRIUS USTR(" failed\n\n"), m_sJsonFileName.c_str());
+		return false;
+	}
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"version\": \"%s\",\n", CTPKTOOL_VERSION);
+	fprintf(fp, "\t\"etc1_quality\": %d,\n", m_nEtc1Quality);
+	fprintf(fp, "\t\"results\": [\n");
+	for (n32 i = 0; i < static_cast<n32>(m_vResult.size()); i++)
+	{
+		const SResult& result = m_vResult[i];
+		fprintf(fp, "\t\t{ \"format\": \"%s\", \"size\": %d, \"mip\": %d, \"stage\": \"%s\", \"mpix_per_s\": %.3f, \"mb_per_s\": %.3f }%s\n", s_pFormatName[result.Format], result.Size, result.MipLevel, s_pStageName[result.Stage], result.MPixPerSecond, result.MBytesPerSecond, i + 1 < static_cast<n32>(m_vResult.size()) ? "," : "");
+	}
+	fprintf(fp, "\t]\n");
+	fprintf(fp, "}\n");
+	fclose(fp);
+	return true;
+}
+
+bool CCtpkBench::compareBaseline() const
+{
+	FILE* fp = UFopen(m_sBaselineFileName.c_str(), USTR("rb"));
+	if (fp == nullptr)
+	{
+		UPrintf(USTR("ERROR: open %") PRIUS USTR(" failed\n\n"), m_sBaselineFileName.c_str());
+		return false;
+	}
+	map<string, double> mBaseline;
+	char szLine[512] = {};
+	while (fgets(szLine, sizeof(szLine), fp) != nullptr)
+	{
+		char szFormat[32] = {};
+		char szStage[32] = {};
+		n32 nSize = 0;
+		n32 nMipLevel = 0;
+		double fMPixPerSecond = 0;
+		if (sscanf(szLine, " { \"format\": \"%31[^\"]\", \"size\": %d, \"mip\": %d, \"stage\": \"%31[^\"]\", \"mpix_per_s\": %lf", szFormat, &nSize, &nMipLevel, szStage, &fMPixPerSecond) == 5)
+		{
+			mBaseline[Format("%s %d %d %s", szFormat, nSize, nMipLevel, szStage)] = fMPixPerSecond;
+		}
+	}
+	fclose(fp);
+	n32 nRegressionCount = 0;
+	for (n32 i = 0; i < static_cast<n32>(m_vResult.size()); i++)
+	{
+		const SResult& result = m_vResult[i];
+		string sKey = Format("%s %d %d %s", s_pFormatName[result.Format], result.Size, result.MipLevel, s_pStageName[result.Stage]);
+		map<string, double>::const_iterator it = mBaseline.find(sKey);
+		if (it != mBaseline.end() && result.MPixPerSecond < it->second * (100 - m_nTolerance) / 100)
+		{
+			UPrintf(USTR("REGRESSION: %") PRIUS USTR(" %.2f MPix/s, baseline %.2f MPix/s\n"), AToU(sKey).c_str(), result.MPixPerSecond, it->second);
+			nRegressionCount++;
+		}
+	}
+	if (nRegressionCount != 0)
+	{
+		UPrintf(USTR("ERROR: %d of %d results regressed more than %d%%\n\n"), nRegressionCount, static_cast<n32>(m_vResult.size()), m_nTolerance);
+		return false;
+	}
+	return true;
+}
+
+// the uncompressed formats start from noise so that every bit of every texel has to survive export and import,
+// etc1 starts from the synthetic image and has to come back within s_fEtc1MinPsnr of the exported png,
+// with --ktx every format carries its native blocks and has to come back bit-exact
+bool CCtpkBench::verify()
+{
+	UMkdir(m_sDirName.c_str());
+	static const n32 c_nSize[][2] = { { 64, 64 }, { 128, 32 }, { 32, 128 } };
+	n32 nCaseCount = 0;
+	n32 nFailedCount = 0;
+	for (n32 nFormat = CCtpk::kTextureFormatRGBA8888; nFormat <= CCtpk::kTextureFormatETC1_A4; nFormat++)
+	{
+		for (n32 i = 0; i < static_cast<n32>(sizeof(c_nSize) / sizeof(c_nSize[0])); i++)
+		{
+			n32 nWidth = c_nSize[i][0];
+			n32 nHeight = c_nSize[i][1];
+			n32 nMipLevel = 1;
+			while ((nWidth >> nMipLevel) >= 8 && (nHeight >> nMipLevel) >= 8)
+			{
+				nMipLevel++;
+			}
+			// a single level, then the whole chain down to the last whole tile, each through png and through ktx
+			for (n32 nCase = 0; nCase < 4; nCase++)
+			{
+				nCaseCount++;
+				if (!verifyCtpk(nFormat, nWidth, nHeight, nCase % 2 == 0 ? 1 : nMipLevel, nCase >= 2))
+				{
+					nFailedCount++;
+				}
+			}
+		}
+	}
+	nCaseCount++;
+	if (!verifyIcon(48))
+	{
+		nFailedCount++;
+	}
+	// the levels of a ctpk always have rows of whole words, so the row padding of ktx only shows with odd sizes
+	static const n32 c_nKtxCase[][3] = { { 5, 3, 2 }, { 6, 6, 3 }, { 7, 2, 1 } };
+	for (n32 i = 0; i < static_cast<n32>(sizeof(c_nKtxCase) / sizeof(c_nKtxCase[0])); i++)
+	{
+		nCaseCount++;
+		if (!verifyKtx(c_nKtxCase[i][0], c_nKtxCase[i][1], c_nKtxCase[i][2]))
+		{
+			nFailedCount++;
+		}
+	}
+	// the scalar code and every simd level of the cpu have to hit the same golden hashes
+	CSwizzle::ESimdLevel eSimdLevel = CSwizzle::GetSimdLevel();
+	for (n32 nSimdLevel = CSwizzle::kSimdLevelNone; nSimdLevel <= eSimdLevel; nSimdLevel++)
+	{
+		CSwizzle::SetSimdLevel(static_cast<CSwizzle::ESimdLevel>(nSimdLevel));
+		for (n32 nFormat = CCtpk::kTextureFormatRGBA8888; nFormat <= CCtpk::kTextureFormatETC1_A4; nFormat++)
+		{
+			nCaseCount++;
+			if (!verifyGolden(nFormat))
+			{
+				nFailedCount++;
+			}
+		}
+	}
+	CSwizzle::SetSimdLevel(eSimdLevel);
+	for (n32 nFormat = CCtpk::kTextureFormatETC1; nFormat <= CCtpk::kTextureFormatETC1_A4; nFormat++)
+	{
+		nCaseCount++;
+		if (!verifyEtc1Quality(nFormat, 128, 128))
+		{
+			nFailedCount++;
+		}
+	}
+	// the same archive again must be served from the scratch arena alone, through png level by level, png in bands and ktx
+	static const n32 c_nArenaCase[][5] =
+	{
+		{ CCtpk::kTextureFormatRGBA8888, 128, 32, 3, 0 },
+		{ CCtpk::kTextureFormatL4, 64, 64, 1, 0 },
+		{ CCtpk::kTextureFormatETC1, 64, 64, 4, 0 },
+		{ CCtpk::kTextureFormatLA44, 64, 64, 4, 1 },
+		{ CCtpk::kTextureFormatETC1_A4, 64, 64, 4, 1 }
+	};
+	for (n32 i = 0; i < static_cast<n32>(sizeof(c_nArenaCase) / sizeof(c_nArenaCase[0])); i++)
+	{
+		nCaseCount++;
+		if (!verifyArena(c_nArenaCase[i][0], c_nArenaCase[i][1], c_nArenaCase[i][2], c_nArenaCase[i][3], c_nArenaCase[i][4] != 0))
+		{
+			nFailedCount++;
+		}
+	}
+	// the codecs themselves, without the file handling around them, and once more with an image large enough for several png chunks
+	for (n32 i = 0; i <= static_cast<n32>(sizeof(c_nArenaCase) / sizeof(c_nArenaCase[0])); i++)
+	{
+		nCaseCount++;
+		bool bLarge = i == static_cast<n32>(sizeof(c_nArenaCase) / sizeof(c_nArenaCase[0]));
+		if (!(bLarge ? verifyHeap(CCtpk::kTextureFormatRGBA8888, 512, 512, 2) : verifyHeap(c_nArenaCase[i][0], c_nArenaCase[i][1], c_nArenaCase[i][2], c_nArenaCase[i][3])))
+		{
+			nFailedCount++;
+		}
+	}
+	UPrintf(USTR("verify: %d of %d round trips passed\n"), nCaseCount - nFailedCount, nCaseCount);
+	if (nFailedCount != 0)
+	{
+		UPrintf(USTR("ERROR: verify failed\n\n"));
+		return false;
+	}
+	return true;
+}
+
+bool CCtpkBench::verifyCtpk(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, bool a_bKtx)
+{
+	UString sCase = AToU(Format("%s %dx%d mip %d%s", s_pFormatName[a_nFormat], a_nWidth, a_nHeight, a_nMipLevel, a_bKtx ? " ktx" : ""));
+	bool bEtc1 = a_nFormat == CCtpk::kTextureFormatETC1 || a_nFormat == CCtpk::kTextureFormatETC1_A4;
+	vector<u8> vCtpk;
+	makeCtpk(a_nFormat, a_nWidth, a_nHeight, a_nMipLevel, vCtpk);
+	CCtpk ctpk;
+	ctpk.SetEtc1Quality(m_nEtc1Quality);
+	if (!ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	n32 nTexDataSize = ctpk.GetTextureInfo(0)->TexDataSize;
+	u8* pTexData = ctpk.GetTexData(0);
+	if (bEtc1)
+	{
+		vector<u8> vRGBA(a_nWidth * a_nHeight * 4);
+		makeImage(a_nWidth, a_nHeight, vRGBA.data());
+		ctpk.EncodeTexture(0, 0, vRGBA.data());
+	}
+	else
+	{
+		makeNoise(pTexData, nTexDataSize);
+	}
+	vector<u8> vOriginal = vCtpk;
+	UString sFileName = m_sDirName + USTR("/verify.ctpk");
+	UString sDirName = m_sDirName + USTR("/verify");
+	// the texture is cleared between export and import, so everything that comes back was read from the exported files
+	bool bResult = writeFile(sFileName, vCtpk);
+	if (bResult)
+	{
+		CCtpk exporter;
+		exporter.SetFileName(sFileName);
+		exporter.SetDirName(sDirName);
+		exporter.SetKtx(a_bKtx);
+		bResult = exporter.ExportFile();
+	}
+	if (bResult)
+	{
+		memset(pTexData, 0, nTexDataSize);
+		bResult = writeFile(sFileName, vCtpk);
+	}
+	if (bResult)
+	{
+		CCtpk importer;
+		importer.SetFileName(sFileName);
+		importer.SetDirName(sDirName);
+		importer.SetKtx(a_bKtx);
+		importer.SetEtc1Quality(m_nEtc1Quality);
+		bResult = importer.ImportFile();
+	}
+	if (bResult)
+	{
+		bResult = readFile(sFileName, vCtpk) && vCtpk.size() == vOriginal.size();
+	}
+	if (!bResult)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" round trip failed\n\n"), sCase.c_str());
+		return false;
+	}
+	if (!bEtc1 || a_bKtx)
+	{
+		if (vCtpk != vOriginal)
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" is not bit-exact\n\n"), sCase.c_str());
+			return false;
+		}
+		return true;
+	}
+	// every level of the import is compared with the same level of the original, which is what the png held
+	CCtpk original;
+	if (!original.Open(vOriginal.data(), vOriginal.size()) || !ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	vector<u8> vRGBA(a_nWidth * a_nHeight * 4);
+	vector<u8> vOriginalRGBA(vRGBA.size());
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		n32 nPixelCount = (a_nWidth >> l) * (a_nHeight >> l);
+		if (!original.DecodeTexture(0, l, vOriginalRGBA.data()) || !ctpk.DecodeTexture(0, l, vRGBA.data()))
+		{
+			return false;
+		}
+		double fPsnr = getPsnr(vOriginalRGBA.data(), vRGBA.data(), nPixelCount * 4);
+		if (fPsnr < s_fEtc1MinPsnr)
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" level %d psnr %.2f dB is below %.2f dB\n\n"), sCase.c_str(), l, fPsnr, s_fEtc1MinPsnr);
+			return false;
+		}
+	}
+	return true;
+}
+
+// rgb888 levels whose rows are not whole words, every row in the file has to be padded with zeros to 4 bytes and read back without them
+bool CCtpkBench::verifyKtx(n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel)
+{
+	UString sCase = AToU(Format("ktx RGB888 %dx%d mip %d", a_nWidth, a_nHeight, a_nMipLevel));
+	static const CKtx::SFormat c_Format = { 0x1401, 1, 0x1907, 0x8051, 0x1907, 24 };
+	vector<u8> vData(CKtx::GetSize(c_Format, a_nWidth, a_nHeight, a_nMipLevel));
+	makeNoise(vData.data(), static_cast<n32>(vData.size()));
+	vector<u8> vRead(vData.size());
+	UString sFileName = m_sDirName + USTR("/verify.ktx");
+	vector<u8> vKtx;
+	if (!CKtx::Write(sFileName, c_Format, a_nWidth, a_nHeight, a_nMipLevel, vData.data()) || !CKtx::Read(sFileName, c_Format, a_nWidth, a_nHeight, a_nMipLevel, vRead.data()) || !readFile(sFileName, vKtx) || vKtx.size() < sizeof(SKtxHeader))
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" round trip failed\n\n"), sCase.c_str());
+		return false;
+	}
+	if (vRead != vData)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" is not bit-exact\n\n"), sCase.c_str());
+		return false;
+	}
+	const SKtxHeader* pKtxHeader = reinterpret_cast<const SKtxHeader*>(vKtx.data());
+	size_t uOffset = sizeof(SKtxHeader) + pKtxHeader->BytesOfKeyValueData;
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		n32 nRowSize = (a_nWidth >> l) * 3;
+		n32 nRowPitch = (nRowSize + 3) / 4 * 4;
+		n32 nImageSize = nRowPitch * (a_nHeight >> l);
+		if (uOffset + 4 + nImageSize > vKtx.size() || *reinterpret_cast<const u32*>(vKtx.data() + uOffset) != static_cast<u32>(nImageSize))
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" level %d is not padded to 4 byte rows\n\n"), sCase.c_str(), l);
+			return false;
+		}
+		for (n32 nY = 0; nY < (a_nHeight >> l); nY++)
+		{
+			for (n32 i = nRowSize; i < nRowPitch; i++)
+			{
+				if (vKtx[uOffset + 4 + nY * nRowPitch + i] != 0)
+				{
+					UPrintf(USTR("ERROR: %") PRIUS USTR(" level %d has a row padding that is not zero\n\n"), sCase.c_str(), l);
+					return false;
+				}
+			}
+		}
+		uOffset += 4 + (nImageSize + 3) / 4 * 4;
+	}
+	return true;
+}
+
+// an icon is a bare square of rgb565 that goes through DecodeFile and EncodeFile instead of the ctpk path
+bool CCtpkBench::verifyIcon(n32 a_nSize)
+{
+	vector<u8> vIcon(a_nSize * a_nSize * 2);
+	makeNoise(vIcon.data(), static_cast<n32>(vIcon.size()));
+	vector<u8> vOriginal = vIcon;
+	UString sFileName = m_sDirName + USTR("/icon.bin");
+	UString sDirName = m_sDirName + USTR("/icon");
+	bool bResult = writeFile(sFileName, vIcon) && CCtpk::IsCtpkIconFile(sFileName);
+	if (bResult)
+	{
+		CCtpk exporter;
+		exporter.SetFileName(sFileName);
+		exporter.SetDirName(sDirName);
+		bResult = exporter.ExportFile();
+	}
+	if (bResult)
+	{
+		memset(vIcon.data(), 0, vIcon.size());
+		bResult = writeFile(sFileName, vIcon);
+	}
+	if (bResult)
+	{
+		CCtpk importer;
+		importer.SetFileName(sFileName);
+		importer.SetDirName(sDirName);
+		bResult = importer.ImportFile();
+	}
+	if (bResult)
+	{
+		bResult = readFile(sFileName, vIcon) && vIcon == vOriginal;
+	}
+	if (!bResult)
+	{
+		UPrintf(USTR("ERROR: icon %dx%d round trip failed\n\n"), a_nSize, a_nSize);
+	}
+	return bResult;
+}
+
+// the round trips only prove that encode and decode agree with each other, the golden hashes pin both to fixed output:
+// a 32x16 texture with 2 levels of noise has to decode and export to the pixels of the baseline decoder,
+// and the synthetic image has to encode, with the slow built-in etc1 and the box filter, to the same TexData as before
+bool CCtpkBench::verifyGolden(n32 a_nFormat)
+{
+	static const n32 c_nWidth = 32;
+	static const n32 c_nHeight = 16;
+	static const n32 c_nMipLevel = 2;
+	UString sCase = AToU(Format("%s %dx%d mip %d golden simd %d", s_pFormatName[a_nFormat], c_nWidth, c_nHeight, c_nMipLevel, CSwizzle::GetSimdLevel()));
+	vector<u8> vCtpk;
+	makeCtpk(a_nFormat, c_nWidth, c_nHeight, c_nMipLevel, vCtpk);
+	CCtpk ctpk;
+	if (!ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	n32 nTexDataSize = ctpk.GetTextureInfo(0)->TexDataSize;
+	u8* pTexData = ctpk.GetTexData(0);
+	makeNoise(pTexData, nTexDataSize);
+	vector<u8> vRGBA(c_nWidth * c_nHeight * 4);
+	CHash pixelHash;
+	bool bResult = true;
+	for (n32 l = 0; l < c_nMipLevel; l++)
+	{
+		bResult = ctpk.DecodeTexture(0, l, vRGBA.data()) && bResult;
+		pixelHash.Update(vRGBA.data(), (c_nWidth >> l) * (c_nHeight >> l) * 4);
+	}
+	if (bResult && pixelHash.Digest() != s_uGoldenPixelHash[a_nFormat])
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" decodes to %016llX instead of %016llX\n\n"), sCase.c_str(), static_cast<unsigned long long>(pixelHash.Digest()), static_cast<unsigned long long>(s_uGoldenPixelHash[a_nFormat]));
+		return false;
+	}
+	UString sFileName = m_sDirName + USTR("/golden.ctpk");
+	UString sDirName = m_sDirName + USTR("/golden");
+	bResult = bResult && writeFile(sFileName, vCtpk);
+	if (bResult)
+	{
+		CCtpk exporter;
+		exporter.SetFileName(sFileName);
+		exporter.SetDirName(sDirName);
+		bResult = exporter.ExportFile();
+	}
+	CHash pngHash;
+	for (n32 l = 0; bResult && l < c_nMipLevel; l++)
+	{
+		UString sPngFileName = sDirName + (l == 0 ? USTR("/bench.tga.png") : AToU(Format("/bench.tga.mip%d.png", l)));
+		FILE* fp = UFopen(sPngFileName.c_str(), USTR("rb"));
+		bResult = fp != nullptr && readPng(fp, c_nWidth >> l, c_nHeight >> l, vRGBA.data());
+		if (fp != nullptr)
+		{
+			fclose(fp);
+		}
+		pngHash.Update(vRGBA.data(), (c_nWidth >> l) * (c_nHeight >> l) * 4);
+	}
+	if (bResult && pngHash.Digest() != s_uGoldenPixelHash[a_nFormat])
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" exports png pixels %016llX instead of %016llX\n\n"), sCase.c_str(), static_cast<unsigned long long>(pngHash.Digest()), static_cast<unsigned long long>(s_uGoldenPixelHash[a_nFormat]));
+		return false;
+	}
+	makeImage(c_nWidth, c_nHeight, vRGBA.data());
+	ctpk.SetEtc1Quality(CEtc1::kQualitySlow);
+	ctpk.SetMipmapFilter(CMipmap::kFilterBox);
+	bResult = bResult && ctpk.EncodeTexture(0, 0, vRGBA.data());
+	if (!bResult)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" failed\n\n"), sCase.c_str());
+		return false;
+	}
+	u64 uTexDataHash = CHash::Hash64(pTexData, nTexDataSize);
+	if (uTexDataHash != s_uGoldenTexDataHash[a_nFormat])
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" encodes to %016llX instead of %016llX\n\n"), sCase.c_str(), static_cast<unsigned long long>(uTexDataHash), static_cast<unsigned long long>(s_uGoldenTexDataHash[a_nFormat]));
+		return false;
+	}
+	return true;
+}
+
+// every built-in tier encodes the synthetic image next to pvrtexlib and has to stay within its margin of the pvrtexlib psnr
+bool CCtpkBench::verifyEtc1Quality(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight)
+{
+	UString sCase = AToU(Format("%s %dx%d", s_pFormatName[a_nFormat], a_nWidth, a_nHeight));
+	static const char* c_pQualityName[] = { "fast", "medium", "slow" };
+	vector<u8> vCtpk;
+	makeCtpk(a_nFormat, a_nWidth, a_nHeight, 1, vCtpk);
+	CCtpk ctpk;
+	if (!ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	vector<u8> vOriginalRGBA(a_nWidth * a_nHeight * 4);
+	makeImage(a_nWidth, a_nHeight, vOriginalRGBA.data());
+	if (a_nFormat == CCtpk::kTextureFormatETC1)
+	{
+		// etc1 decodes opaque, so only the color is held against the source
+		for (n32 i = 0; i < a_nWidth * a_nHeight; i++)
+		{
+			vOriginalRGBA[i * 4 + 3] = 0xFF;
+		}
+	}
+	vector<u8> vRGBA(vOriginalRGBA.size());
+	// -1 is pvrtexlib, the built-in tiers follow in the order of CEtc1::EQuality
+	double fPsnr[4] = {};
+	for (n32 nQuality = -1; nQuality <= CEtc1::kQualitySlow; nQuality++)
+	{
+		ctpk.SetEtc1Quality(nQuality);
+		if (!ctpk.EncodeTexture(0, 0, vOriginalRGBA.data()) || !ctpk.DecodeTexture(0, 0, vRGBA.data()))
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" etc1 quality %d failed\n\n"), sCase.c_str(), nQuality);
+			return false;
+		}
+		fPsnr[nQuality + 1] = getPsnr(vOriginalRGBA.data(), vRGBA.data(), static_cast<n32>(vRGBA.size()));
+	}
+	UPrintf(USTR("verify: %") PRIUS USTR(" psnr pvrtexlib %.2f dB, fast %.2f dB, medium %.2f dB, slow %.2f dB\n"), sCase.c_str(), fPsnr[0], fPsnr[1], fPsnr[2], fPsnr[3]);
+	bool bResult = true;
+	for (n32 nQuality = CEtc1::kQualityFast; nQuality <= CEtc1::kQualitySlow; nQuality++)
+	{
+		if (fPsnr[nQuality + 1] < fPsnr[0] - s_fEtc1PsnrMargin[nQuality])
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" etc1 %") PRIUS USTR(" psnr %.2f dB is more than %.2f dB below pvrtexlib %.2f dB\n\n"), sCase.c_str(), AToU(c_pQualityName[nQuality]).c_str(), fPsnr[nQuality + 1], s_fEtc1PsnrMargin[nQuality], fPsnr[0]);
+			bResult = false;
+		}
+	}
+	return bResult;
+}
+
+// with one job the textures run on the thread that calls ExportFile and ImportFile, a thread of its own starts with an empty arena,
+// so the reserve sized by getScratchSize must be its only heap allocation, whatever libpng, zlib or the codecs take beyond that estimate would overflow
+bool CCtpkBench::verifyArena(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, bool a_bKtx)
+{
+	UString sCase = AToU(Format("%s %dx%d mip %d%s", s_pFormatName[a_nFormat], a_nWidth, a_nHeight, a_nMipLevel, a_bKtx ? " ktx" : ""));
+	vector<u8> vCtpk;
+	makeCtpk(a_nFormat, a_nWidth, a_nHeight, a_nMipLevel, vCtpk);
+	CCtpk ctpk;
+	if (!ctpk.Open(vCtpk.data(), vCtpk.size()))
+	{
+		return false;
+	}
+	n32 nTexDataSize = ctpk.GetTextureInfo(0)->TexDataSize;
+	u8* pTexData = ctpk.GetTexData(0);
+	makeNoise(pTexData, nTexDataSize);
+	vector<u8> vOriginal = vCtpk;
+	UString sFileName = m_sDirName + USTR("/arena.ctpk");
+	UString sDirName = m_sDirName + USTR("/arena");
+	bool bResult = true;
+	thread worker([&]()
+	{
+		for (n32 nRun = 0; nRun < 3 && bResult; nRun++)
+		{
+			// the texture is cleared before every import so that each one encodes all of it again
+			memcpy(vCtpk.data(), vOriginal.data(), vCtpk.size());
+			bResult = writeFile(sFileName, vCtpk);
+			if (bResult)
+			{
+				CCtpk exporter;
+				exporter.SetFileName(sFileName);
+				exporter.SetDirName(sDirName);
+				exporter.SetKtx(a_bKtx);
+				bResult = exporter.ExportFile();
+			}
+			if (bResult)
+			{
+				memset(pTexData, 0, nTexDataSize);
+				bResult = writeFile(sFileName, vCtpk);
+			}
+			if (bResult)
+			{
+				CCtpk importer;
+				importer.SetFileName(sFileName);
+				importer.SetDirName(sDirName);
+				importer.SetKtx(a_bKtx);
+				importer.SetEtc1Quality(m_nEtc1Quality);
+				bResult = importer.ImportFile();
+			}
+			if (!bResult)
+			{
+				UPrintf(USTR("ERROR: %") PRIUS USTR(" arena round trip failed\n\n"), sCase.c_str());
+				break;
+			}
+			n64 nHeapAllocCount = CArena::GetThreadArena().GetHeapAllocCount();
+			if (nHeapAllocCount != 1)
+			{
+				UPrintf(USTR("ERROR: %") PRIUS USTR(" run %d made %d heap allocations in the arena beyond its reserve\n\n"), sCase.c_str(), nRun, static_cast<n32>(nHeapAllocCount - 1));
+				bResult = false;
+			}
+		}
+	});
+	worker.join();
+	return bResult;
+}
+
+// mipmaps, encode, decode and png of one texture, on a pool without workers and a warmed arena, must not reach operator new at all
+bool CCtpkBench::verifyHeap(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel)
+{
+	UString sCase = AToU(Format("%s %dx%d mip %d", s_pFormatName[a_nFormat], a_nWidth, a_nHeight, a_nMipLevel));
+	bool bEtc1 = a_nFormat == CCtpk::kTextureFormatETC1 || a_nFormat == CCtpk::kTextureFormatETC1_A4;
+	vector<n32> vRGBAOffset(a_nMipLevel + 1);
+	vector<n32> vTexDataOffset(a_nMipLevel + 1);
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		vRGBAOffset[l + 1] = vRGBAOffset[l] + (a_nWidth >> l) * (a_nHeight >> l) * 4;
+		vTexDataOffset[l + 1] = vTexDataOffset[l] + (a_nWidth >> l) * (a_nHeight >> l) * CCtpk::s_nBPP[a_nFormat] / 8;
+	}
+	vector<u8> vRGBA(vRGBAOffset[a_nMipLevel]);
+	vector<u8> vDecode(vRGBAOffset[a_nMipLevel]);
+	vector<u8> vTexData(vTexDataOffset[a_nMipLevel]);
+	makeImage(a_nWidth, a_nHeight, vRGBA.data());
+	FILE* fp = tmpfile();
+	if (fp == nullptr)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" open tmpfile failed\n\n"), sCase.c_str());
+		return false;
+	}
+	CThreadPool& threadPool = CThreadPool::GetThreadPool(1);
+	CArena arena;
+	CEtc1::EQuality eQuality = static_cast<CEtc1::EQuality>(m_nEtc1Quality >= 0 ? m_nEtc1Quality : CEtc1::kQualityFast);
+	bool bResult = true;
+	n64 nOperatorNewCount = 0;
+	// the first run grows the arena, the second has to live in it
+	for (n32 nRun = 0; nRun < 2; nRun++)
+	{
+		n64 nBegin = s_nOperatorNewCount;
+		for (n32 nFilter = CMipmap::kFilterBox; nFilter <= CMipmap::kFilterKaiser; nFilter++)
+		{
+			CMipmap::Generate(vRGBA.data(), vRGBA.data() + vRGBAOffset[1], a_nWidth, a_nHeight, a_nMipLevel, static_cast<CMipmap::EFilter>(nFilter), arena);
+			arena.Reset();
+		}
+		rewind(fp);
+		for (n32 l = 0; l < a_nMipLevel; l++)
+		{
+			n32 nMipmapWidth = a_nWidth >> l;
+			n32 nMipmapHeight = a_nHeight >> l;
+			if (bEtc1)
+			{
+				CEtc1::Encode(vRGBA.data() + vRGBAOffset[l], vTexData.data() + vTexDataOffset[l], nMipmapWidth, nMipmapHeight, a_nFormat == CCtpk::kTextureFormatETC1_A4, eQuality, threadPool);
+				CEtc1::Decode(vTexData.data() + vTexDataOffset[l], vDecode.data() + vRGBAOffset[l], nMipmapWidth, nMipmapHeight, a_nFormat == CCtpk::kTextureFormatETC1_A4);
+			}
+			else
+			{
+				bResult = CPixelFormat::Encode(vRGBA.data() + vRGBAOffset[l], vTexData.data() + vTexDataOffset[l], nMipmapWidth, nMipmapHeight, a_nFormat) && bResult;
+				bResult = CPixelFormat::Decode(vTexData.data() + vTexDataOffset[l], vDecode.data() + vRGBAOffset[l], nMipmapWidth, nMipmapHeight, a_nFormat) && bResult;
+			}
+			bResult = CPngWriter::Write(fp, vDecode.data() + vRGBAOffset[l], nMipmapWidth, nMipmapHeight, CPngWriter::kEffortDefault, CPngWriter::kFilterPaeth, threadPool, arena) && bResult;
+			arena.Reset();
+		}
+		nOperatorNewCount = s_nOperatorNewCount - nBegin;
+	}
+	fclose(fp);
+	if (!bResult)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" heap stages failed\n\n"), sCase.c_str());
+		return false;
+	}
+	if (nOperatorNewCount != 0)
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR(" made %d calls to operator new once the arena was warm\n\n"), sCase.c_str(), static_cast<n32>(nOperatorNewCount));
+		return false;
+	}
+	return true;
+}
+
+// a ctpk with the single texture bench.tga and TexDataSize holding every level exactly
+void CCtpkBench::makeCtpk(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, vector<u8>& a_vCtpk)
+{
+	static const char c_szFilePath[] = "bench.tga";
+	n32 nTexDataSize = 0;
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		nTexDataSize += (a_nWidth >> l) * (a_nHeight >> l) * CCtpk::s_nBPP[a_nFormat] / 8;
+	}
+	n32 nFilePathOffset = sizeof(SCtpkHeader) + sizeof(SCtrTextureInfo);
+	n32 nTextureShortInfoOffset = (nFilePathOffset + sizeof(c_szFilePath) + 3) / 4 * 4;
+	n32 nTextureOffset = (nTextureShortInfoOffset + sizeof(STextureShortInfo) + 0x7F) / 0x80 * 0x80;
+	a_vCtpk.assign(nTextureOffset + nTexDataSize, 0);
+	SCtpkHeader* pCtpkHeader = reinterpret_cast<SCtpkHeader*>(a_vCtpk.data());
+	pCtpkHeader->Signature = CCtpk::s_uSignature;
+	pCtpkHeader->Version = 1;
+	pCtpkHeader->Count = 1;
+	pCtpkHeader->TextureOffset = nTextureOffset;
+	pCtpkHeader->TextureSize = nTexDataSize;
+	pCtpkHeader->TextureShortInfoOffset = nTextureShortInfoOffset;
+	SCtrTextureInfo* pCtrTextureInfo = reinterpret_cast<SCtrTextureInfo*>(a_vCtpk.data() + sizeof(SCtpkHeader));
+	pCtrTextureInfo->FilePathOffset = nFilePathOffset;
+	pCtrTextureInfo->TexDataSize = nTexDataSize;
+	pCtrTextureInfo->TexFormat = a_nFormat;
+	pCtrTextureInfo->Width = a_nWidth;
+	pCtrTextureInfo->Height = a_nHeight;
+	pCtrTextureInfo->MipLevel = a_nMipLevel;
+	memcpy(a_vCtpk.data() + nFilePathOffset, c_szFilePath, sizeof(c_szFilePath));
+	STextureShortInfo* pTextureShortInfo = reinterpret_cast<STextureShortInfo*>(a_vCtpk.data() + nTextureShortInfoOffset);
+	pTextureShortInfo->TextFormat = a_nFormat;
+	pTextureShortInfo->MipLevel = a_nMipLevel;
+}
+
+// smooth gradients with a little noise and an alpha pattern, closer to game art than pure noise for both etc1 and deflate
+void CCtpkBench::makeImage(n32 a_nWidth, n32 a_nHeight, u8* a_pRGBA)
+{
+	u32 uSeed = 0x12345678;
+	for (n32 nY = 0; nY < a_nHeight; nY++)
+	{
+		for (n32 nX = 0; nX < a_nWidth; nX++)
+		{
+			uSeed = uSeed * 1103515245 + 12345;
+			n32 nNoise = static_cast<n32>(uSeed >> 28) - 8;
+			u8* pPixel = a_pRGBA + (nY * a_nWidth + nX) * 4;
+			pPixel[0] = static_cast<u8>(min(max(nX * 255 / a_nWidth + nNoise, 0), 255));
+			pPixel[1] = static_cast<u8>(min(max(nY * 255 / a_nHeight + nNoise, 0), 255));
+			pPixel[2] = static_cast<u8>(min(max((nX * 255 / a_nWidth + nY * 255 / a_nHeight) / 2 - nNoise, 0), 255));
+			pPixel[3] = static_cast<u8>(((nX ^ nY) & 0x3F) * 4);
+		}
+	}
+}
+
+void CCtpkBench::makeNoise(u8* a_pData, n32 a_nSize)
+{
+	u32 uSeed = 0x87654321;
+	for (n32 i = 0; i < a_nSize; i++)
+	{
+		uSeed = uSeed * 1103515245 + 12345;
+		a_pData[i] = static_cast<u8>(uSeed >> 24);
+	}
+}
+
+bool CCtpkBench::readPng(FILE* a_fp, n32 a_nWidth, n32 a_nHeight, u8* a_pRGBA)
+{
+	png_structp pPng = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if (pPng == nullptr)
+	{
+		return false;
+	}
+	png_infop pInfo = png_create_info_struct(pPng);
+	if (pInfo == nullptr)
+	{
+		png_destroy_read_struct(&pPng, nullptr, nullptr);
+		return false;
+	}
+	vector<png_bytep> vRowPointer(a_nHeight);
+	for (n32 i = 0; i < a_nHeight; i++)
+	{
+		vRowPointer[i] = a_pRGBA + i * a_nWidth * 4;
+	}
+	if (setjmp(png_jmpbuf(pPng)) != 0)
+	{
+		png_destroy_read_struct(&pPng, &pInfo, nullptr);
+		return false;
+	}
+	png_init_io(pPng, a_fp);
+	png_read_info(pPng, pInfo);
+	bool bResult = static_cast<n32>(png_get_image_width(pPng, pInfo)) == a_nWidth && static_cast<n32>(png_get_image_height(pPng, pInfo)) == a_nHeight && png_get_bit_depth(pPng, pInfo) == 8 && png_get_color_type(pPng, pInfo) == PNG_COLOR_TYPE_RGB_ALPHA;
+	if (bResult)
+	{
+		png_read_image(pPng, vRowPointer.data());
+	}
+	png_destroy_read_struct(&pPng, &pInfo, nullptr);
+	return bResult;
+}
+
+bool CCtpkBench::readFile(const UString& a_sFileName, vector<u8>& a_vData)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("rb"));
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	Fseek(fp, 0, SEEK_END);
+	a_vData.resize(static_cast<size_t>(Ftell(fp)));
+	Fseek(fp, 0, SEEK_SET);
+	bool bResult = fread(a_vData.data(), 1, a_vData.size(), fp) == a_vData.size();
+	fclose(fp);
+	return bResult;
+}
+
+bool CCtpkBench::writeFile(const UString& a_sFileName, const vector<u8>& a_vData)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("wb"));
+	if (fp == nullptr)
+	{
+		UPrintf(USTR("ERROR: open %") PRIUS USTR(" failed\n\n"), a_sFileName.c_str());
+		return false;
+	}
+	bool bResult = fwrite(a_vData.data(), 1, a_vData.size(), fp) == a_vData.size();
+	fclose(fp);
+	return bResult;
+}
+
+double CCtpkBench::getPsnr(const u8* a_pRGBA0, const u8* a_pRGBA1, n32 a_nSize)
+{
+	double fError = 0;
+	for (n32 i = 0; i < a_nSize; i++)
+	{
+		double fDelta = static_cast<double>(a_pRGBA0[i]) - a_pRGBA1[i];
+		fError += fDelta * fDelta;
+	}
+	if (fError == 0)
+	{
+		return 99.0;
+	}
+	return 10 * log10(255.0 * 255.0 * a_nSize / fError);
+}
+
+int UMain(int argc, UChar* argv[])
+{
+	CCtpkBench bench;
+	if (bench.ParseOptions(argc, argv) != 0)
+	{
+		return bench.Help();
+	}
+	if (bench.CheckOptions() != 0)
+	{
+		return 1;
+	}
+	return bench.Action();
+}
@@ -0,0 +1,88 @@
+#ifndef CTPKBENCH_H_
+#define CTPKBENCH_H_
+
+#include <sdw.h>
+
+class CCtpkBench
+{
+public:
+	enum EParseOptionReturn
+	{
+		kParseOptionReturnSuccess,
+		kParseOptionReturnIllegalOption,
+		kParseOptionReturnNoArgument,
+		kParseOptionReturnUnknownArgument,
+		kParseOptionReturnOptionConflict
+	};
+	enum EStage
+	{
+		kStageDecode,
+		kStageEncode,
+		kStageMipmap,
+		kStagePngWrite,
+		kStagePngRead,
+		kStageCount
+	};
+	struct SOption
+	{
+		const UChar* Name;
+		int Key;
+		const UChar* Doc;
+	};
+	struct SResult
+	{
+		n32 Format;
+		n32 Size;
+		n32 MipLevel;
+		n32 Stage;
+		double MPixPerSecond;
+		double MBytesPerSecond;
+	};
+	CCtpkBench();
+	~CCtpkBench();
+	int ParseOptions(int a_nArgc, UChar* a_pArgv[]);
+	int CheckOptions();
+	int Help();
+	int Action();
+	static SOption s_Option[];
+private:
+	EParseOptionReturn parseOptions(const UChar* a_pName, int& a_nIndex, int a_nArgc, UChar* a_pArgv[]);
+	bool benchTexture(n32 a_nFormat, n32 a_nSize, n32 a_nMipLevel);
+	void addResult(n32 a_nFormat, n32 a_nSize, n32 a_nMipLevel, n32 a_nStage, double a_fSeconds, n64 a_nPixelCount, n64 a_nByteCount);
+	double measure(const function<void()>& a_fStage) const;
+	bool writeJson() const;
+	bool compareBaseline() const;
+	bool verify();
+	bool verifyCtpk(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, bool a_bKtx);
+	bool verifyIcon(n32 a_nSize);
+	bool verifyKtx(n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel);
+	bool verifyEtc1Quality(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight);
+	bool verifyGolden(n32 a_nFormat);
+	bool verifyArena(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, bool a_bKtx);
+	bool verifyHeap(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel);
+	static void makeCtpk(n32 a_nFormat, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, vector<u8>& a_vCtpk);
+	static void makeImage(n32 a_nWidth, n32 a_nHeight, u8* a_pRGBA);
+	static void makeNoise(u8* a_pData, n32 a_nSize);
+	static bool readPng(FILE* a_fp, n32 a_nWidth, n32 a_nHeight, u8* a_pRGBA);
+	static bool readFile(const UString& a_sFileName, vector<u8>& a_vData);
+	static bool writeFile(const UString& a_sFileName, const vector<u8>& a_vData);
+	static double getPsnr(const u8* a_pRGBA0, const u8* a_pRGBA1, n32 a_nSize);
+	static const char* s_pFormatName[];
+	static const char* s_pStageName[];
+	static const double s_fEtc1MinPsnr;
+	static const double s_fEtc1PsnrMargin[];
+	static const u64 s_uGoldenPixelHash[];
+	static const u64 s_uGoldenTexDataHash[];
+	bool m_bVerify;
+	UString m_sDirName;
+	UString m_sJsonFileName;
+	UString m_sBaselineFileName;
+	n32 m_nEtc1Quality;
+	n32 m_nMaxSize;
+	n32 m_nMinTime;
+	n32 m_nTolerance;
+	vector<SResult> m_vResult;
+	UString m_sMessage;
+};
+
+#endif	// CTPKBENCH_H_
@@ -0,0 +1,81 @@
+#include "arena.h"
+
+// a whole cache line, which also covers the 32 byte loads of the avx2 kernels
+const n64 CArena::s_nAlignment = 64;
+
+static inline u8* alignUp(u8* a_pData, n64 a_nAlignment)
+{
+	return reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(a_pData) + a_nAlignment - 1) & ~static_cast<uintptr_t>(a_nAlignment - 1));
+}
+
+CArena::CArena()
+	: m_pStorage(nullptr)
+	, m_pBlock(nullptr)
+	, m_nCapacity(0)
+	, m_nOffset(0)
+	, m_nUsed(0)
+	, m_nHeapAllocCount(0)
+{
+}
+
+CArena::~CArena()
+{
+	Reset();
+	delete[] m_pStorage;
+}
+
+// only between two textures, the block moves when it grows
+void CArena::Reserve(n64 a_nSize)
+{
+	if (a_nSize <= m_nCapacity)
+	{
+		return;
+	}
+	delete[] m_pStorage;
+	m_pStorage = new u8[static_cast<size_t>(a_nSize + s_nAlignment)];
+	m_pBlock = alignUp(m_pStorage, s_nAlignment);
+	m_nCapacity = a_nSize;
+	m_nOffset = 0;
+	m_nHeapAllocCount++;
+}
+
+// whatever did not fit in the block is freed and the block grows to cover it, so the next texture of that size runs without the heap
+void CArena::Reset()
+{
+	for (n32 i = 0; i < static_cast<n32>(m_vOverflow.size()); i++)
+	{
+		delete[] m_vOverflow[i];
+	}
+	m_vOverflow.clear();
+	n64 nUsed = m_nUsed;
+	m_nOffset = 0;
+	m_nUsed = 0;
+	Reserve(nUsed);
+}
+
+n64 CArena::GetHeapAllocCount() const
+{
+	return m_nHeapAllocCount;
+}
+
+CArena& CArena::GetThreadArena()
+{
+	static thread_local CArena s_Arena;
+	return s_Arena;
+}
+
+void* CArena::alloc(n64 a_nSize)
+{
+	n64 nSize = (a_nSize + s_nAlignment - 1) / s_nAlignment * s_nAlignment;
+	m_nUsed += nSize;
+	if (m_nOffset + nSize <= m_nCapacity)
+	{
+		u8* pData = m_pBlock + m_nOffset;
+		m_nOffset += nSize;
+		return pData;
+	}
+	u8* pStorage = new u8[static_cast<size_t>(nSize + s_nAlignment)];
+	m_vOverflow.push_back(pStorage);
+	m_nHeapAllocCount++;
+	return alignUp(pStorage, s_nAlignment);
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <sdw.h>
+
+class CArena
+{
+public:
+	CArena();
+	~CArena();
+	void Reserve(n64 a_nSize);
+	void Reset();
+	template<typename T>
+	T* Alloc(n64 a_nCount);
+	n64 GetHeapAllocCount() const;
+	static CArena& GetThreadArena();
+	static const n64 s_nAlignment;
+private:
+	CArena(const CArena&);
+	CArena& operator=(const CArena&);
+	void* alloc(n64 a_nSize);
+	u8* m_pStorage;
+	u8* m_pBlock;
+	n64 m_nCapacity;
+	n64 m_nOffset;
+	n64 m_nUsed;
+	vector<u8*> m_vOverflow;
+	n64 m_nHeapAllocCount;
+};
+
+template<typename T>
+T* CArena::Alloc(n64 a_nCount)
+{
+	return static_cast<T*>(alloc(a_nCount * static_cast<n64>(sizeof(T))));
+}
+
+#endif	// ARENA_H_
@@ -1,23 +1,119 @@
 #include "ctpk.h"
+#include "arena.h"
+#include "etc1.h"
+#include "hash.h"
+#include "ktx.h"
+#include "mappedfile.h"
+#include "mipmap.h"
+#include "pixelformat.h"
+#include "pngwriter.h"
+#include "positionedfile.h"
+#include "swizzle.h"
+#include "threadpool.h"
+#include <chrono>
 #include <png.h>
 #include <PVRTextureUtilities.h>
 
 const u32 CCtpk::s_uSignature = SDW_CONVERT_ENDIAN32('CTPK');
 const int CCtpk::s_nBPP[] = { 32, 24, 16, 16, 16, 16, 16, 8, 8, 8, 4, 4, 4, 8 };
-const int CCtpk::s_nDecodeTransByte[64] =
-{
-	 0,  1,  4,  5, 16, 17, 20, 21,
-	 2,  3,  6,  7, 18, 19, 22, 23,
-	 8,  9, 12, 13, 24, 25, 28, 29,
-	10, 11, 14, 15, 26, 27, 30, 31,
-	32, 33, 36, 37, 48, 49, 52, 53,
-	34, 35, 38, 39, 50, 51, 54, 55,
-	40, 41, 44, 45, 56, 57, 60, 61,
-	42, 43, 46, 47, 58, 59, 62, 63
+const UChar* CCtpk::s_pManifestFileName = USTR("ctpktool.manifest");
+const char* CCtpk::s_pFormatName[] = { "RGBA8888", "RGB888", "RGBA5551", "RGB565", "RGBA4444", "LA88", "HL8", "L8", "A8", "LA44", "L4", "A4", "ETC1", "ETC1_A4" };
+const char* CCtpk::s_pStatsStageName[] = { "read", "deswizzle", "transcode", "mipmap", "png-encode", "png-decode", "write" };
+// the native layout of every format, the 4 bit ones widened to the nearest gl format and etc1_a4 split into an etc1 file and an alpha file
+const CKtx::SFormat CCtpk::s_KtxFormat[] =
+{
+	{ 0x1401, 1, 0x1908, 0x8058, 0x1908, 32 },
+	{ 0x1401, 1, 0x1907, 0x8051, 0x1907, 24 },
+	{ 0x8034, 2, 0x1908, 0x8057, 0x1908, 16 },
+	{ 0x8363, 2, 0x1907, 0x8D62, 0x1907, 16 },
+	{ 0x8033, 2, 0x1908, 0x8056, 0x1908, 16 },
+	{ 0x1401, 1, 0x190A, 0x8045, 0x190A, 16 },
+	{ 0x1401, 1, 0x8227, 0x822B, 0x8227, 16 },
+	{ 0x1401, 1, 0x1909, 0x8040, 0x1909, 8 },
+	{ 0x1401, 1, 0x1906, 0x803C, 0x1906, 8 },
+	{ 0x1401, 1, 0x190A, 0x8045, 0x190A, 16 },
+	{ 0x1401, 1, 0x1909, 0x8040, 0x1909, 8 },
+	{ 0x1401, 1, 0x1906, 0x803C, 0x1906, 8 },
+	{ 0, 1, 0, 0x8D64, 0x1907, 4 },
+	{ 0, 1, 0, 0x8D64, 0x1907, 4 }
 };
 
+static inline n64 getMicrosecond()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// libpng takes its structs, the inflate window and the row buffers from the arena, which gets all of it back at Reset
+static png_voidp pngAlloc(png_structp a_pPng, png_alloc_size_t a_uSize)
+{
+	return static_cast<CArena*>(png_get_mem_ptr(a_pPng))->Alloc<u8>(static_cast<n64>(a_uSize));
+}
+
+static void pngFree(png_structp a_pPng, png_voidp a_pData)
+{
+}
+
+CCtpk::STextureStats::STextureStats()
+	: Format(0)
+	, Width(0)
+	, Height(0)
+	, MipLevel(0)
+	, PixelCount(0)
+	, BytesIn(0)
+	, BytesOut(0)
+{
+	memset(Time, 0, sizeof(Time));
+}
+
+CCtpk::STextureHash::STextureHash()
+	: TexData(0)
+	, File(0)
+	, Pixel(0)
+	, Imported(false)
+{
+}
+
+CCtpk::STextureEntry::STextureEntry()
+	: Size(0)
+{
+	memset(&Info, 0, sizeof(Info));
+	memset(&ShortInfo, 0, sizeof(ShortInfo));
+}
+
+CCtpk::STextureTask::STextureTask()
+	: Index(0)
+	, Cost(0)
+	, ScratchSize(0)
+	, Jobs(1)
+	, Arena(nullptr)
+	, InManifest(false)
+	, Changed(false)
+	, Result(true)
+	, Done(false)
+	, Selected(true)
+{
+}
+
+CCtpk::SDirtyRange::SDirtyRange()
+	: Offset(0)
+	, Size(0)
+{
+}
+
 CCtpk::CCtpk()
 	: m_bVerbose(false)
+	, m_nJobs(1)
+	, m_nEtc1Quality(-1)
+	, m_bIncremental(false)
+	, m_nPngEffort(CPngWriter::kEffortDefault)
+	, m_bKtx(false)
+	, m_nMipmapFilter(CMipmap::kFilterBox)
+	, m_pThreadPool(nullptr)
+	, m_nSyncMode(CPositionedFile::kSyncModeNone)
+	, m_bAtomic(false)
+	, m_pLog(nullptr)
+	, m_pCtpk(nullptr)
+	, m_nCtpkSize(0)
 {
 }
 
@@ -40,85 +136,473 @@ void CCtpk::SetVerbose(bool a_bVerbose)
 	m_bVerbose = a_bVerbose;
 }
 
+void CCtpk::SetJobs(n32 a_nJobs)
+{
+	m_nJobs = a_nJobs;
+}
+
+void CCtpk::SetEtc1Quality(n32 a_nEtc1Quality)
+{
+	m_nEtc1Quality = a_nEtc1Quality;
+}
+
+void CCtpk::SetIncremental(bool a_bIncremental)
+{
+	m_bIncremental = a_bIncremental;
+}
+
+void CCtpk::SetPngEffort(n32 a_nPngEffort)
+{
+	m_nPngEffort = a_nPngEffort;
+}
+
+void CCtpk::SetKtx(bool a_bKtx)
+{
+	m_bKtx = a_bKtx;
+}
+
+void CCtpk::SetMipmapFilter(n32 a_nMipmapFilter)
+{
+	m_nMipmapFilter = a_nMipmapFilter;
+}
+
+void CCtpk::SetThreadPool(CThreadPool* a_pThreadPool)
+{
+	m_pThreadPool = a_pThreadPool;
+}
+
+void CCtpk::SetOnly(const vector<UString>& a_vOnly)
+{
+	m_vOnly = a_vOnly;
+}
+
+void CCtpk::SetIndex(const vector<n32>& a_vIndex)
+{
+	m_vIndex = a_vIndex;
+}
+
+void CCtpk::SetSyncMode(n32 a_nSyncMode)
+{
+	m_nSyncMode = a_nSyncMode;
+}
+
+void CCtpk::SetAtomic(bool a_bAtomic)
+{
+	m_bAtomic = a_bAtomic;
+}
+
+// the texture logs and the verbose lines go to a_pLog in index order, the library prints nothing itself
+void CCtpk::SetLog(UString* a_pLog)
+{
+	m_pLog = a_pLog;
+}
+
+// the span is borrowed, not copied, EncodeTexture writes straight into it and it has to outlive every call up to Close
+bool CCtpk::Open(u8* a_pCtpk, n64 a_nCtpkSize)
+{
+	Close();
+	if (a_pCtpk == nullptr || a_nCtpkSize < static_cast<n64>(sizeof(SCtpkHeader)))
+	{
+		m_sLastError = USTR("ctpk is too small");
+		return false;
+	}
+	const SCtpkHeader* pCtpkHeader = reinterpret_cast<const SCtpkHeader*>(a_pCtpk);
+	if (pCtpkHeader->Signature != s_uSignature)
+	{
+		m_sLastError = USTR("not a ctpk");
+		return false;
+	}
+	if (!checkTextureTable(*pCtpkHeader, a_nCtpkSize))
+	{
+		return false;
+	}
+	const SCtrTextureInfo* pCtrTextureInfo = reinterpret_cast<const SCtrTextureInfo*>(a_pCtpk + sizeof(SCtpkHeader));
+	const STextureShortInfo* pTextureShortInfo = reinterpret_cast<const STextureShortInfo*>(a_pCtpk + pCtpkHeader->TextureShortInfoOffset);
+	for (n32 i = 0; i < pCtpkHeader->Count; i++)
+	{
+		if (!checkTextureInfo(*pCtpkHeader, pCtrTextureInfo[i], pTextureShortInfo[i], i, a_nCtpkSize))
+		{
+			return false;
+		}
+		if (memchr(a_pCtpk + pCtrTextureInfo[i].FilePathOffset, 0, static_cast<size_t>(a_nCtpkSize - pCtrTextureInfo[i].FilePathOffset)) == nullptr)
+		{
+			m_sLastError = AToU(Format("file path of texture %d is out of range", i));
+			return false;
+		}
+	}
+	m_pCtpk = a_pCtpk;
+	m_nCtpkSize = a_nCtpkSize;
+	return true;
+}
+
+void CCtpk::Close()
+{
+	m_pCtpk = nullptr;
+	m_nCtpkSize = 0;
+}
+
+n32 CCtpk::GetTextureCount() const
+{
+	return m_pCtpk != nullptr ? reinterpret_cast<const SCtpkHeader*>(m_pCtpk)->Count : 0;
+}
+
+const SCtrTextureInfo* CCtpk::GetTextureInfo(n32 a_nIndex) const
+{
+	if (a_nIndex < 0 || a_nIndex >= GetTextureCount())
+	{
+		return nullptr;
+	}
+	return reinterpret_cast<const SCtrTextureInfo*>(m_pCtpk + sizeof(SCtpkHeader)) + a_nIndex;
+}
+
+UString CCtpk::GetTextureName(n32 a_nIndex) const
+{
+	const SCtrTextureInfo* pCtrTextureInfo = GetTextureInfo(a_nIndex);
+	if (pCtrTextureInfo == nullptr)
+	{
+		return USTR("");
+	}
+	return XToU(reinterpret_cast<const char*>(m_pCtpk + pCtrTextureInfo->FilePathOffset), 932, "CP932");
+}
+
+u8* CCtpk::GetTexData(n32 a_nIndex) const
+{
+	const SCtrTextureInfo* pCtrTextureInfo = GetTextureInfo(a_nIndex);
+	if (pCtrTextureInfo == nullptr)
+	{
+		return nullptr;
+	}
+	return m_pCtpk + reinterpret_cast<const SCtpkHeader*>(m_pCtpk)->TextureOffset + pCtrTextureInfo->TexDataOffset;
+}
+
+// a_pRGBA holds (Width >> a_nLevel) * (Height >> a_nLevel) pixels
+bool CCtpk::DecodeTexture(n32 a_nIndex, n32 a_nLevel, u8* a_pRGBA) const
+{
+	if (!checkLevel(a_nIndex, a_nLevel))
+	{
+		return false;
+	}
+	const SCtrTextureInfo& ctrTextureInfo = *GetTextureInfo(a_nIndex);
+	return decode(GetTexData(a_nIndex) + getLevelOffset(ctrTextureInfo, a_nLevel), ctrTextureInfo.Width >> a_nLevel, ctrTextureInfo.Height >> a_nLevel, ctrTextureInfo.TexFormat, a_pRGBA) == 0;
+}
+
+// a_nLevel is encoded from a_pRGBA and every level after it is generated with the mipmap filter,
+// so a caller with its own mipmaps replaces them in ascending order
+bool CCtpk::EncodeTexture(n32 a_nIndex, n32 a_nLevel, const u8* a_pRGBA)
+{
+	if (!checkLevel(a_nIndex, a_nLevel))
+	{
+		return false;
+	}
+	const SCtrTextureInfo& ctrTextureInfo = *GetTextureInfo(a_nIndex);
+	n32 nWidth = ctrTextureInfo.Width >> a_nLevel;
+	n32 nHeight = ctrTextureInfo.Height >> a_nLevel;
+	n32 nMipLevel = getLayoutMipLevel(ctrTextureInfo);
+	n32 nOffset = getLevelOffset(ctrTextureInfo, a_nLevel);
+	n32 nSize = getLevelOffset(ctrTextureInfo, nMipLevel) - nOffset;
+	if (nSize > static_cast<n32>(ctrTextureInfo.TexDataSize) - nOffset)
+	{
+		nSize = ctrTextureInfo.TexDataSize - nOffset;
+	}
+	CArena arena;
+	u8* pBuffer = nullptr;
+	encode(a_pRGBA, nWidth, nHeight, ctrTextureInfo.TexFormat, nMipLevel - a_nLevel, s_nBPP[ctrTextureInfo.TexFormat], &pBuffer, m_nEtc1Quality, m_nMipmapFilter, m_nJobs > 0 ? m_nJobs : CThreadPool::GetAutoThreadCount(), arena, nullptr);
+	memcpy(GetTexData(a_nIndex) + nOffset, pBuffer, nSize);
+	return true;
+}
+
+// only the tables in front of TextureOffset are read, with a handful of positioned reads however large the archive is
+bool CCtpk::ListFile(SCtpkHeader& a_CtpkHeader, vector<STextureEntry>& a_vTextureEntry) const
+{
+	a_vTextureEntry.clear();
+	CPositionedFile file;
+	if (!file.Open(m_sFileName, CPositionedFile::kOpenModeRead))
+	{
+		m_sLastError = USTR("open ") + m_sFileName + USTR(" failed");
+		return false;
+	}
+	n64 nCtpkSize = file.GetSize();
+	if (!file.Read(0, &a_CtpkHeader, sizeof(SCtpkHeader)))
+	{
+		m_sLastError = USTR("ctpk is too small");
+		return false;
+	}
+	if (a_CtpkHeader.Signature != s_uSignature)
+	{
+		m_sLastError = USTR("not a ctpk");
+		return false;
+	}
+	if (!checkTextureTable(a_CtpkHeader, nCtpkSize))
+	{
+		return false;
+	}
+	if (a_CtpkHeader.Count == 0)
+	{
+		return true;
+	}
+	vector<SCtrTextureInfo> vCtrTextureInfo(a_CtpkHeader.Count);
+	vector<STextureShortInfo> vTextureShortInfo(a_CtpkHeader.Count);
+	if (!file.Read(sizeof(SCtpkHeader), vCtrTextureInfo.data(), a_CtpkHeader.Count * sizeof(SCtrTextureInfo)) || !file.Read(a_CtpkHeader.TextureShortInfoOffset, vTextureShortInfo.data(), a_CtpkHeader.Count * sizeof(STextureShortInfo)))
+	{
+		m_sLastError = USTR("read texture table failed");
+		return false;
+	}
+	// the paths sit between the info table and TextureOffset, they come in with one read
+	n64 nPathBegin = a_CtpkHeader.TextureOffset;
+	for (n32 i = 0; i < a_CtpkHeader.Count; i++)
+	{
+		if (!checkTextureInfo(a_CtpkHeader, vCtrTextureInfo[i], vTextureShortInfo[i], i, nCtpkSize))
+		{
+			return false;
+		}
+		nPathBegin = min<n64>(nPathBegin, vCtrTextureInfo[i].FilePathOffset);
+	}
+	vector<char> vPath(static_cast<size_t>(a_CtpkHeader.TextureOffset - nPathBegin));
+	if (!vPath.empty() && !file.Read(nPathBegin, vPath.data(), vPath.size()))
+	{
+		m_sLastError = USTR("read file path failed");
+		return false;
+	}
+	a_vTextureEntry.resize(a_CtpkHeader.Count);
+	for (n32 i = 0; i < a_CtpkHeader.Count; i++)
+	{
+		// a path elsewhere, or one that runs on past TextureOffset, is read by itself
+		n64 nOffset = vCtrTextureInfo[i].FilePathOffset;
+		const char* pPath = nOffset < a_CtpkHeader.TextureOffset ? vPath.data() + (nOffset - nPathBegin) : nullptr;
+		const char* pPathEnd = pPath != nullptr ? static_cast<const char*>(memchr(pPath, 0, static_cast<size_t>(a_CtpkHeader.TextureOffset - nOffset))) : nullptr;
+		string sPath;
+		if (pPathEnd != nullptr)
+		{
+			sPath.assign(pPath, pPathEnd);
+		}
+		else if (!readFilePath(file, nOffset, sPath))
+		{
+			m_sLastError = AToU(Format("file path of texture %d is out of range", i));
+			a_vTextureEntry.clear();
+			return false;
+		}
+		STextureEntry& textureEntry = a_vTextureEntry[i];
+		textureEntry.Name = XToU(sPath.c_str(), 932, "CP932");
+		textureEntry.Info = vCtrTextureInfo[i];
+		textureEntry.ShortInfo = vTextureShortInfo[i];
+		textureEntry.Size = getTexDataSize(vCtrTextureInfo[i]);
+	}
+	return true;
+}
+
+// the textures of every ExportFile and ImportFile so far, in index order
+const vector<CCtpk::STextureStats>& CCtpk::GetStats() const
+{
+	return m_vStats;
+}
+
+// why the last call that returned false failed, the errors of a single texture are in the log as well
+const UString& CCtpk::GetLastError() const
+{
+	return m_sLastError;
+}
+
 bool CCtpk::ExportFile()
 {
-	bool bResult = true;
-	FILE* fp = UFopen(m_sFileName.c_str(), USTR("rb"));
-	if (fp == nullptr)
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(m_sFileName, CMappedFile::kMapModeRead))
 	{
+		m_sLastError = USTR("open ") + m_sFileName + USTR(" failed");
 		return false;
 	}
-	fseek(fp, 0, SEEK_END);
-	u32 uCtpkSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	u8* pCtpk = new u8[uCtpkSize];
-	fread(pCtpk, 1, uCtpkSize, fp);
-	fclose(fp);
+	u8* pCtpk = mappedFile.GetData();
 	SCtpkHeader* pCtpkHeader = reinterpret_cast<SCtpkHeader*>(pCtpk);
 	if (pCtpkHeader->Signature != s_uSignature)
 	{
-		delete[] pCtpk;
+		mappedFile.Close();
 		return DecodeFile();
 	}
-	SCtrTextureInfo* pCtrTextureInfo = reinterpret_cast<SCtrTextureInfo*>(pCtpk + sizeof(SCtpkHeader));
-	STextureShortInfo* pTextureShortInfo = reinterpret_cast<STextureShortInfo*>(pCtpk + pCtpkHeader->TextureShortInfoOffset);
+	if (!Open(pCtpk, mappedFile.GetSize()))
+	{
+		return false;
+	}
+	const SCtrTextureInfo* pCtrTextureInfo = GetTextureInfo(0);
+	if (!checkSelection(pCtpkHeader->Count))
+	{
+		Close();
+		return false;
+	}
 	UMkdir(m_sDirName.c_str());
+	vector<STextureTask> vTextureTask(pCtpkHeader->Count);
+	bool bSelected = false;
+	for (n32 i = 0; i < pCtpkHeader->Count; i++)
+	{
+		initTextureTask(i, true, vTextureTask[i]);
+		bSelected = bSelected || vTextureTask[i].Selected;
+	}
+	if (!bSelected && pCtpkHeader->Count != 0)
+	{
+		m_sLastError = USTR("no texture is selected");
+		Close();
+		return false;
+	}
+	// the manifest entries of the textures left out are carried over, so a later incremental run still trusts them
+	if (m_bIncremental || !m_vOnly.empty() || !m_vIndex.empty())
+	{
+		loadManifest(vTextureTask, pCtrTextureInfo);
+	}
+	runTextureTask(vTextureTask, [this, pCtpk, pCtpkHeader, pCtrTextureInfo](STextureTask& a_TextureTask)
+	{
+		SCtrTextureInfo ctrTextureInfo = pCtrTextureInfo[a_TextureTask.Index];
+		limitMipLevel(ctrTextureInfo, a_TextureTask);
+		a_TextureTask.Result = ctrTextureInfo.MipLevel == 0 || exportTexture(pCtpk + pCtpkHeader->TextureOffset + ctrTextureInfo.TexDataOffset, ctrTextureInfo, a_TextureTask);
+		a_TextureTask.Stats.BytesIn = ctrTextureInfo.TexDataSize;
+	});
+	bool bResult = true;
 	for (n32 i = 0; i < pCtpkHeader->Count; i++)
 	{
-		if (pTextureShortInfo[i].TextFormat != 0xFF && pCtrTextureInfo[i].TexFormat != pTextureShortInfo[i].TextFormat)
+		if (vTextureTask[i].Selected)
 		{
-			bResult = false;
-			UPrintf(USTR("ERROR: format is not equivalent\n\n"));
-			break;
+			vTextureTask[i].Stats.FileName = vTextureTask[i].FileName;
+			m_vStats.push_back(vTextureTask[i].Stats);
 		}
-		if (pCtrTextureInfo[i].TexFormat < kTextureFormatRGBA8888 || pCtrTextureInfo[i].TexFormat > kTextureFormatETC1_A4)
+		if (!vTextureTask[i].Result && bResult)
 		{
-			bResult = false;
-			UPrintf(USTR("ERROR: unknown format %d\n\n"), pCtrTextureInfo[i].TexFormat);
-			break;
+			m_sLastError = AToU(Format("export of texture %d failed", i));
+		}
+		bResult = bResult && vTextureTask[i].Result;
+	}
+	if (bResult)
+	{
+		bResult = saveManifest(vTextureTask, pCtrTextureInfo);
+	}
+	Close();
+	return bResult;
+}
+
+bool CCtpk::ImportFile()
+{
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(m_sFileName, CMappedFile::kMapModeCopyOnWrite))
+	{
+		m_sLastError = USTR("open ") + m_sFileName + USTR(" failed");
+		return false;
+	}
+	u8* pCtpk = mappedFile.GetData();
+	SCtpkHeader* pCtpkHeader = reinterpret_cast<SCtpkHeader*>(pCtpk);
+	if (pCtpkHeader->Signature != s_uSignature)
+	{
+		mappedFile.Close();
+		return EncodeFile();
+	}
+	if (!Open(pCtpk, mappedFile.GetSize()))
+	{
+		return false;
+	}
+	const SCtrTextureInfo* pCtrTextureInfo = GetTextureInfo(0);
+	if (!checkSelection(pCtpkHeader->Count))
+	{
+		Close();
+		return false;
+	}
+	vector<STextureTask> vTextureTask(pCtpkHeader->Count);
+	bool bSelected = false;
+	for (n32 i = 0; i < pCtpkHeader->Count; i++)
+	{
+		initTextureTask(i, false, vTextureTask[i]);
+		bSelected = bSelected || vTextureTask[i].Selected;
+	}
+	if (!bSelected && pCtpkHeader->Count != 0)
+	{
+		m_sLastError = USTR("no texture is selected");
+		Close();
+		return false;
+	}
+	loadManifest(vTextureTask, pCtrTextureInfo);
+	runTextureTask(vTextureTask, [this, pCtpk, pCtpkHeader, pCtrTextureInfo](STextureTask& a_TextureTask)
+	{
+		SCtrTextureInfo ctrTextureInfo = pCtrTextureInfo[a_TextureTask.Index];
+		limitMipLevel(ctrTextureInfo, a_TextureTask);
+		a_TextureTask.Result = ctrTextureInfo.MipLevel == 0 || importTexture(pCtpk + pCtpkHeader->TextureOffset + ctrTextureInfo.TexDataOffset, ctrTextureInfo, a_TextureTask);
+		a_TextureTask.Stats.BytesIn = getFileSize(a_TextureTask);
+		a_TextureTask.Stats.BytesOut = a_TextureTask.Changed ? ctrTextureInfo.TexDataSize : 0;
+	});
+	bool bResult = true;
+	for (n32 i = 0; i < pCtpkHeader->Count; i++)
+	{
+		if (vTextureTask[i].Selected)
+		{
+			vTextureTask[i].Stats.FileName = vTextureTask[i].FileName;
+			m_vStats.push_back(vTextureTask[i].Stats);
 		}
-		n32 nCheckSize = 0;
-		for (n32 l = 0; l < pCtrTextureInfo[i].MipLevel; l++)
+		if (!vTextureTask[i].Result && bResult)
 		{
-			n32 nMipmapHeight = pCtrTextureInfo[i].Height >> l;
-			n32 nMipmapWidth = pCtrTextureInfo[i].Width >> l;
-			nCheckSize += nMipmapHeight * nMipmapWidth * s_nBPP[pCtrTextureInfo[i].TexFormat] / 8;
+			m_sLastError = AToU(Format("import of texture %d failed", i));
 		}
-		if (pCtrTextureInfo[i].TexDataSize != nCheckSize && m_bVerbose)
+		bResult = bResult && vTextureTask[i].Result;
+	}
+	// only the TexData of the textures that changed goes back, the rest of the file is left alone
+	vector<SDirtyRange> vDirtyRange;
+	for (n32 i = 0; i < static_cast<n32>(vTextureTask.size()); i++)
+	{
+		if (vTextureTask[i].Changed)
 		{
-			UPrintf(USTR("INFO: width: %X, height: %X, checksize: %X, size: %X, bpp: %d, format: %0X\n"), pCtrTextureInfo[i].Width, pCtrTextureInfo[i].Height, nCheckSize, pCtrTextureInfo[i].TexDataSize, pCtrTextureInfo[i].TexDataSize * 8 / pCtrTextureInfo[i].Width / pCtrTextureInfo[i].Height, pCtrTextureInfo[i].TexFormat);
+			SDirtyRange dirtyRange;
+			dirtyRange.Offset = static_cast<n64>(pCtpkHeader->TextureOffset) + pCtrTextureInfo[i].TexDataOffset;
+			dirtyRange.Size = pCtrTextureInfo[i].TexDataSize;
+			vDirtyRange.push_back(dirtyRange);
 		}
-		pvrtexture::CPVRTexture* pPVRTexture = nullptr;
-		if (decode(pCtpk + pCtpkHeader->TextureOffset + pCtrTextureInfo[i].TexDataOffset, pCtrTextureInfo[i].Width, pCtrTextureInfo[i].Height, pCtrTextureInfo[i].TexFormat, &pPVRTexture) == 0)
+	}
+	UString sTempFileName;
+	if (bResult && !vDirtyRange.empty())
+	{
+		bResult = writeBack(pCtpk, vDirtyRange, sTempFileName);
+	}
+	if (bResult)
+	{
+		bResult = saveManifest(vTextureTask, pCtrTextureInfo);
+	}
+	Close();
+	// windows does not let a file with a mapped view be replaced, so the rename waits for the mapping to go
+	mappedFile.Close();
+	return replaceFile(sTempFileName, bResult);
+}
+
+bool CCtpk::DecodeFile()
+{
+	bool bResult = true;
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(m_sFileName, CMappedFile::kMapModeRead))
+	{
+		m_sLastError = USTR("open ") + m_sFileName + USTR(" failed");
+		return false;
+	}
+	u32 uCtpkSize = static_cast<u32>(mappedFile.GetSize());
+	u8* pCtpk = mappedFile.GetData();
+	n32 nWidth = static_cast<n32>(sqrt(static_cast<double>(uCtpkSize / 2)));
+	n32 nHeight = nWidth;
+	UMkdir(m_sDirName.c_str());
+	do
+	{
+		u8* pData = new u8[nWidth * nHeight * 4];
+		if (decode(pCtpk, nWidth, nHeight, kTextureFormatRGB565, pData) == 0)
 		{
-			UString sPngFileName = XToU(reinterpret_cast<char*>(pCtpk + pCtrTextureInfo[i].FilePathOffset), 932, "CP932");
-			remove(sPngFileName.begin(), sPngFileName.end(), USTR(':'));
-			vector<UString> vDirPath = SplitOf(sPngFileName, USTR("/\\"));
-			UString sDirName = m_sDirName;
-			for (n32 j = 0; j < static_cast<n32>(vDirPath.size()) - 1; j++)
-			{
-				sDirName += USTR("/") + vDirPath[j];
-				UMkdir(sDirName.c_str());
-			}
-			sPngFileName = sDirName + USTR("/") + vDirPath.back() + USTR(".png");
+			vector<UString> vDirPath = SplitOf(m_sDirName, USTR("/\\"));
+			UString sPngFileName = m_sDirName + USTR("/") + vDirPath.back() + USTR(".png");
 			FILE* fpSub = UFopen(sPngFileName.c_str(), USTR("wb"));
 			if (fpSub == nullptr)
 			{
-				delete pPVRTexture;
+				delete[] pData;
 				bResult = false;
+				m_sLastError = USTR("open ") + sPngFileName + USTR(" failed");
 				break;
 			}
 			if (m_bVerbose)
 			{
-				UPrintf(USTR("save: %") PRIUS USTR("\n"), sPngFileName.c_str());
+				log(USTR("save: ") + sPngFileName + USTR("\n"));
 			}
 			png_structp pPng = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
 			if (pPng == nullptr)
 			{
 				fclose(fpSub);
-				delete pPVRTexture;
+				delete[] pData;
 				bResult = false;
-				UPrintf(USTR("ERROR: png_create_write_struct error\n\n"));
+				m_sLastError = USTR("png_create_write_struct error");
 				break;
 			}
 			png_infop pInfo = png_create_info_struct(pPng);
@@ -126,118 +610,81 @@ bool CCtpk::ExportFile()
 			{
 				png_destroy_write_struct(&pPng, nullptr);
 				fclose(fpSub);
-				delete pPVRTexture;
+				delete[] pData;
 				bResult = false;
-				UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
+				m_sLastError = USTR("png_create_info_struct error");
 				break;
 			}
 			if (setjmp(png_jmpbuf(pPng)) != 0)
 			{
 				png_destroy_write_struct(&pPng, &pInfo);
 				fclose(fpSub);
-				delete pPVRTexture;
+				delete[] pData;
 				bResult = false;
-				UPrintf(USTR("ERROR: setjmp error\n\n"));
+				m_sLastError = USTR("setjmp error");
 				break;
 			}
 			png_init_io(pPng, fpSub);
-			png_set_IHDR(pPng, pInfo, pCtrTextureInfo[i].Width, pCtrTextureInfo[i].Height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-			u8* pData = static_cast<u8*>(pPVRTexture->getDataPtr());
-			png_bytepp pRowPointers = new png_bytep[pCtrTextureInfo[i].Height];
-			for (n32 j = 0; j < pCtrTextureInfo[i].Height; j++)
+			png_set_IHDR(pPng, pInfo, nWidth, nHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+			png_bytepp pRowPointers = new png_bytep[nHeight];
+			for (n32 j = 0; j < nHeight; j++)
 			{
-				pRowPointers[j] = pData + j * pCtrTextureInfo[i].Width * 4;
+				pRowPointers[j] = pData + j * nWidth * 4;
 			}
 			png_set_rows(pPng, pInfo, pRowPointers);
 			png_write_png(pPng, pInfo, PNG_TRANSFORM_IDENTITY, nullptr);
 			png_destroy_write_struct(&pPng, &pInfo);
 			delete[] pRowPointers;
 			fclose(fpSub);
-			delete pPVRTexture;
+			delete[] pData;
 		}
 		else
 		{
+			delete[] pData;
 			bResult = false;
-			UPrintf(USTR("ERROR: decode error\n\n"));
+			m_sLastError = USTR("decode error");
 			break;
 		}
-	}
-	delete[] pCtpk;
+	} while (false);
 	return bResult;
 }
 
-bool CCtpk::ImportFile()
+bool CCtpk::EncodeFile()
 {
 	bool bResult = true;
-	FILE* fp = UFopen(m_sFileName.c_str(), USTR("rb"));
-	if (fp == nullptr)
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(m_sFileName, CMappedFile::kMapModeCopyOnWrite))
 	{
+		m_sLastError = USTR("open ") + m_sFileName + USTR(" failed");
 		return false;
 	}
-	fseek(fp, 0, SEEK_END);
-	u32 uCtpkSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	u8* pCtpk = new u8[uCtpkSize];
-	fread(pCtpk, 1, uCtpkSize, fp);
-	fclose(fp);
-	SCtpkHeader* pCtpkHeader = reinterpret_cast<SCtpkHeader*>(pCtpk);
-	if (pCtpkHeader->Signature != s_uSignature)
+	u32 uCtpkSize = static_cast<u32>(mappedFile.GetSize());
+	u8* pCtpk = mappedFile.GetData();
+	n32 nWidth = static_cast<n32>(sqrt(static_cast<double>(uCtpkSize / 2)));
+	n32 nHeight = nWidth;
+	vector<SDirtyRange> vDirtyRange;
+	CArena arena;
+	do
 	{
-		delete[] pCtpk;
-		return EncodeFile();
-	}
-	SCtrTextureInfo* pCtrTextureInfo = reinterpret_cast<SCtrTextureInfo*>(pCtpk + sizeof(SCtpkHeader));
-	STextureShortInfo* pTextureShortInfo = reinterpret_cast<STextureShortInfo*>(pCtpk + pCtpkHeader->TextureShortInfoOffset);
-	for (n32 i = 0; i < pCtpkHeader->Count; i++)
-	{
-		if (pTextureShortInfo[i].TextFormat != 0xFF && pCtrTextureInfo[i].TexFormat != pTextureShortInfo[i].TextFormat)
-		{
-			bResult = false;
-			UPrintf(USTR("ERROR: format is not equivalent\n\n"));
-			break;
-		}
-		if (pCtrTextureInfo[i].TexFormat < kTextureFormatRGBA8888 || pCtrTextureInfo[i].TexFormat > kTextureFormatETC1_A4)
-		{
-			bResult = false;
-			UPrintf(USTR("ERROR: unknown format %d\n\n"), pCtrTextureInfo[i].TexFormat);
-			break;
-		}
-		n32 nCheckSize = 0;
-		for (n32 l = 0; l < pCtrTextureInfo[i].MipLevel; l++)
-		{
-			n32 nMipmapHeight = pCtrTextureInfo[i].Height >> l;
-			n32 nMipmapWidth = pCtrTextureInfo[i].Width >> l;
-			nCheckSize += nMipmapHeight * nMipmapWidth * s_nBPP[pCtrTextureInfo[i].TexFormat] / 8;
-		}
-		if (pCtrTextureInfo[i].TexDataSize != nCheckSize && m_bVerbose)
-		{
-			UPrintf(USTR("INFO: width: %X, height: %X, checksize: %X, size: %X, bpp: %d, format: %0X\n"), pCtrTextureInfo[i].Width, pCtrTextureInfo[i].Height, nCheckSize, pCtrTextureInfo[i].TexDataSize, pCtrTextureInfo[i].TexDataSize * 8 / pCtrTextureInfo[i].Width / pCtrTextureInfo[i].Height, pCtrTextureInfo[i].TexFormat);
-		}
-		UString sPngFileName = XToU(reinterpret_cast<char*>(pCtpk + pCtrTextureInfo[i].FilePathOffset), 932, "CP932");
-		remove(sPngFileName.begin(), sPngFileName.end(), USTR(':'));
-		vector<UString> vDirPath = SplitOf(sPngFileName, USTR("/\\"));
-		UString sDirName = m_sDirName;
-		for (n32 j = 0; j < static_cast<n32>(vDirPath.size()) - 1; j++)
-		{
-			sDirName += USTR("/") + vDirPath[j];
-		}
-		sPngFileName = sDirName + USTR("/") + vDirPath.back() + USTR(".png");
+		vector<UString> vDirPath = SplitOf(m_sDirName, USTR("/\\"));
+		UString sPngFileName = m_sDirName + USTR("/") + vDirPath.back() + USTR(".png");
 		FILE* fpSub = UFopen(sPngFileName.c_str(), USTR("rb"));
 		if (fpSub == nullptr)
 		{
 			bResult = false;
+			m_sLastError = USTR("open ") + sPngFileName + USTR(" failed");
 			break;
 		}
 		if (m_bVerbose)
 		{
-			UPrintf(USTR("load: %") PRIUS USTR("\n"), sPngFileName.c_str());
+			log(USTR("load: ") + sPngFileName + USTR("\n"));
 		}
-		png_structp pPng = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		png_structp pPng = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, &arena, pngAlloc, pngFree);
 		if (pPng == nullptr)
 		{
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: png_create_read_struct error\n\n"));
+			m_sLastError = USTR("png_create_read_struct error");
 			break;
 		}
 		png_infop pInfo = png_create_info_struct(pPng);
@@ -246,7 +693,7 @@ bool CCtpk::ImportFile()
 			png_destroy_read_struct(&pPng, nullptr, nullptr);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
+			m_sLastError = USTR("png_create_info_struct error");
 			break;
 		}
 		png_infop pEndInfo = png_create_info_struct(pPng);
@@ -255,7 +702,7 @@ bool CCtpk::ImportFile()
 			png_destroy_read_struct(&pPng, &pInfo, nullptr);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
+			m_sLastError = USTR("png_create_info_struct error");
 			break;
 		}
 		if (setjmp(png_jmpbuf(pPng)) != 0)
@@ -263,27 +710,27 @@ bool CCtpk::ImportFile()
 			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: setjmp error\n\n"));
+			m_sLastError = USTR("setjmp error");
 			break;
 		}
 		png_init_io(pPng, fpSub);
 		png_read_info(pPng, pInfo);
 		n32 nPngWidth = png_get_image_width(pPng, pInfo);
-		if (nPngWidth != pCtrTextureInfo[i].Width)
+		if (nPngWidth != nWidth)
 		{
 			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: nPngWidth != Width\n\n"));
+			m_sLastError = USTR("nPngWidth != nWidth");
 			break;
 		}
 		n32 nPngHeight = png_get_image_height(pPng, pInfo);
-		if (nPngHeight != pCtrTextureInfo[i].Height)
+		if (nPngHeight != nHeight)
 		{
 			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: nPngHeight != Height\n\n"));
+			m_sLastError = USTR("nPngHeight != nHeight");
 			break;
 		}
 		n32 nBitDepth = png_get_bit_depth(pPng, pInfo);
@@ -292,7 +739,7 @@ bool CCtpk::ImportFile()
 			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: nBitDepth != 8\n\n"));
+			m_sLastError = USTR("nBitDepth != 8");
 			break;
 		}
 		n32 nColorType = png_get_color_type(pPng, pInfo);
@@ -301,7 +748,7 @@ bool CCtpk::ImportFile()
 			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 			fclose(fpSub);
 			bResult = false;
-			UPrintf(USTR("ERROR: nColorType != PNG_COLOR_TYPE_RGB_ALPHA\n\n"));
+			m_sLastError = USTR("nColorType != PNG_COLOR_TYPE_RGB_ALPHA");
 			break;
 		}
 		u8* pData = new u8[nPngWidth * nPngHeight * 4];
@@ -314,937 +761,1204 @@ bool CCtpk::ImportFile()
 		png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
 		delete[] pRowPointers;
 		fclose(fpSub);
-		pvrtexture::CPVRTexture* pPVRTexture = nullptr;
-		bool bSame = decode(pCtpk + pCtpkHeader->TextureOffset + pCtrTextureInfo[i].TexDataOffset, pCtrTextureInfo[i].Width, pCtrTextureInfo[i].Height, pCtrTextureInfo[i].TexFormat, &pPVRTexture) == 0 && memcmp(pPVRTexture->getDataPtr(), pData, pCtrTextureInfo[i].Width * pCtrTextureInfo[i].Height * 4) == 0;
-		delete pPVRTexture;
+		u8* pDecodeData = new u8[nWidth * nHeight * 4];
+		bool bSame = decode(pCtpk, nWidth, nHeight, kTextureFormatRGB565, pDecodeData) == 0 && memcmp(pDecodeData, pData, nWidth * nHeight * 4) == 0;
+		delete[] pDecodeData;
 		if (!bSame)
 		{
 			u8* pBuffer = nullptr;
-			encode(pData, nPngWidth, nPngHeight, pCtrTextureInfo[i].TexFormat, pCtrTextureInfo[i].MipLevel, s_nBPP[pCtrTextureInfo[i].TexFormat], &pBuffer);
-			memcpy(pCtpk + pCtpkHeader->TextureOffset + pCtrTextureInfo[i].TexDataOffset, pBuffer, pCtrTextureInfo[i].TexDataSize);
-			delete[] pBuffer;
+			encode(pData, nPngWidth, nPngHeight, kTextureFormatRGB565, 1, s_nBPP[kTextureFormatRGB565], &pBuffer, -1, CMipmap::kFilterBox, 1, arena, nullptr);
+			memcpy(pCtpk, pBuffer, uCtpkSize);
+			SDirtyRange dirtyRange;
+			dirtyRange.Size = uCtpkSize;
+			vDirtyRange.push_back(dirtyRange);
 		}
 		delete[] pData;
-	}
-	if (bResult)
+	} while (false);
+	UString sTempFileName;
+	if (bResult && !vDirtyRange.empty())
 	{
-		fp = UFopen(m_sFileName.c_str(), USTR("wb"));
-		if (fp != nullptr)
-		{
-			fwrite(pCtpk, 1, uCtpkSize, fp);
-			fclose(fp);
-		}
-		else
-		{
-			bResult = false;
-		}
+		bResult = writeBack(pCtpk, vDirtyRange, sTempFileName);
 	}
-	delete[] pCtpk;
-	return bResult;
+	mappedFile.Close();
+	return replaceFile(sTempFileName, bResult);
 }
 
-bool CCtpk::DecodeFile()
+// the file names, stats, cost and selection of texture a_nIndex, export also makes the directories of the selected ones
+void CCtpk::initTextureTask(n32 a_nIndex, bool a_bExport, STextureTask& a_TextureTask) const
 {
-	bool bResult = true;
-	FILE* fp = UFopen(m_sFileName.c_str(), USTR("rb"));
-	if (fp == nullptr)
+	const SCtrTextureInfo& ctrTextureInfo = *GetTextureInfo(a_nIndex);
+	n32 nCheckSize = 0;
+	for (n32 l = 0; l < ctrTextureInfo.MipLevel; l++)
 	{
-		return false;
+		n32 nMipmapHeight = ctrTextureInfo.Height >> l;
+		n32 nMipmapWidth = ctrTextureInfo.Width >> l;
+		nCheckSize += nMipmapHeight * nMipmapWidth * s_nBPP[ctrTextureInfo.TexFormat] / 8;
 	}
-	fseek(fp, 0, SEEK_END);
-	u32 uCtpkSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	u8* pCtpk = new u8[uCtpkSize];
-	fread(pCtpk, 1, uCtpkSize, fp);
-	fclose(fp);
-	n32 nWidth = static_cast<n32>(sqrt(static_cast<double>(uCtpkSize / 2)));
-	n32 nHeight = nWidth;
-	UMkdir(m_sDirName.c_str());
-	do
+	if (ctrTextureInfo.TexDataSize != nCheckSize && m_bVerbose)
 	{
-		pvrtexture::CPVRTexture* pPVRTexture = nullptr;
-		if (decode(pCtpk, nWidth, nHeight, kTextureFormatRGB565, &pPVRTexture) == 0)
-		{
-			vector<UString> vDirPath = SplitOf(m_sDirName, USTR("/\\"));
-			UString sPngFileName = m_sDirName + USTR("/") + vDirPath.back() + USTR(".png");
-			FILE* fpSub = UFopen(sPngFileName.c_str(), USTR("wb"));
-			if (fpSub == nullptr)
-			{
-				delete pPVRTexture;
-				bResult = false;
-				break;
-			}
-			if (m_bVerbose)
-			{
-				UPrintf(USTR("save: %") PRIUS USTR("\n"), sPngFileName.c_str());
-			}
-			png_structp pPng = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-			if (pPng == nullptr)
-			{
-				fclose(fpSub);
-				delete pPVRTexture;
-				bResult = false;
-				UPrintf(USTR("ERROR: png_create_write_struct error\n\n"));
-				break;
-			}
-			png_infop pInfo = png_create_info_struct(pPng);
-			if (pInfo == nullptr)
-			{
-				png_destroy_write_struct(&pPng, nullptr);
-				fclose(fpSub);
-				delete pPVRTexture;
-				bResult = false;
-				UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
-				break;
-			}
-			if (setjmp(png_jmpbuf(pPng)) != 0)
-			{
-				png_destroy_write_struct(&pPng, &pInfo);
-				fclose(fpSub);
-				delete pPVRTexture;
-				bResult = false;
-				UPrintf(USTR("ERROR: setjmp error\n\n"));
-				break;
-			}
-			png_init_io(pPng, fpSub);
-			png_set_IHDR(pPng, pInfo, nWidth, nHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-			u8* pData = static_cast<u8*>(pPVRTexture->getDataPtr());
-			png_bytepp pRowPointers = new png_bytep[nHeight];
-			for (n32 j = 0; j < nHeight; j++)
-			{
-				pRowPointers[j] = pData + j * nWidth * 4;
-			}
-			png_set_rows(pPng, pInfo, pRowPointers);
-			png_write_png(pPng, pInfo, PNG_TRANSFORM_IDENTITY, nullptr);
-			png_destroy_write_struct(&pPng, &pInfo);
-			delete[] pRowPointers;
-			fclose(fpSub);
-			delete pPVRTexture;
-		}
-		else
+		a_TextureTask.Log += AToU(Format("INFO: width: %X, height: %X, checksize: %X, size: %X, bpp: %d, format: %0X\n", ctrTextureInfo.Width, ctrTextureInfo.Height, nCheckSize, ctrTextureInfo.TexDataSize, ctrTextureInfo.TexDataSize * 8 / ctrTextureInfo.Width / ctrTextureInfo.Height, ctrTextureInfo.TexFormat));
+	}
+	UString sPngFileName = GetTextureName(a_nIndex);
+	a_TextureTask.Selected = isSelected(a_nIndex, sPngFileName);
+	remove(sPngFileName.begin(), sPngFileName.end(), USTR(':'));
+	vector<UString> vDirPath = SplitOf(sPngFileName, USTR("/\\"));
+	UString sDirName = m_sDirName;
+	for (n32 j = 0; j < static_cast<n32>(vDirPath.size()) - 1; j++)
+	{
+		sDirName += USTR("/") + vDirPath[j];
+		if (a_bExport && a_TextureTask.Selected)
 		{
-			bResult = false;
-			UPrintf(USTR("ERROR: decode error\n\n"));
-			break;
+			UMkdir(sDirName.c_str());
 		}
-	} while (false);
-	delete[] pCtpk;
-	return bResult;
+	}
+	a_TextureTask.Index = a_nIndex;
+	a_TextureTask.Stats.Format = ctrTextureInfo.TexFormat;
+	a_TextureTask.Stats.Width = ctrTextureInfo.Width;
+	a_TextureTask.Stats.Height = ctrTextureInfo.Height;
+	a_TextureTask.Stats.MipLevel = ctrTextureInfo.MipLevel;
+	for (n32 l = 0; l < ctrTextureInfo.MipLevel; l++)
+	{
+		a_TextureTask.Stats.PixelCount += (ctrTextureInfo.Width >> l) * (ctrTextureInfo.Height >> l);
+	}
+	a_TextureTask.FileName = sDirName + USTR("/") + vDirPath.back() + (m_bKtx ? USTR(".ktx") : USTR(".png"));
+	if (m_bKtx && ctrTextureInfo.TexFormat == kTextureFormatETC1_A4)
+	{
+		a_TextureTask.AlphaFileName = sDirName + USTR("/") + vDirPath.back() + USTR(".alpha.ktx");
+	}
+	if (!m_bKtx)
+	{
+		getMipmapFileName(ctrTextureInfo, sDirName, vDirPath.back(), a_TextureTask.MipmapFileName);
+	}
+	a_TextureTask.Cost = m_bKtx ? ctrTextureInfo.TexDataSize : (a_bExport ? getExportCost(ctrTextureInfo) : getImportCost(ctrTextureInfo));
+	a_TextureTask.ScratchSize = getScratchSize(ctrTextureInfo);
 }
 
-bool CCtpk::EncodeFile()
+void CCtpk::log(const UString& a_sText) const
 {
-	bool bResult = true;
-	FILE* fp = UFopen(m_sFileName.c_str(), USTR("rb"));
-	if (fp == nullptr)
+	if (m_pLog != nullptr)
 	{
-		return false;
+		*m_pLog += a_sText;
 	}
-	fseek(fp, 0, SEEK_END);
-	u32 uCtpkSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	u8* pCtpk = new u8[uCtpkSize];
-	fread(pCtpk, 1, uCtpkSize, fp);
-	fclose(fp);
-	n32 nWidth = static_cast<n32>(sqrt(static_cast<double>(uCtpkSize / 2)));
-	n32 nHeight = nWidth;
-	do
+}
+
+void CCtpk::runTextureTask(vector<STextureTask>& a_vTextureTask, const function<void(STextureTask&)>& a_fTask)
+{
+	// most expensive first keeps the tail of the schedule short, the log still comes out in index order
+	vector<n32> vOrder(a_vTextureTask.size());
+	for (n32 i = 0; i < static_cast<n32>(vOrder.size()); i++)
 	{
-		vector<UString> vDirPath = SplitOf(m_sDirName, USTR("/\\"));
-		UString sPngFileName = m_sDirName + USTR("/") + vDirPath.back() + USTR(".png");
-		FILE* fpSub = UFopen(sPngFileName.c_str(), USTR("rb"));
-		if (fpSub == nullptr)
-		{
-			bResult = false;
-			break;
-		}
-		if (m_bVerbose)
-		{
-			UPrintf(USTR("load: %") PRIUS USTR("\n"), sPngFileName.c_str());
-		}
-		png_structp pPng = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-		if (pPng == nullptr)
+		vOrder[i] = i;
+	}
+	stable_sort(vOrder.begin(), vOrder.end(), [&a_vTextureTask](n32 a_nLeft, n32 a_nRight)
+	{
+		return a_vTextureTask[a_nLeft].Cost > a_vTextureTask[a_nRight].Cost;
+	});
+	// every worker keeps its scratch arena across textures and archives, sized once to the largest texture
+	n64 nScratchSize = 0;
+	for (n32 i = 0; i < static_cast<n32>(a_vTextureTask.size()); i++)
+	{
+		nScratchSize = max<n64>(nScratchSize, a_vTextureTask[i].ScratchSize);
+	}
+	mutex logMutex;
+	n32 nLogIndex = 0;
+	CThreadPool threadPool;
+	CThreadPool* pThreadPool = m_pThreadPool;
+	if (pThreadPool == nullptr)
+	{
+		threadPool.Start(m_nJobs > 0 ? m_nJobs : CThreadPool::GetAutoThreadCount());
+		pThreadPool = &threadPool;
+	}
+	CTaskGroup taskGroup(*pThreadPool);
+	// threads left over when there are fewer textures than workers go to the encoders inside each texture,
+	// a shared pool has none to spare since the textures of the other archives keep it busy
+	n32 nTaskCount = 0;
+	for (n32 i = 0; i < static_cast<n32>(a_vTextureTask.size()); i++)
+	{
+		// the textures left out by --only and --index count as done from the start, they keep their manifest hash
+		if (!a_vTextureTask[i].Selected)
 		{
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: png_create_read_struct error\n\n"));
-			break;
+			a_vTextureTask[i].Hash = a_vTextureTask[i].ManifestHash;
+			a_vTextureTask[i].Done = true;
 		}
-		png_infop pInfo = png_create_info_struct(pPng);
-		if (pInfo == nullptr)
+		else
 		{
-			png_destroy_read_struct(&pPng, nullptr, nullptr);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
-			break;
+			nTaskCount++;
 		}
-		png_infop pEndInfo = png_create_info_struct(pPng);
-		if (pEndInfo == nullptr)
+	}
+	for (n32 i = 0; i < static_cast<n32>(a_vTextureTask.size()); i++)
+	{
+		a_vTextureTask[i].Jobs = m_pThreadPool == nullptr && threadPool.GetThreadCount() > nTaskCount ? threadPool.GetThreadCount() / nTaskCount : 1;
+	}
+	for (n32 i = 0; i < static_cast<n32>(vOrder.size()); i++)
+	{
+		STextureTask& textureTask = a_vTextureTask[vOrder[i]];
+		if (!textureTask.Selected)
 		{
-			png_destroy_read_struct(&pPng, &pInfo, nullptr);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: png_create_info_struct error\n\n"));
-			break;
+			continue;
 		}
-		if (setjmp(png_jmpbuf(pPng)) != 0)
+		taskGroup.Push([this, &a_vTextureTask, &a_fTask, &textureTask, &logMutex, &nLogIndex, nScratchSize]()
 		{
-			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: setjmp error\n\n"));
-			break;
-		}
-		png_init_io(pPng, fpSub);
-		png_read_info(pPng, pInfo);
-		n32 nPngWidth = png_get_image_width(pPng, pInfo);
-		if (nPngWidth != nWidth)
+			CArena& arena = CArena::GetThreadArena();
+			arena.Reserve(nScratchSize);
+			textureTask.Arena = &arena;
+			a_fTask(textureTask);
+			textureTask.Arena = nullptr;
+			arena.Reset();
+			lock_guard<mutex> lock(logMutex);
+			textureTask.Done = true;
+			for (; nLogIndex < static_cast<n32>(a_vTextureTask.size()) && a_vTextureTask[nLogIndex].Done; nLogIndex++)
+			{
+				log(a_vTextureTask[nLogIndex].Log);
+			}
+		});
+	}
+	taskGroup.Wait();
+}
+
+bool CCtpk::exportTexture(const u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const
+{
+	n64 nBegin = getMicrosecond();
+	a_TextureTask.Hash.TexData = CHash::Hash64(a_pTexData, a_CtrTextureInfo.TexDataSize);
+	// with --incremental the file from the last export is left alone, mtime included, while both its TexData and the file itself still match,
+	// a file that an import had to encode is not what an export of the TexData it became would write
+	u64 uFileHash = 0;
+	bool bSkip = m_bIncremental && a_TextureTask.InManifest && !a_TextureTask.ManifestHash.Imported && a_TextureTask.ManifestHash.TexData == a_TextureTask.Hash.TexData && getFileHash(a_TextureTask, uFileHash) && uFileHash == a_TextureTask.ManifestHash.File;
+	a_TextureTask.Stats.Time[kStatsStageRead] += getMicrosecond() - nBegin;
+	if (bSkip)
+	{
+		a_TextureTask.Hash = a_TextureTask.ManifestHash;
+		if (m_bVerbose)
 		{
-			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: nPngWidth != nWidth\n\n"));
-			break;
+			a_TextureTask.Log += USTR("skip: ") + a_TextureTask.FileName + USTR("\n");
 		}
-		n32 nPngHeight = png_get_image_height(pPng, pInfo);
-		if (nPngHeight != nHeight)
+		return true;
+	}
+	if (m_bKtx)
+	{
+		return exportKtx(a_pTexData, a_CtrTextureInfo, a_TextureTask);
+	}
+	// paeth suits the continuous tone formats, the few level ones compress better with sub
+	CPngWriter::EFilter eFilter = CPngWriter::kFilterSub;
+	if (m_nPngEffort == CPngWriter::kEffortStored)
+	{
+		eFilter = CPngWriter::kFilterNone;
+	}
+	else if (m_nPngEffort != CPngWriter::kEffortFast && (a_CtrTextureInfo.TexFormat == kTextureFormatRGBA8888 || a_CtrTextureInfo.TexFormat == kTextureFormatRGB888 || a_CtrTextureInfo.TexFormat == kTextureFormatETC1 || a_CtrTextureInfo.TexFormat == kTextureFormatETC1_A4))
+	{
+		eFilter = CPngWriter::kFilterPaeth;
+	}
+	u8* pData = a_TextureTask.Arena->Alloc<u8>(a_CtrTextureInfo.Width * a_CtrTextureInfo.Height * 4);
+	CThreadPool& threadPool = CThreadPool::GetThreadPool(a_TextureTask.Jobs);
+	n32 nCurrentSize = 0;
+	for (n32 l = 0; l <= static_cast<n32>(a_TextureTask.MipmapFileName.size()); l++)
+	{
+		const UString& sFileName = l == 0 ? a_TextureTask.FileName : a_TextureTask.MipmapFileName[l - 1];
+		n32 nMipmapWidth = a_CtrTextureInfo.Width >> l;
+		n32 nMipmapHeight = a_CtrTextureInfo.Height >> l;
+		nBegin = getMicrosecond();
+		bool bDecode = decode(a_pTexData + nCurrentSize, nMipmapWidth, nMipmapHeight, a_CtrTextureInfo.TexFormat, pData) == 0;
+		a_TextureTask.Stats.Time[kStatsStageDeswizzle] += getMicrosecond() - nBegin;
+		if (!bDecode)
 		{
-			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: nPngHeight != nHeight\n\n"));
-			break;
+			a_TextureTask.Log += USTR("ERROR: decode error\n\n");
+			return false;
 		}
-		n32 nBitDepth = png_get_bit_depth(pPng, pInfo);
-		if (nBitDepth != 8)
+		nCurrentSize += nMipmapWidth * nMipmapHeight * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+		if (l == 0)
 		{
-			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: nBitDepth != 8\n\n"));
-			break;
+			a_TextureTask.Hash.Pixel = CHash::Hash64(pData, nMipmapWidth * nMipmapHeight * 4);
 		}
-		n32 nColorType = png_get_color_type(pPng, pInfo);
-		if (nColorType != PNG_COLOR_TYPE_RGB_ALPHA)
+		nBegin = getMicrosecond();
+		FILE* fp = UFopen(sFileName.c_str(), USTR("wb"));
+		if (fp == nullptr)
 		{
-			png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-			fclose(fpSub);
-			bResult = false;
-			UPrintf(USTR("ERROR: nColorType != PNG_COLOR_TYPE_RGB_ALPHA\n\n"));
-			break;
+			return false;
 		}
-		u8* pData = new u8[nPngWidth * nPngHeight * 4];
-		png_bytepp pRowPointers = new png_bytep[nPngHeight];
-		for (n32 j = 0; j < nPngHeight; j++)
+		if (m_bVerbose)
 		{
-			pRowPointers[j] = pData + j * nPngWidth * 4;
+			a_TextureTask.Log += USTR("save: ") + sFileName + USTR("\n");
 		}
-		png_read_image(pPng, pRowPointers);
-		png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
-		delete[] pRowPointers;
-		fclose(fpSub);
-		pvrtexture::CPVRTexture* pPVRTexture = nullptr;
-		bool bSame = decode(pCtpk, nWidth, nHeight, kTextureFormatRGB565, &pPVRTexture) == 0 && memcmp(pPVRTexture->getDataPtr(), pData, nWidth * nHeight * 4) == 0;
-		delete pPVRTexture;
-		if (!bSame)
+		bool bResult = CPngWriter::Write(fp, pData, nMipmapWidth, nMipmapHeight, static_cast<CPngWriter::EEffort>(m_nPngEffort), eFilter, threadPool, *a_TextureTask.Arena);
+		fclose(fp);
+		a_TextureTask.Stats.Time[kStatsStagePngEncode] += getMicrosecond() - nBegin;
+		if (!bResult)
 		{
-			u8* pBuffer = nullptr;
-			encode(pData, nPngWidth, nPngHeight, kTextureFormatRGB565, 1, s_nBPP[kTextureFormatRGB565], &pBuffer);
-			memcpy(pCtpk, pBuffer, uCtpkSize);
-			delete[] pBuffer;
+			a_TextureTask.Log += USTR("ERROR: write png error\n\n");
+			return false;
 		}
-		delete[] pData;
-	} while (false);
-	if (bResult)
+	}
+	nBegin = getMicrosecond();
+	getFileHash(a_TextureTask, a_TextureTask.Hash.File);
+	a_TextureTask.Stats.Time[kStatsStageRead] += getMicrosecond() - nBegin;
+	a_TextureTask.Stats.BytesOut = getFileSize(a_TextureTask);
+	return true;
+}
+
+bool CCtpk::importTexture(u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const
+{
+	// a file whose bytes or pixels hash like the manifest entry for this very TexData needs neither a decode nor an encode
+	n64 nBegin = getMicrosecond();
+	a_TextureTask.Hash.TexData = CHash::Hash64(a_pTexData, a_CtrTextureInfo.TexDataSize);
+	bool bManifest = a_TextureTask.InManifest && a_TextureTask.ManifestHash.TexData == a_TextureTask.Hash.TexData;
+	bool bSkip = getFileHash(a_TextureTask, a_TextureTask.Hash.File) && bManifest && a_TextureTask.Hash.File == a_TextureTask.ManifestHash.File;
+	a_TextureTask.Stats.Time[kStatsStageRead] += getMicrosecond() - nBegin;
+	if (bSkip)
 	{
-		fp = UFopen(m_sFileName.c_str(), USTR("wb"));
-		if (fp != nullptr)
+		a_TextureTask.Hash.Pixel = a_TextureTask.ManifestHash.Pixel;
+		a_TextureTask.Hash.Imported = a_TextureTask.ManifestHash.Imported;
+		if (m_bVerbose)
 		{
-			fwrite(pCtpk, 1, uCtpkSize, fp);
-			fclose(fp);
+			a_TextureTask.Log += USTR("skip: ") + a_TextureTask.FileName + USTR("\n");
 		}
-		else
+		return true;
+	}
+	if (m_bKtx)
+	{
+		return importKtx(a_pTexData, a_CtrTextureInfo, a_TextureTask);
+	}
+	// with every level exported each one is compared and encoded on its own, otherwise the mipmaps are generated from the first level
+	bool bMipmap = a_CtrTextureInfo.MipLevel > 1 && static_cast<n32>(a_TextureTask.MipmapFileName.size()) == a_CtrTextureInfo.MipLevel - 1;
+	for (n32 l = 0; bMipmap && l < static_cast<n32>(a_TextureTask.MipmapFileName.size()); l++)
+	{
+		n64 nFileSize = 0;
+		bMipmap = UGetFileSize(a_TextureTask.MipmapFileName[l].c_str(), nFileSize);
+	}
+	n32 nCurrentSize = 0;
+	for (n32 l = 0; l < (bMipmap ? a_CtrTextureInfo.MipLevel : 1); l++)
+	{
+		if (!importLevel(a_pTexData + nCurrentSize, a_CtrTextureInfo.TexDataSize - nCurrentSize, a_CtrTextureInfo, l, bMipmap ? 1 : a_CtrTextureInfo.MipLevel, bManifest, a_TextureTask))
 		{
-			bResult = false;
+			return false;
 		}
+		nCurrentSize += (a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l) * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
 	}
-	delete[] pCtpk;
-	return bResult;
+	// the file and pixel hashes stay those of the png, so the next import of the same png skips again
+	if (a_TextureTask.Changed)
+	{
+		a_TextureTask.Hash.TexData = CHash::Hash64(a_pTexData, a_CtrTextureInfo.TexDataSize);
+	}
+	return true;
 }
 
-bool CCtpk::IsCtpkFile(const UString& a_sFileName)
+// a_pTexData points at a_nLevel with a_nTexDataSize bytes left, a_nMipLevel levels are encoded from the png of that level
+bool CCtpk::importLevel(u8* a_pTexData, n32 a_nTexDataSize, const SCtrTextureInfo& a_CtrTextureInfo, n32 a_nLevel, n32 a_nMipLevel, bool a_bManifest, STextureTask& a_TextureTask) const
 {
-	FILE* fp = UFopen(a_sFileName.c_str(), USTR("rb"));
+	const UString& sFileName = a_nLevel == 0 ? a_TextureTask.FileName : a_TextureTask.MipmapFileName[a_nLevel - 1];
+	n32 nWidth = a_CtrTextureInfo.Width >> a_nLevel;
+	n32 nHeight = a_CtrTextureInfo.Height >> a_nLevel;
+	n32 nSize = 0;
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		nSize += (nWidth >> l) * (nHeight >> l) * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+	}
+	if (nSize > a_nTexDataSize)
+	{
+		nSize = a_nTexDataSize;
+	}
+	n64 nBegin = getMicrosecond();
+	FILE* fp = UFopen(sFileName.c_str(), USTR("rb"));
 	if (fp == nullptr)
 	{
 		return false;
 	}
-	SCtpkHeader ctpkHeader;
-	fread(&ctpkHeader, sizeof(SCtpkHeader), 1, fp);
-	fclose(fp);
-	return ctpkHeader.Signature == s_uSignature;
-}
-
-bool CCtpk::IsCtpkIconFile(const UString& a_sFileName)
-{
-	n64 nCtpkSize = 0;
-	if (!UGetFileSize(a_sFileName.c_str(), nCtpkSize))
+	if (m_bVerbose)
+	{
+		a_TextureTask.Log += USTR("load: ") + sFileName + USTR("\n");
+	}
+	png_structp pPng = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, a_TextureTask.Arena, pngAlloc, pngFree);
+	if (pPng == nullptr)
 	{
-		UPrintf(USTR("ERROR: get %") PRIUS USTR(" size error\n\n"), a_sFileName.c_str());
+		fclose(fp);
+		a_TextureTask.Log += USTR("ERROR: png_create_read_struct error\n\n");
 		return false;
 	}
-	if (nCtpkSize <= 0 || nCtpkSize % 2 != 0)
+	png_infop pInfo = png_create_info_struct(pPng);
+	if (pInfo == nullptr)
 	{
+		png_destroy_read_struct(&pPng, nullptr, nullptr);
+		fclose(fp);
+		a_TextureTask.Log += USTR("ERROR: png_create_info_struct error\n\n");
 		return false;
 	}
-	nCtpkSize /= 2;
-	n32 nSize = static_cast<n32>(sqrt(static_cast<double>(nCtpkSize)));
-	return nSize * nSize == nCtpkSize && nSize % 8 == 0;
-}
-
-int CCtpk::decode(u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, pvrtexture::CPVRTexture** a_pPVRTexture)
-{
-	u8* pRGBA = nullptr;
-	u8* pAlpha = nullptr;
-	switch (a_nFormat)
+	png_infop pEndInfo = png_create_info_struct(pPng);
+	if (pEndInfo == nullptr)
 	{
-	case kTextureFormatRGBA8888:
+		png_destroy_read_struct(&pPng, &pInfo, nullptr);
+		fclose(fp);
+		a_TextureTask.Log += USTR("ERROR: png_create_info_struct error\n\n");
+		return false;
+	}
+	if (setjmp(png_jmpbuf(pPng)) != 0)
+	{
+		png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
+		fclose(fp);
+		a_TextureTask.Log += USTR("ERROR: setjmp error\n\n");
+		return false;
+	}
+	png_init_io(pPng, fp);
+	png_read_info(pPng, pInfo);
+	const UChar* pError = nullptr;
+	if (static_cast<n32>(png_get_image_width(pPng, pInfo)) != nWidth)
+	{
+		pError = USTR("ERROR: nPngWidth != Width\n\n");
+	}
+	else if (static_cast<n32>(png_get_image_height(pPng, pInfo)) != nHeight)
+	{
+		pError = USTR("ERROR: nPngHeight != Height\n\n");
+	}
+	else if (png_get_bit_depth(pPng, pInfo) != 8)
+	{
+		pError = USTR("ERROR: nBitDepth != 8\n\n");
+	}
+	else if (png_get_color_type(pPng, pInfo) != PNG_COLOR_TYPE_RGB_ALPHA)
+	{
+		pError = USTR("ERROR: nColorType != PNG_COLOR_TYPE_RGB_ALPHA\n\n");
+	}
+	if (pError != nullptr)
+	{
+		png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
+		fclose(fp);
+		a_TextureTask.Log += pError;
+		return false;
+	}
+	// the uncompressed formats without mipmaps never need the whole image, they go through one tile row of 8 rows at a time
+	bool bBand = a_nMipLevel == 1 && nHeight % 8 == 0 && nSize == nWidth * nHeight * s_nBPP[a_CtrTextureInfo.TexFormat] / 8 && a_CtrTextureInfo.TexFormat < kTextureFormatETC1 && png_get_interlace_type(pPng, pInfo) == PNG_INTERLACE_NONE;
+	n32 nRowCount = bBand ? 8 : nHeight;
+	u8* pData = a_TextureTask.Arena->Alloc<u8>(nWidth * nRowCount * 4);
+	u8* pDecodeData = bBand ? a_TextureTask.Arena->Alloc<u8>(nWidth * nRowCount * 4) : nullptr;
+	png_bytepp pRowPointers = a_TextureTask.Arena->Alloc<png_bytep>(nRowCount);
+	for (n32 i = 0; i < nRowCount; i++)
+	{
+		pRowPointers[i] = pData + i * nWidth * 4;
+	}
+	if (bBand)
+	{
+		// each band is compared with the decoded original and only swizzled into the mapping when it differs
+		CHash pixelHash;
+		n32 nBandSize = nWidth * 8 * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+		u8* pBandBuffer = a_TextureTask.Arena->Alloc<u8>(nBandSize);
+		for (n32 nY = 0; nY < nHeight; nY += 8)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight * 4];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
+			png_read_rows(pPng, pRowPointers, nullptr, 8);
+			pixelHash.Update(pData, nWidth * 8 * 4);
+			u8* pBand = a_pTexData + nY / 8 * nBandSize;
+			n64 nBandBegin = getMicrosecond();
+			bool bSame = decode(pBand, nWidth, 8, a_CtrTextureInfo.TexFormat, pDecodeData) == 0 && memcmp(pDecodeData, pData, nWidth * 8 * 4) == 0;
+			n64 nBandDecode = getMicrosecond();
+			a_TextureTask.Stats.Time[kStatsStageDeswizzle] += nBandDecode - nBandBegin;
+			if (!bSame)
 			{
-				for (n32 j = 0; j < 64; j++)
+				// the quantization can land on the very bytes that are there, which leaves the band clean
+				CPixelFormat::Encode(pData, pBandBuffer, nWidth, 8, a_CtrTextureInfo.TexFormat);
+				if (memcmp(pBand, pBandBuffer, nBandSize) != 0)
 				{
-					for (n32 k = 0; k < 4; k++)
-					{
-						pTemp[(i * 64 + j) * 4 + k] = a_pBuffer[(i * 64 + s_nDecodeTransByte[j]) * 4 + 3 - k];
-					}
+					memcpy(pBand, pBandBuffer, nBandSize);
+					a_TextureTask.Changed = true;
 				}
+				a_TextureTask.Hash.Imported = true;
+				a_TextureTask.Stats.Time[kStatsStageTranscode] += getMicrosecond() - nBandDecode;
 			}
-			pRGBA = new u8[a_nWidth * a_nHeight * 4];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					for (n32 k = 0; k < 4; k++)
-					{
-						pRGBA[(i * a_nWidth + j) * 4 + k] = pTemp[(((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 4 + k];
-					}
-				}
-			}
-			delete[] pTemp;
+			// the png stage only keeps the time spent in libpng
+			nBegin += getMicrosecond() - nBandBegin;
 		}
-		break;
-	case kTextureFormatRGB888:
+		if (a_nLevel == 0)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight * 3];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
-			{
-				for (n32 j = 0; j < 64; j++)
-				{
-					for (n32 k = 0; k < 3; k++)
-					{
-						pTemp[(i * 64 + j) * 3 + k] = a_pBuffer[(i * 64 + s_nDecodeTransByte[j]) * 3 + 2 - k];
-					}
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight * 3];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					for (n32 k = 0; k < 3; k++)
-					{
-						pRGBA[(i * a_nWidth + j) * 3 + k] = pTemp[(((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 3 + k];
-					}
-				}
-			}
-			delete[] pTemp;
+			a_TextureTask.Hash.Pixel = pixelHash.Digest();
 		}
-		break;
-	case kTextureFormatRGBA5551:
-	case kTextureFormatRGB565:
-	case kTextureFormatRGBA4444:
+	}
+	else
+	{
+		png_read_image(pPng, pRowPointers);
+	}
+	png_destroy_read_struct(&pPng, &pInfo, &pEndInfo);
+	fclose(fp);
+	a_TextureTask.Stats.Time[kStatsStagePngDecode] += getMicrosecond() - nBegin;
+	if (bBand)
+	{
+		return true;
+	}
+	u64 uPixelHash = CHash::Hash64(pData, nWidth * nHeight * 4);
+	if (a_nLevel == 0)
+	{
+		a_TextureTask.Hash.Pixel = uPixelHash;
+	}
+	bool bSame = a_bManifest && a_nLevel == 0 && uPixelHash == a_TextureTask.ManifestHash.Pixel;
+	if (bSame)
+	{
+		// the TexData is still what the pixels of the manifest entry made of it, exact or encoded
+		a_TextureTask.Hash.Imported = a_TextureTask.Hash.Imported || a_TextureTask.ManifestHash.Imported;
+	}
+	else
+	{
+		// without a matching manifest entry the original is decoded and compared instead
+		nBegin = getMicrosecond();
+		pDecodeData = a_TextureTask.Arena->Alloc<u8>(nWidth * nHeight * 4);
+		bSame = decode(a_pTexData, nWidth, nHeight, a_CtrTextureInfo.TexFormat, pDecodeData) == 0 && memcmp(pDecodeData, pData, nWidth * nHeight * 4) == 0;
+		a_TextureTask.Stats.Time[kStatsStageDeswizzle] += getMicrosecond() - nBegin;
+	}
+	if (!bSame)
+	{
+		// every texture owns a disjoint TexDataOffset range, so the workers write the mapping without a lock
+		u8* pBuffer = nullptr;
+		n64 nMipmapTime = a_TextureTask.Stats.Time[kStatsStageMipmap];
+		nBegin = getMicrosecond();
+		encode(pData, nWidth, nHeight, a_CtrTextureInfo.TexFormat, a_nMipLevel, s_nBPP[a_CtrTextureInfo.TexFormat], &pBuffer, m_nEtc1Quality, m_nMipmapFilter, a_TextureTask.Jobs, *a_TextureTask.Arena, &a_TextureTask.Stats);
+		a_TextureTask.Stats.Time[kStatsStageTranscode] += getMicrosecond() - nBegin - (a_TextureTask.Stats.Time[kStatsStageMipmap] - nMipmapTime);
+		// an encode that lands on the bytes already there neither dirties the range nor rewrites the archive
+		if (memcmp(a_pTexData, pBuffer, nSize) != 0)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight * 2];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
-			{
-				for (n32 j = 0; j < 64; j++)
-				{
-					for (n32 k = 0; k < 2; k++)
-					{
-						pTemp[(i * 64 + j) * 2 + k] = a_pBuffer[(i * 64 + s_nDecodeTransByte[j]) * 2 + k];
-					}
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight * 2];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					for (n32 k = 0; k < 2; k++)
-					{
-						pRGBA[(i * a_nWidth + j) * 2 + k] = pTemp[(((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 2 + k];
-					}
-				}
-			}
-			delete[] pTemp;
+			memcpy(a_pTexData, pBuffer, nSize);
+			a_TextureTask.Changed = true;
 		}
-		break;
-	case kTextureFormatLA88:
-	case kTextureFormatHL8:
+		a_TextureTask.Hash.Imported = true;
+	}
+	return true;
+}
+
+bool CCtpk::exportKtx(const u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const
+{
+	n32 nSize = CKtx::GetSize(s_KtxFormat[a_CtrTextureInfo.TexFormat], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel);
+	n32 nAlphaSize = a_TextureTask.AlphaFileName.empty() ? 0 : CKtx::GetSize(s_KtxFormat[kTextureFormatA8], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel);
+	if (static_cast<n32>(a_CtrTextureInfo.TexDataSize) < getTexDataSize(a_CtrTextureInfo))
+	{
+		a_TextureTask.Log += USTR("ERROR: TexDataSize is smaller than the mipmap chain\n\n");
+		return false;
+	}
+	if (m_bVerbose)
+	{
+		a_TextureTask.Log += USTR("save: ") + a_TextureTask.FileName + USTR("\n");
+	}
+	// the blocks only lose the tile order and the byte reversal, nothing is decoded
+	n64 nBegin = getMicrosecond();
+	u8* pKtx = a_TextureTask.Arena->Alloc<u8>(nSize);
+	u8* pAlphaKtx = nAlphaSize != 0 ? a_TextureTask.Arena->Alloc<u8>(nAlphaSize) : nullptr;
+	n32 nCurrentSize = 0;
+	n32 nKtxSize = 0;
+	n32 nAlphaKtxSize = 0;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		n32 nMipmapWidth = a_CtrTextureInfo.Width >> l;
+		n32 nMipmapHeight = a_CtrTextureInfo.Height >> l;
+		deswizzle(a_pTexData + nCurrentSize, nMipmapWidth, nMipmapHeight, a_CtrTextureInfo.TexFormat, pKtx + nKtxSize, pAlphaKtx != nullptr ? pAlphaKtx + nAlphaKtxSize : nullptr, *a_TextureTask.Arena);
+		nCurrentSize += nMipmapWidth * nMipmapHeight * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+		nKtxSize += CKtx::GetSize(s_KtxFormat[a_CtrTextureInfo.TexFormat], nMipmapWidth, nMipmapHeight, 1);
+		nAlphaKtxSize += CKtx::GetSize(s_KtxFormat[kTextureFormatA8], nMipmapWidth, nMipmapHeight, 1);
+	}
+	n64 nDeswizzle = getMicrosecond();
+	a_TextureTask.Stats.Time[kStatsStageDeswizzle] += nDeswizzle - nBegin;
+	bool bResult = CKtx::Write(a_TextureTask.FileName, s_KtxFormat[a_CtrTextureInfo.TexFormat], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel, pKtx);
+	if (bResult && pAlphaKtx != nullptr)
+	{
+		bResult = CKtx::Write(a_TextureTask.AlphaFileName, s_KtxFormat[kTextureFormatA8], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel, pAlphaKtx);
+	}
+	if (!bResult)
+	{
+		a_TextureTask.Log += USTR("ERROR: write ktx error\n\n");
+		return false;
+	}
+	nBegin = getMicrosecond();
+	a_TextureTask.Stats.Time[kStatsStageWrite] += nBegin - nDeswizzle;
+	getFileHash(a_TextureTask, a_TextureTask.Hash.File);
+	a_TextureTask.Stats.Time[kStatsStageRead] += getMicrosecond() - nBegin;
+	a_TextureTask.Stats.BytesOut = getFileSize(a_TextureTask);
+	return true;
+}
+
+bool CCtpk::importKtx(u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const
+{
+	n32 nSize = CKtx::GetSize(s_KtxFormat[a_CtrTextureInfo.TexFormat], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel);
+	n32 nAlphaSize = a_TextureTask.AlphaFileName.empty() ? 0 : CKtx::GetSize(s_KtxFormat[kTextureFormatA8], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel);
+	n32 nBufferSize = getTexDataSize(a_CtrTextureInfo);
+	if (static_cast<n32>(a_CtrTextureInfo.TexDataSize) < nBufferSize)
+	{
+		a_TextureTask.Log += USTR("ERROR: TexDataSize is smaller than the mipmap chain\n\n");
+		return false;
+	}
+	if (m_bVerbose)
+	{
+		a_TextureTask.Log += USTR("load: ") + a_TextureTask.FileName + USTR("\n");
+	}
+	n64 nBegin = getMicrosecond();
+	u8* pKtx = a_TextureTask.Arena->Alloc<u8>(nSize);
+	u8* pAlphaKtx = nAlphaSize != 0 ? a_TextureTask.Arena->Alloc<u8>(nAlphaSize) : nullptr;
+	bool bResult = CKtx::Read(a_TextureTask.FileName, s_KtxFormat[a_CtrTextureInfo.TexFormat], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel, pKtx);
+	if (bResult && pAlphaKtx != nullptr)
+	{
+		bResult = CKtx::Read(a_TextureTask.AlphaFileName, s_KtxFormat[kTextureFormatA8], a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel, pAlphaKtx);
+	}
+	if (!bResult)
+	{
+		a_TextureTask.Log += USTR("ERROR: ktx format, size or mipmap level mismatch\n\n");
+		return false;
+	}
+	n64 nRead = getMicrosecond();
+	a_TextureTask.Stats.Time[kStatsStageRead] += nRead - nBegin;
+	u8* pBuffer = a_TextureTask.Arena->Alloc<u8>(nBufferSize);
+	n32 nCurrentSize = 0;
+	n32 nKtxSize = 0;
+	n32 nAlphaKtxSize = 0;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		n32 nMipmapWidth = a_CtrTextureInfo.Width >> l;
+		n32 nMipmapHeight = a_CtrTextureInfo.Height >> l;
+		swizzle(pKtx + nKtxSize, pAlphaKtx != nullptr ? pAlphaKtx + nAlphaKtxSize : nullptr, nMipmapWidth, nMipmapHeight, a_CtrTextureInfo.TexFormat, pBuffer + nCurrentSize, *a_TextureTask.Arena);
+		nCurrentSize += nMipmapWidth * nMipmapHeight * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+		nKtxSize += CKtx::GetSize(s_KtxFormat[a_CtrTextureInfo.TexFormat], nMipmapWidth, nMipmapHeight, 1);
+		nAlphaKtxSize += CKtx::GetSize(s_KtxFormat[kTextureFormatA8], nMipmapWidth, nMipmapHeight, 1);
+	}
+	a_TextureTask.Stats.Time[kStatsStageDeswizzle] += getMicrosecond() - nRead;
+	if (memcmp(a_pTexData, pBuffer, nBufferSize) != 0)
+	{
+		memcpy(a_pTexData, pBuffer, nBufferSize);
+		a_TextureTask.Hash.TexData = CHash::Hash64(a_pTexData, a_CtrTextureInfo.TexDataSize);
+		a_TextureTask.Changed = true;
+	}
+	return true;
+}
+
+// the etc1_a4 alpha file and the mipmap pngs are chained into the hash of the first file
+bool CCtpk::getFileHash(const STextureTask& a_TextureTask, u64& a_uHash) const
+{
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(a_TextureTask.FileName, CMappedFile::kMapModeRead))
+	{
+		return false;
+	}
+	u64 uHash = CHash::Hash64(mappedFile.GetData(), mappedFile.GetSize());
+	mappedFile.Close();
+	if (!a_TextureTask.AlphaFileName.empty())
+	{
+		if (!mappedFile.Open(a_TextureTask.AlphaFileName, CMappedFile::kMapModeRead))
+		{
+			return false;
+		}
+		uHash = CHash::Hash64(mappedFile.GetData(), mappedFile.GetSize(), uHash);
+		mappedFile.Close();
+	}
+	for (n32 i = 0; i < static_cast<n32>(a_TextureTask.MipmapFileName.size()); i++)
+	{
+		if (!mappedFile.Open(a_TextureTask.MipmapFileName[i], CMappedFile::kMapModeRead))
+		{
+			return false;
+		}
+		uHash = CHash::Hash64(mappedFile.GetData(), mappedFile.GetSize(), uHash);
+		mappedFile.Close();
+	}
+	a_uHash = uHash;
+	return true;
+}
+
+// every --index has to name a texture of the file
+bool CCtpk::checkSelection(n32 a_nCount) const
+{
+	for (n32 i = 0; i < static_cast<n32>(m_vIndex.size()); i++)
+	{
+		if (m_vIndex[i] < 0 || m_vIndex[i] >= a_nCount)
+		{
+			m_sLastError = AToU(Format("no texture %d", m_vIndex[i]));
+			return false;
+		}
+	}
+	return true;
+}
+
+// without --only and --index every texture is selected, with them a texture needs to match one glob or one index
+bool CCtpk::isSelected(n32 a_nIndex, const UString& a_sName) const
+{
+	if (m_vOnly.empty() && m_vIndex.empty())
+	{
+		return true;
+	}
+	if (find(m_vIndex.begin(), m_vIndex.end(), a_nIndex) != m_vIndex.end())
+	{
+		return true;
+	}
+	for (n32 i = 0; i < static_cast<n32>(m_vOnly.size()); i++)
+	{
+		if (matchGlob(a_sName.c_str(), m_vOnly[i].c_str()))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// * and ? as in a shell, except that * also crosses the /, the last * is remembered so no input backtracks twice
+bool CCtpk::matchGlob(const UChar* a_pName, const UChar* a_pGlob)
+{
+	const UChar* pStarGlob = nullptr;
+	const UChar* pStarName = nullptr;
+	while (*a_pName != 0)
+	{
+		if (*a_pGlob == USTR('*'))
+		{
+			pStarGlob = ++a_pGlob;
+			pStarName = a_pName;
+		}
+		else if (*a_pGlob == USTR('?') || *a_pGlob == *a_pName)
+		{
+			a_pGlob++;
+			a_pName++;
+		}
+		else if (pStarGlob != nullptr)
+		{
+			a_pGlob = pStarGlob;
+			a_pName = ++pStarName;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (*a_pGlob == USTR('*'))
+	{
+		a_pGlob++;
+	}
+	return *a_pGlob == 0;
+}
+
+n64 CCtpk::getFileSize(const STextureTask& a_TextureTask)
+{
+	n64 nSize = 0;
+	n64 nFileSize = 0;
+	if (UGetFileSize(a_TextureTask.FileName.c_str(), nFileSize))
+	{
+		nSize += nFileSize;
+	}
+	if (!a_TextureTask.AlphaFileName.empty() && UGetFileSize(a_TextureTask.AlphaFileName.c_str(), nFileSize))
+	{
+		nSize += nFileSize;
+	}
+	for (n32 i = 0; i < static_cast<n32>(a_TextureTask.MipmapFileName.size()); i++)
+	{
+		if (UGetFileSize(a_TextureTask.MipmapFileName[i].c_str(), nFileSize))
+		{
+			nSize += nFileSize;
+		}
+	}
+	return nSize;
+}
+
+// the png of every further level that still has whole tiles and fits in TexDataSize sits next to the first one
+void CCtpk::getMipmapFileName(const SCtrTextureInfo& a_CtrTextureInfo, const UString& a_sDirName, const UString& a_sBaseName, vector<UString>& a_vMipmapFileName)
+{
+	n32 nMipmapSize = a_CtrTextureInfo.Width * a_CtrTextureInfo.Height * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+	n32 nMipLevel = getLayoutMipLevel(a_CtrTextureInfo);
+	for (n32 l = 1; l < nMipLevel; l++)
+	{
+		nMipmapSize += (a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l) * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+		if (nMipmapSize > static_cast<n32>(a_CtrTextureInfo.TexDataSize))
+		{
+			break;
+		}
+		a_vMipmapFileName.push_back(a_sDirName + USTR("/") + a_sBaseName + AToU(Format(".mip%d.png", l)));
+	}
+}
+
+// one line per texture: index, format, width, height, mip level, then the TexData, png file and png pixel hashes
+// and whether the files came from an export of the TexData or were encoded into it by an import
+void CCtpk::loadManifest(vector<STextureTask>& a_vTextureTask, const SCtrTextureInfo* a_pCtrTextureInfo) const
+{
+	FILE* fp = UFopen((m_sDirName + USTR("/") + s_pManifestFileName).c_str(), USTR("rb"));
+	if (fp == nullptr)
+	{
+		return;
+	}
+	char szLine[256] = {};
+	while (fgets(szLine, sizeof(szLine), fp) != nullptr)
+	{
+		n32 nIndex = 0;
+		n32 nFormat = 0;
+		n32 nWidth = 0;
+		n32 nHeight = 0;
+		n32 nMipLevel = 0;
+		unsigned long long uHash[3] = {};
+		char szOrigin[8] = {};
+		// a line without the origin is from before it was written and counts as an import, which costs one more export at most
+		n32 nFieldCount = sscanf(szLine, "%d %d %d %d %d %llx %llx %llx %7s", &nIndex, &nFormat, &nWidth, &nHeight, &nMipLevel, &uHash[0], &uHash[1], &uHash[2], szOrigin);
+		if (nFieldCount < 8 || nIndex < 0 || nIndex >= static_cast<n32>(a_vTextureTask.size()))
+		{
+			continue;
+		}
+		const SCtrTextureInfo& ctrTextureInfo = a_pCtrTextureInfo[nIndex];
+		if (nFormat != ctrTextureInfo.TexFormat || nWidth != ctrTextureInfo.Width || nHeight != ctrTextureInfo.Height || nMipLevel != ctrTextureInfo.MipLevel)
+		{
+			continue;
+		}
+		STextureTask& textureTask = a_vTextureTask[nIndex];
+		textureTask.InManifest = true;
+		textureTask.ManifestHash.TexData = uHash[0];
+		textureTask.ManifestHash.File = uHash[1];
+		textureTask.ManifestHash.Pixel = uHash[2];
+		textureTask.ManifestHash.Imported = strcmp(szOrigin, "export") != 0;
+	}
+	fclose(fp);
+}
+
+bool CCtpk::saveManifest(const vector<STextureTask>& a_vTextureTask, const SCtrTextureInfo* a_pCtrTextureInfo) const
+{
+	FILE* fp = UFopen((m_sDirName + USTR("/") + s_pManifestFileName).c_str(), USTR("wb"));
+	if (fp == nullptr)
+	{
+		m_sLastError = USTR("open ") + m_sDirName + USTR("/") + s_pManifestFileName + USTR(" failed");
+		return false;
+	}
+	for (n32 i = 0; i < static_cast<n32>(a_vTextureTask.size()); i++)
+	{
+		const SCtrTextureInfo& ctrTextureInfo = a_pCtrTextureInfo[i];
+		const STextureHash& textureHash = a_vTextureTask[i].Hash;
+		fprintf(fp, "%d %d %d %d %d %016llX %016llX %016llX %s\n", i, ctrTextureInfo.TexFormat, ctrTextureInfo.Width, ctrTextureInfo.Height, ctrTextureInfo.MipLevel, static_cast<unsigned long long>(textureHash.TexData), static_cast<unsigned long long>(textureHash.File), static_cast<unsigned long long>(textureHash.Pixel), textureHash.Imported ? "import" : "export");
+	}
+	fclose(fp);
+	return true;
+}
+
+// neighbouring ranges are merged so that every run of changed bytes takes one positioned write,
+// in atomic mode they go into a clone of the archive that replaceFile later renames over it
+bool CCtpk::writeBack(const u8* a_pCtpk, vector<SDirtyRange>& a_vDirtyRange, UString& a_sTempFileName) const
+{
+	sort(a_vDirtyRange.begin(), a_vDirtyRange.end(), [](const SDirtyRange& a_Left, const SDirtyRange& a_Right)
+	{
+		return a_Left.Offset < a_Right.Offset;
+	});
+	vector<SDirtyRange> vDirtyRange;
+	for (n32 i = 0; i < static_cast<n32>(a_vDirtyRange.size()); i++)
+	{
+		if (!vDirtyRange.empty() && a_vDirtyRange[i].Offset <= vDirtyRange.back().Offset + vDirtyRange.back().Size)
+		{
+			vDirtyRange.back().Size = max(vDirtyRange.back().Size, a_vDirtyRange[i].Offset + a_vDirtyRange[i].Size - vDirtyRange.back().Offset);
+		}
+		else
+		{
+			vDirtyRange.push_back(a_vDirtyRange[i]);
+		}
+	}
+	UString sFileName = m_sFileName;
+	if (m_bAtomic)
+	{
+		a_sTempFileName = m_sFileName + USTR(".tmp");
+		if (!CPositionedFile::Clone(m_sFileName, a_sTempFileName))
+		{
+			m_sLastError = USTR("clone ") + a_sTempFileName + USTR(" failed");
+			a_sTempFileName.clear();
+			return false;
+		}
+		sFileName = a_sTempFileName;
+	}
+	CPositionedFile file;
+	if (!file.Open(sFileName, CPositionedFile::kOpenModeReadWrite))
+	{
+		m_sLastError = USTR("open ") + sFileName + USTR(" failed");
+		return false;
+	}
+	for (n32 i = 0; i < static_cast<n32>(vDirtyRange.size()); i++)
+	{
+		if (!file.Write(vDirtyRange[i].Offset, a_pCtpk + vDirtyRange[i].Offset, vDirtyRange[i].Size))
+		{
+			m_sLastError = USTR("write ") + sFileName + USTR(" failed");
+			return false;
+		}
+	}
+	// the clone has to be on disk before the rename makes it the archive, whatever the sync mode says
+	if (!file.Sync(m_bAtomic && m_nSyncMode == CPositionedFile::kSyncModeNone ? CPositionedFile::kSyncModeData : static_cast<CPositionedFile::ESyncMode>(m_nSyncMode)))
+	{
+		m_sLastError = USTR("sync ") + sFileName + USTR(" failed");
+		return false;
+	}
+	return true;
+}
+
+bool CCtpk::replaceFile(const UString& a_sTempFileName, bool a_bResult) const
+{
+	if (a_sTempFileName.empty())
+	{
+		return a_bResult;
+	}
+	if (!a_bResult)
+	{
+		CPositionedFile::Remove(a_sTempFileName);
+		return false;
+	}
+	if (!CPositionedFile::Replace(m_sFileName, a_sTempFileName, static_cast<CPositionedFile::ESyncMode>(m_nSyncMode)))
+	{
+		m_sLastError = USTR("replace ") + m_sFileName + USTR(" failed");
+		CPositionedFile::Remove(a_sTempFileName);
+		return false;
+	}
+	return true;
+}
+
+bool CCtpk::checkLevel(n32 a_nIndex, n32 a_nLevel) const
+{
+	const SCtrTextureInfo* pCtrTextureInfo = GetTextureInfo(a_nIndex);
+	if (pCtrTextureInfo == nullptr)
+	{
+		m_sLastError = AToU(Format("no texture %d", a_nIndex));
+		return false;
+	}
+	// only the levels with whole tiles inside TexDataSize can be decoded and encoded on their own
+	if (a_nLevel < 0 || a_nLevel >= getLayoutMipLevel(*pCtrTextureInfo) || getLevelOffset(*pCtrTextureInfo, a_nLevel + 1) > static_cast<n32>(pCtrTextureInfo->TexDataSize))
+	{
+		m_sLastError = AToU(Format("no level %d in texture %d", a_nLevel, a_nIndex));
+		return false;
+	}
+	return true;
+}
+
+n32 CCtpk::getLevelOffset(const SCtrTextureInfo& a_CtrTextureInfo, n32 a_nLevel)
+{
+	n32 nOffset = 0;
+	for (n32 l = 0; l < a_nLevel; l++)
+	{
+		nOffset += (a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l) * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+	}
+	return nOffset;
+}
+
+// the levels before the first one smaller than a whole 8x8 tile, the order of the texels in a cut tile is not known
+n32 CCtpk::getLayoutMipLevel(const SCtrTextureInfo& a_CtrTextureInfo)
+{
+	n32 nMipLevel = 0;
+	while (nMipLevel < a_CtrTextureInfo.MipLevel && (a_CtrTextureInfo.Width >> nMipLevel) >= 8 && (a_CtrTextureInfo.Height >> nMipLevel) >= 8)
+	{
+		nMipLevel++;
+	}
+	return nMipLevel;
+}
+
+// export and import stop the chain at the last level with a layout, the levels after it are left as they are
+void CCtpk::limitMipLevel(SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask)
+{
+	n32 nMipLevel = getLayoutMipLevel(a_CtrTextureInfo);
+	if (nMipLevel < a_CtrTextureInfo.MipLevel)
+	{
+		a_TextureTask.Log += AToU(Format("WARNING: levels %d to %d of texture %d are smaller than a tile and left out\n", nMipLevel, a_CtrTextureInfo.MipLevel - 1, a_TextureTask.Index));
+		a_CtrTextureInfo.MipLevel = nMipLevel;
+	}
+}
+
+bool CCtpk::checkTextureTable(const SCtpkHeader& a_CtpkHeader, n64 a_nCtpkSize) const
+{
+	if (static_cast<n64>(sizeof(SCtpkHeader) + a_CtpkHeader.Count * sizeof(SCtrTextureInfo)) > a_nCtpkSize || static_cast<n64>(a_CtpkHeader.TextureShortInfoOffset) + a_CtpkHeader.Count * sizeof(STextureShortInfo) > static_cast<u64>(a_nCtpkSize) || a_CtpkHeader.TextureOffset > a_nCtpkSize)
+	{
+		m_sLastError = USTR("texture table is out of range");
+		return false;
+	}
+	return true;
+}
+
+bool CCtpk::checkTextureInfo(const SCtpkHeader& a_CtpkHeader, const SCtrTextureInfo& a_CtrTextureInfo, const STextureShortInfo& a_TextureShortInfo, n32 a_nIndex, n64 a_nCtpkSize) const
+{
+	if (a_TextureShortInfo.TextFormat != 0xFF && a_CtrTextureInfo.TexFormat != a_TextureShortInfo.TextFormat)
+	{
+		m_sLastError = USTR("format is not equivalent");
+		return false;
+	}
+	if (a_CtrTextureInfo.TexFormat < kTextureFormatRGBA8888 || a_CtrTextureInfo.TexFormat > kTextureFormatETC1_A4)
+	{
+		m_sLastError = AToU(Format("unknown format %d", a_CtrTextureInfo.TexFormat));
+		return false;
+	}
+	if (static_cast<n64>(a_CtpkHeader.TextureOffset) + a_CtrTextureInfo.TexDataOffset + a_CtrTextureInfo.TexDataSize > a_nCtpkSize)
+	{
+		m_sLastError = AToU(Format("texture %d is out of range", a_nIndex));
+		return false;
+	}
+	if (a_CtrTextureInfo.FilePathOffset >= a_nCtpkSize)
+	{
+		m_sLastError = AToU(Format("file path of texture %d is out of range", a_nIndex));
+		return false;
+	}
+	return true;
+}
+
+// up to the NUL in small reads, the file may end long after the path does
+bool CCtpk::readFilePath(const CPositionedFile& a_File, n64 a_nOffset, string& a_sPath)
+{
+	a_sPath.clear();
+	char szChunk[256] = {};
+	while (a_nOffset < a_File.GetSize())
+	{
+		n64 nSize = min<n64>(sizeof(szChunk), a_File.GetSize() - a_nOffset);
+		if (!a_File.Read(a_nOffset, szChunk, nSize))
+		{
+			return false;
+		}
+		const char* pEnd = static_cast<const char*>(memchr(szChunk, 0, static_cast<size_t>(nSize)));
+		if (pEnd != nullptr)
+		{
+			a_sPath.append(szChunk, static_cast<size_t>(pEnd - szChunk));
+			return true;
+		}
+		a_sPath.append(szChunk, static_cast<size_t>(nSize));
+		a_nOffset += nSize;
+	}
+	return false;
+}
+
+n32 CCtpk::getTexDataSize(const SCtrTextureInfo& a_CtrTextureInfo)
+{
+	n32 nSize = 0;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		nSize += (a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l) * s_nBPP[a_CtrTextureInfo.TexFormat] / 8;
+	}
+	return nSize;
+}
+
+n64 CCtpk::getExportCost(const SCtrTextureInfo& a_CtrTextureInfo)
+{
+	// every level is decoded and deflated
+	n64 nPixelCount = 0;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		nPixelCount += static_cast<n64>(a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l);
+	}
+	return nPixelCount;
+}
+
+n64 CCtpk::getImportCost(const SCtrTextureInfo& a_CtrTextureInfo)
+{
+	// relative cost per pixel of encode, the etc1 compressor dwarfs everything else
+	static const n32 c_nPixelCost[] = { 4, 4, 4, 4, 4, 4, 4, 3, 3, 3, 3, 3, 256, 264 };
+	n64 nPixelCount = 0;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		nPixelCount += static_cast<n64>(a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l);
+	}
+	// reading and comparing the first level is paid by every format
+	return nPixelCount * c_nPixelCost[a_CtrTextureInfo.TexFormat] + static_cast<n64>(a_CtrTextureInfo.Width) * a_CtrTextureInfo.Height * 8;
+}
+
+// an upper bound of every path, import keeps the png and the decoded original of each level, the generated
+// rgba mipmaps with the scratch of the widest filter and the encoded chain, export adds the png writer
+// of every level, the ktx paths stay below that, plus the padding of each block
+n64 CCtpk::getScratchSize(const SCtrTextureInfo& a_CtrTextureInfo)
+{
+	n64 nRGBASize = 0;
+	n64 nPngWriterSize = 0;
+	n64 nPngReadSize = 0;
+	// what libpng asks for besides the two row buffers of a level: its structs, the inflate state and window and the idat read buffer
+	static const n64 c_nPngReadSize = 64 * 1024;
+	for (n32 l = 0; l < a_CtrTextureInfo.MipLevel; l++)
+	{
+		nRGBASize += static_cast<n64>(a_CtrTextureInfo.Width >> l) * (a_CtrTextureInfo.Height >> l) * 4;
+		nPngWriterSize += CPngWriter::GetScratchSize(a_CtrTextureInfo.Width >> l, a_CtrTextureInfo.Height >> l);
+		nPngReadSize += c_nPngReadSize + 2 * ((a_CtrTextureInfo.Width >> l) * 4 + 1 + CArena::s_nAlignment);
+	}
+	return nRGBASize * 3 + getTexDataSize(a_CtrTextureInfo) + a_CtrTextureInfo.Height * 2 * static_cast<n64>(sizeof(png_bytep)) + CMipmap::GetScratchSize(a_CtrTextureInfo.Width, a_CtrTextureInfo.Height, a_CtrTextureInfo.MipLevel, CMipmap::kFilterKaiser) + nPngWriterSize + nPngReadSize + (a_CtrTextureInfo.MipLevel * 5 + 4) * CArena::s_nAlignment;
+}
+
+bool CCtpk::IsCtpkFile(const UString& a_sFileName)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("rb"));
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	SCtpkHeader ctpkHeader;
+	fread(&ctpkHeader, sizeof(SCtpkHeader), 1, fp);
+	fclose(fp);
+	return ctpkHeader.Signature == s_uSignature;
+}
+
+bool CCtpk::IsCtpkIconFile(const UString& a_sFileName)
+{
+	n64 nCtpkSize = 0;
+	if (!UGetFileSize(a_sFileName.c_str(), nCtpkSize) || nCtpkSize <= 0 || nCtpkSize % 2 != 0)
+	{
+		return false;
+	}
+	nCtpkSize /= 2;
+	n32 nSize = static_cast<n32>(sqrt(static_cast<double>(nCtpkSize)));
+	return nSize * nSize == nCtpkSize && nSize % 8 == 0;
+}
+
+int CCtpk::decode(const u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pRGBA)
+{
+	if (a_nFormat == kTextureFormatETC1 || a_nFormat == kTextureFormatETC1_A4)
+	{
+		CEtc1::Decode(a_pBuffer, a_pRGBA, a_nWidth, a_nHeight, a_nFormat == kTextureFormatETC1_A4);
+		return 0;
+	}
+	return CPixelFormat::Decode(a_pBuffer, a_pRGBA, a_nWidth, a_nHeight, a_nFormat) ? 0 : 1;
+}
+
+void CCtpk::encode(const u8* a_pData, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, n32 a_nMipmapLevel, n32 a_nBPP, u8** a_pBuffer, n32 a_nEtc1Quality, n32 a_nMipmapFilter, n32 a_nJobs, CArena& a_Arena, STextureStats* a_pStats)
+{
+	bool bEtc1 = a_nFormat == kTextureFormatETC1 || a_nFormat == kTextureFormatETC1_A4;
+	bool bNative = !bEtc1 || a_nEtc1Quality >= 0;
+	n32 nTotalSize = 0;
+	n32 nRGBASize = 0;
+	for (n32 l = 0; l < a_nMipmapLevel; l++)
+	{
+		nTotalSize += (a_nWidth >> l) * (a_nHeight >> l) * a_nBPP / 8;
+		nRGBASize += (a_nWidth >> l) * (a_nHeight >> l) * 4;
+	}
+	*a_pBuffer = a_Arena.Alloc<u8>(nTotalSize);
+	// the levels follow each other in one buffer like in a pvr texture, the first is only copied when there are more or pvrtexlib needs it
+	const u8* pRGBA = a_pData;
+	u8* pMipmap = nullptr;
+	if (a_nMipmapLevel != 1 || !bNative)
+	{
+		pMipmap = a_Arena.Alloc<u8>(nRGBASize);
+		memcpy(pMipmap, a_pData, a_nWidth * a_nHeight * 4);
+		n64 nBegin = getMicrosecond();
+		CMipmap::Generate(pMipmap, pMipmap + a_nWidth * a_nHeight * 4, a_nWidth, a_nHeight, a_nMipmapLevel, static_cast<CMipmap::EFilter>(a_nMipmapFilter), a_Arena);
+		if (a_pStats != nullptr)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight * 2];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
-			{
-				for (n32 j = 0; j < 64; j++)
-				{
-					for (n32 k = 0; k < 2; k++)
-					{
-						pTemp[(i * 64 + j) * 2 + k] = a_pBuffer[(i * 64 + s_nDecodeTransByte[j]) * 2 + 1 - k];
-					}
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight * 2];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					for (n32 k = 0; k < 2; k++)
-					{
-						pRGBA[(i * a_nWidth + j) * 2 + k] = pTemp[(((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 2 + k];
-					}
-				}
-			}
-			delete[] pTemp;
+			a_pStats->Time[kStatsStageMipmap] += getMicrosecond() - nBegin;
 		}
-		break;
-	case kTextureFormatL8:
-	case kTextureFormatA8:
-	case kTextureFormatLA44:
+		pRGBA = pMipmap;
+	}
+	// pvrtexlib is only needed for the default etc1 compressor
+	pvrtexture::CPVRTexture* pPVRTexture = nullptr;
+	if (!bNative)
+	{
+		if (a_nFormat == kTextureFormatETC1_A4)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
-			{
-				for (n32 j = 0; j < 64; j++)
-				{
-					pTemp[i * 64 + j] = a_pBuffer[i * 64 + s_nDecodeTransByte[j]];
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nHeight; i++)
+			// the alpha plane is packed from the source alpha, then the color is made opaque for the compressor
+			n32 nCurrentSize = 0;
+			n32 nCurrentRGBASize = 0;
+			for (n32 l = 0; l < a_nMipmapLevel; l++)
 			{
-				for (n32 j = 0; j < a_nWidth; j++)
+				n32 nMipmapWidth = a_nWidth >> l;
+				n32 nMipmapHeight = a_nHeight >> l;
+				u8* pMipmapRGBA = pMipmap + nCurrentRGBASize;
+				CEtc1::EncodeAlpha(pMipmapRGBA, *a_pBuffer + nCurrentSize, nMipmapWidth, nMipmapHeight);
+				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight; i++)
 				{
-					pRGBA[i * a_nWidth + j] = pTemp[((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8];
+					pMipmapRGBA[i * 4 + 3] = 0xFF;
 				}
+				nCurrentSize += nMipmapWidth * nMipmapHeight * a_nBPP / 8;
+				nCurrentRGBASize += nMipmapWidth * nMipmapHeight * 4;
 			}
-			delete[] pTemp;
 		}
-		break;
-	case kTextureFormatL4:
-	case kTextureFormatA4:
+		PVRTextureHeaderV3 pvrTextureHeaderV3;
+		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PVRStandard8PixelType.PixelTypeID;
+		pvrTextureHeaderV3.u32Height = a_nHeight;
+		pvrTextureHeaderV3.u32Width = a_nWidth;
+		pvrTextureHeaderV3.u32MIPMapCount = a_nMipmapLevel;
+		MetaDataBlock metaDataBlock;
+		metaDataBlock.DevFOURCC = PVRTEX3_IDENT;
+		metaDataBlock.u32Key = ePVRTMetaDataTextureOrientation;
+		metaDataBlock.u32DataSize = 3;
+		metaDataBlock.Data = new PVRTuint8[metaDataBlock.u32DataSize];
+		metaDataBlock.Data[0] = ePVRTOrientRight;
+		metaDataBlock.Data[1] = ePVRTOrientUp;
+		metaDataBlock.Data[2] = ePVRTOrientIn;
+		pvrtexture::CPVRTextureHeader pvrTextureHeader(pvrTextureHeaderV3, 1, &metaDataBlock);
+		pPVRTexture = new pvrtexture::CPVRTexture(pvrTextureHeader, pMipmap);
+		pvrtexture::Transcode(*pPVRTexture, ePVRTPF_ETC1, ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, pvrtexture::eETCSlowPerceptual);
+	}
+	// the pool of this thread, asked for with the same count for every format so that switching formats never restarts it
+	CThreadPool& threadPool = CThreadPool::GetThreadPool(a_nJobs);
+	n32 nCurrentSize = 0;
+	n32 nCurrentRGBASize = 0;
+	for (n32 l = 0; l < a_nMipmapLevel; l++)
+	{
+		n32 nMipmapWidth = a_nWidth >> l;
+		n32 nMipmapHeight = a_nHeight >> l;
+		u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
+		if (!bEtc1)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 64; i++)
-			{
-				for (n32 j = 0; j < 64; j += 2)
-				{
-					pTemp[i * 64 + j] = (a_pBuffer[i * 32 + s_nDecodeTransByte[j] / 2] & 0xF) * 0x11;
-					pTemp[i * 64 + j + 1] = (a_pBuffer[i * 32 + s_nDecodeTransByte[j] / 2] >> 4 & 0xF) * 0x11;
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					pRGBA[i * a_nWidth + j] = pTemp[((i / 8) * (a_nWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8];
-				}
-			}
-			delete[] pTemp;
+			CPixelFormat::Encode(pRGBA + nCurrentRGBASize, pMipmapBuffer, nMipmapWidth, nMipmapHeight, a_nFormat);
 		}
-		break;
-	case kTextureFormatETC1:
+		else if (bNative)
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight / 2];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 2 / 8; i++)
-			{
-				for (n32 j = 0; j < 8; j++)
-				{
-					pTemp[i * 8 + j] = a_pBuffer[i * 8 + 7 - j];
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight / 2];
-			for (n32 i = 0; i < a_nHeight; i += 4)
-			{
-				for (n32 j = 0; j < a_nWidth; j += 4)
-				{
-					memcpy(pRGBA + ((i / 4) * (a_nWidth / 4) + j / 4) * 8, pTemp + (((i / 8) * (a_nWidth / 8) + j / 8) * 4 + (i % 8 / 4 * 2 + j % 8 / 4)) * 8, 8);
-				}
-			}
-			delete[] pTemp;
+			CEtc1::Encode(pRGBA + nCurrentRGBASize, pMipmapBuffer, nMipmapWidth, nMipmapHeight, a_nFormat == kTextureFormatETC1_A4, static_cast<CEtc1::EQuality>(a_nEtc1Quality), threadPool);
 		}
-		break;
-	case kTextureFormatETC1_A4:
+		else
 		{
-			u8* pTemp = new u8[a_nWidth * a_nHeight / 2];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 2 / 8; i++)
-			{
-				for (n32 j = 0; j < 8; j++)
-				{
-					pTemp[i * 8 + j] = a_pBuffer[8 + i * 16 + 7 - j];
-				}
-			}
-			pRGBA = new u8[a_nWidth * a_nHeight / 2];
-			for (n32 i = 0; i < a_nHeight; i += 4)
-			{
-				for (n32 j = 0; j < a_nWidth; j += 4)
-				{
-					memcpy(pRGBA + ((i / 4) * (a_nWidth / 4) + j / 4) * 8, pTemp + (((i / 8) * (a_nWidth / 8) + j / 8) * 4 + (i % 8 / 4 * 2 + j % 8 / 4)) * 8, 8);
-				}
-			}
-			delete[] pTemp;
-			pTemp = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nWidth * a_nHeight / 16; i++)
-			{
-				for (n32 j = 0; j < 4; j++)
-				{
-					pTemp[i * 16 + j] = (a_pBuffer[i * 16 + j * 2] & 0x0F) * 0x11;
-					pTemp[i * 16 + j + 4] = (a_pBuffer[i * 16 + j * 2] >> 4 & 0x0F) * 0x11;
-					pTemp[i * 16 + j + 8] = (a_pBuffer[i * 16 + j * 2 + 1] & 0x0F) * 0x11;
-					pTemp[i * 16 + j + 12] = (a_pBuffer[i * 16 + j * 2 + 1] >> 4 & 0x0F) * 0x11;
-				}
-			}
-			pAlpha = new u8[a_nWidth * a_nHeight];
-			for (n32 i = 0; i < a_nHeight; i++)
-			{
-				for (n32 j = 0; j < a_nWidth; j++)
-				{
-					pAlpha[i * a_nWidth + j] = pTemp[(((i / 8) * (a_nWidth / 8) + j / 8) * 4 + i % 8 / 4 * 2 + j % 8 / 4) * 16 + i % 4 * 4 + j % 4];
-				}
-			}
-			delete[] pTemp;
+			CSwizzle::SwizzleEtc1(static_cast<const u8*>(pPVRTexture->getDataPtr(l)), pMipmapBuffer, nMipmapWidth, nMipmapHeight, a_nFormat == kTextureFormatETC1_A4 ? 16 : 8);
 		}
-		break;
+		nCurrentSize += nMipmapWidth * nMipmapHeight * a_nBPP / 8;
+		nCurrentRGBASize += nMipmapWidth * nMipmapHeight * 4;
 	}
-	PVRTextureHeaderV3 pvrTextureHeaderV3;
+	delete pPVRTexture;
+}
+
+void CCtpk::deswizzle(const u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pKtx, u8* a_pAlphaKtx, CArena& a_Arena)
+{
 	switch (a_nFormat)
 	{
 	case kTextureFormatRGBA8888:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 8, 8, 8, 8).PixelTypeID;
-		break;
 	case kTextureFormatRGB888:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 'b', 0, 8, 8, 8, 0).PixelTypeID;
+	case kTextureFormatLA88:
+	case kTextureFormatHL8:
+		CSwizzle::Deswizzle(a_pBuffer, a_pKtx, a_nWidth, a_nHeight, s_nBPP[a_nFormat] / 8, true);
 		break;
 	case kTextureFormatRGBA5551:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 5, 5, 5, 1).PixelTypeID;
-		break;
 	case kTextureFormatRGB565:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 'b', 0, 5, 6, 5, 0).PixelTypeID;
-		break;
 	case kTextureFormatRGBA4444:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 4, 4, 4, 4).PixelTypeID;
-		break;
-	case kTextureFormatLA88:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('l', 'a', 0, 0, 8, 8, 0, 0).PixelTypeID;
-		break;
-	case kTextureFormatHL8:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('r', 'g', 0, 0, 8, 8, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatL8:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('l', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatA8:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('a', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
+		// the packed 16 bit formats are little endian u16 just like the gl packed types in a little endian ktx
+		CSwizzle::Deswizzle(a_pBuffer, a_pKtx, a_nWidth, a_nHeight, s_nBPP[a_nFormat] / 8, false);
 		break;
 	case kTextureFormatLA44:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('l', 'a', 0, 0, 4, 4, 0, 0).PixelTypeID;
+		{
+			u8* pLA44 = a_Arena.Alloc<u8>(a_nWidth * a_nHeight);
+			CSwizzle::Deswizzle(a_pBuffer, pLA44, a_nWidth, a_nHeight, 1, false);
+			for (n32 i = 0; i < a_nWidth * a_nHeight; i++)
+			{
+				a_pKtx[i * 2] = (pLA44[i] >> 4) * 0x11;
+				a_pKtx[i * 2 + 1] = (pLA44[i] & 0x0F) * 0x11;
+			}
+		}
 		break;
 	case kTextureFormatL4:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('l', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatA4:
-		pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PixelType('a', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
+		CSwizzle::DeswizzleNibble(a_pBuffer, a_pKtx, a_nWidth, a_nHeight);
 		break;
 	case kTextureFormatETC1:
-		pvrTextureHeaderV3.u64PixelFormat = ePVRTPF_ETC1;
+		CSwizzle::DeswizzleEtc1(a_pBuffer, a_pKtx, a_nWidth, a_nHeight, 8);
 		break;
 	case kTextureFormatETC1_A4:
-		pvrTextureHeaderV3.u64PixelFormat = ePVRTPF_ETC1;
+		CSwizzle::DeswizzleEtc1(a_pBuffer, a_pKtx, a_nWidth, a_nHeight, 16);
+		CSwizzle::DeswizzleEtc1Alpha(a_pBuffer, a_pAlphaKtx, a_nWidth, a_nHeight);
 		break;
 	}
-	pvrTextureHeaderV3.u32Height = a_nHeight;
-	pvrTextureHeaderV3.u32Width = a_nWidth;
-	MetaDataBlock metaDataBlock;
-	metaDataBlock.DevFOURCC = PVRTEX3_IDENT;
-	metaDataBlock.u32Key = ePVRTMetaDataTextureOrientation;
-	metaDataBlock.u32DataSize = 3;
-	metaDataBlock.Data = new PVRTuint8[metaDataBlock.u32DataSize];
-	metaDataBlock.Data[0] = ePVRTOrientRight;
-	metaDataBlock.Data[1] = ePVRTOrientUp;
-	metaDataBlock.Data[2] = ePVRTOrientIn;
-	pvrtexture::CPVRTextureHeader pvrTextureHeader(pvrTextureHeaderV3, 1, &metaDataBlock);
-	*a_pPVRTexture = new pvrtexture::CPVRTexture(pvrTextureHeader, pRGBA);
-	delete[] pRGBA;
-	pvrtexture::Transcode(**a_pPVRTexture, pvrtexture::PVRStandard8PixelType, ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB);
-	if (a_nFormat == kTextureFormatETC1_A4)
-	{
-		u8* pData = static_cast<u8*>((*a_pPVRTexture)->getDataPtr());
-		for (n32 i = 0; i < a_nHeight; i++)
-		{
-			for (n32 j = 0; j < a_nWidth; j++)
-			{
-				pData[(i * a_nWidth + j) * 4 + 3] = pAlpha[i * a_nWidth + j];
-			}
-		}
-		delete[] pAlpha;
-	}
-	return 0;
 }
 
-void CCtpk::encode(u8* a_pData, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, n32 a_nMipmapLevel, n32 a_nBPP, u8** a_pBuffer)
+void CCtpk::swizzle(const u8* a_pKtx, const u8* a_pAlphaKtx, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pBuffer, CArena& a_Arena)
 {
-	PVRTextureHeaderV3 pvrTextureHeaderV3;
-	pvrTextureHeaderV3.u64PixelFormat = pvrtexture::PVRStandard8PixelType.PixelTypeID;
-	pvrTextureHeaderV3.u32Height = a_nHeight;
-	pvrTextureHeaderV3.u32Width = a_nWidth;
-	MetaDataBlock metaDataBlock;
-	metaDataBlock.DevFOURCC = PVRTEX3_IDENT;
-	metaDataBlock.u32Key = ePVRTMetaDataTextureOrientation;
-	metaDataBlock.u32DataSize = 3;
-	metaDataBlock.Data = new PVRTuint8[metaDataBlock.u32DataSize];
-	metaDataBlock.Data[0] = ePVRTOrientRight;
-	metaDataBlock.Data[1] = ePVRTOrientUp;
-	metaDataBlock.Data[2] = ePVRTOrientIn;
-	pvrtexture::CPVRTextureHeader pvrTextureHeader(pvrTextureHeaderV3, 1, &metaDataBlock);
-	pvrtexture::CPVRTexture* pPVRTexture = nullptr;
-	pvrtexture::CPVRTexture* pPVRTextureAlpha = nullptr;
-	if (a_nFormat != kTextureFormatETC1_A4)
-	{
-		pPVRTexture = new pvrtexture::CPVRTexture(pvrTextureHeader, a_pData);
-	}
-	else
-	{
-		u8* pRGBAData = new u8[a_nWidth * a_nHeight * 4];
-		memcpy(pRGBAData, a_pData, a_nWidth * a_nHeight * 4);
-		u8* pAlphaData = new u8[a_nWidth * a_nHeight * 4];
-		memcpy(pAlphaData, a_pData, a_nWidth * a_nHeight * 4);
-		for (n32 i = 0; i < a_nWidth * a_nHeight; i++)
-		{
-			pRGBAData[i * 4 + 3] = 0xFF;
-			pAlphaData[i * 4] = 0;
-			pAlphaData[i * 4 + 1] = 0;
-			pAlphaData[i * 4 + 2] = 0;
-		}
-		pPVRTexture = new pvrtexture::CPVRTexture(pvrTextureHeader, pRGBAData);
-		pPVRTextureAlpha = new pvrtexture::CPVRTexture(pvrTextureHeader, pAlphaData);
-		delete[] pRGBAData;
-		delete[] pAlphaData;
-	}
-	if (a_nMipmapLevel != 1)
-	{
-		pvrtexture::GenerateMIPMaps(*pPVRTexture, pvrtexture::eResizeNearest, a_nMipmapLevel);
-		if (a_nFormat == kTextureFormatETC1_A4)
-		{
-			pvrtexture::GenerateMIPMaps(*pPVRTextureAlpha, pvrtexture::eResizeNearest, a_nMipmapLevel);
-		}
-	}
-	pvrtexture::uint64 uPixelFormat = 0;
-	pvrtexture::ECompressorQuality eCompressorQuality = pvrtexture::ePVRTCBest;
 	switch (a_nFormat)
 	{
 	case kTextureFormatRGBA8888:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 8, 8, 8, 8).PixelTypeID;
-		break;
 	case kTextureFormatRGB888:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 'b', 0, 8, 8, 8, 0).PixelTypeID;
+	case kTextureFormatLA88:
+	case kTextureFormatHL8:
+		CSwizzle::Swizzle(a_pKtx, a_pBuffer, a_nWidth, a_nHeight, s_nBPP[a_nFormat] / 8, true);
 		break;
 	case kTextureFormatRGBA5551:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 5, 5, 5, 1).PixelTypeID;
-		break;
 	case kTextureFormatRGB565:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 'b', 0, 5, 6, 5, 0).PixelTypeID;
-		break;
 	case kTextureFormatRGBA4444:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 'b', 'a', 4, 4, 4, 4).PixelTypeID;
-		break;
-	case kTextureFormatLA88:
-		uPixelFormat = pvrtexture::PixelType('l', 'a', 0, 0, 8, 8, 0, 0).PixelTypeID;
-		break;
-	case kTextureFormatHL8:
-		uPixelFormat = pvrtexture::PixelType('r', 'g', 0, 0, 8, 8, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatL8:
-		uPixelFormat = pvrtexture::PixelType('l', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatA8:
-		uPixelFormat = pvrtexture::PixelType('a', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
+		CSwizzle::Swizzle(a_pKtx, a_pBuffer, a_nWidth, a_nHeight, s_nBPP[a_nFormat] / 8, false);
 		break;
 	case kTextureFormatLA44:
-		uPixelFormat = pvrtexture::PixelType('l', 'a', 0, 0, 4, 4, 0, 0).PixelTypeID;
+		{
+			u8* pLA44 = a_Arena.Alloc<u8>(a_nWidth * a_nHeight);
+			for (n32 i = 0; i < a_nWidth * a_nHeight; i++)
+			{
+				pLA44[i] = static_cast<u8>((a_pKtx[i * 2] / 0x11) << 4 | (a_pKtx[i * 2 + 1] / 0x11));
+			}
+			CSwizzle::Swizzle(pLA44, a_pBuffer, a_nWidth, a_nHeight, 1, false);
+		}
 		break;
 	case kTextureFormatL4:
-		uPixelFormat = pvrtexture::PixelType('l', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
-		break;
 	case kTextureFormatA4:
-		uPixelFormat = pvrtexture::PixelType('a', 0, 0, 0, 8, 0, 0, 0).PixelTypeID;
+		CSwizzle::SwizzleNibble(a_pKtx, a_pBuffer, a_nWidth, a_nHeight);
 		break;
 	case kTextureFormatETC1:
-		uPixelFormat = ePVRTPF_ETC1;
-		eCompressorQuality = pvrtexture::eETCSlowPerceptual;
+		CSwizzle::SwizzleEtc1(a_pKtx, a_pBuffer, a_nWidth, a_nHeight, 8);
 		break;
 	case kTextureFormatETC1_A4:
-		uPixelFormat = ePVRTPF_ETC1;
-		eCompressorQuality = pvrtexture::eETCSlowPerceptual;
+		CSwizzle::SwizzleEtc1Alpha(a_pAlphaKtx, a_pBuffer, a_nWidth, a_nHeight);
+		CSwizzle::SwizzleEtc1(a_pKtx, a_pBuffer, a_nWidth, a_nHeight, 16);
 		break;
 	}
-	pvrtexture::Transcode(*pPVRTexture, uPixelFormat, ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, eCompressorQuality);
-	if (a_nFormat == kTextureFormatETC1_A4)
-	{
-		pvrtexture::Transcode(*pPVRTextureAlpha, pvrtexture::PixelType('a', 0, 0, 0, 8, 0, 0, 0).PixelTypeID, ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, pvrtexture::ePVRTCBest);
-	}
-	n32 nTotalSize = 0;
-	n32 nCurrentSize = 0;
-	for (n32 l = 0; l < a_nMipmapLevel; l++)
-	{
-		nTotalSize += (a_nWidth >> l) * (a_nHeight >> l) * a_nBPP / 8;
-	}
-	*a_pBuffer = new u8[nTotalSize];
-	for (n32 l = 0; l < a_nMipmapLevel; l++)
-	{
-		n32 nMipmapWidth = a_nWidth >> l;
-		n32 nMipmapHeight = a_nHeight >> l;
-		u8* pRGBA = static_cast<u8*>(pPVRTexture->getDataPtr(l));
-		u8* pAlpha = nullptr;
-		if (a_nFormat == kTextureFormatETC1_A4)
-		{
-			pAlpha = static_cast<u8*>(pPVRTextureAlpha->getDataPtr(l));
-		}
-		switch (a_nFormat)
-		{
-		case kTextureFormatRGBA8888:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight * 4];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						for (n32 k = 0; k < 4; k++)
-						{
-							pTemp[(((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 4 + k] = pRGBA[(i * nMipmapWidth + j) * 4 + k];
-						}
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j++)
-					{
-						for (n32 k = 0; k < 4; k++)
-						{
-							pMipmapBuffer[(i * 64 + s_nDecodeTransByte[j]) * 4 + 3 - k] = pTemp[(i * 64 + j) * 4 + k];
-						}
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatRGB888:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight * 3];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						for (n32 k = 0; k < 3; k++)
-						{
-							pTemp[(((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 3 + k] = pRGBA[(i * nMipmapWidth + j) * 3 + k];
-						}
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j++)
-					{
-						for (n32 k = 0; k < 3; k++)
-						{
-							pMipmapBuffer[(i * 64 + s_nDecodeTransByte[j]) * 3 + 2 - k] = pTemp[(i * 64 + j) * 3 + k];
-						}
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatRGBA5551:
-		case kTextureFormatRGB565:
-		case kTextureFormatRGBA4444:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight * 2];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						for (n32 k = 0; k < 2; k++)
-						{
-							pTemp[(((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 2 + k] = pRGBA[(i * nMipmapWidth + j) * 2 + k];
-						}
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j++)
-					{
-						for (n32 k = 0; k < 2; k++)
-						{
-							pMipmapBuffer[(i * 64 + s_nDecodeTransByte[j]) * 2 + k] = pTemp[(i * 64 + j) * 2 + k];
-						}
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatLA88:
-		case kTextureFormatHL8:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight * 2];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						for (n32 k = 0; k < 2; k++)
-						{
-							pTemp[(((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8) * 2 + k] = pRGBA[(i * nMipmapWidth + j) * 2 + k];
-						}
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j++)
-					{
-						for (n32 k = 0; k < 2; k++)
-						{
-							pMipmapBuffer[(i * 64 + s_nDecodeTransByte[j]) * 2 + 1 - k] = pTemp[(i * 64 + j) * 2 + k];
-						}
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatL8:
-		case kTextureFormatA8:
-		case kTextureFormatLA44:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						pTemp[((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8] = pRGBA[i * nMipmapWidth + j];
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j++)
-					{
-						pMipmapBuffer[i * 64 + s_nDecodeTransByte[j]] = pTemp[i * 64 + j];
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatL4:
-		case kTextureFormatA4:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						pTemp[((i / 8) * (nMipmapWidth / 8) + j / 8) * 64 + i % 8 * 8 + j % 8] = pRGBA[i * nMipmapWidth + j];
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 64; i++)
-				{
-					for (n32 j = 0; j < 64; j += 2)
-					{
-						pMipmapBuffer[i * 32 + s_nDecodeTransByte[j] / 2] = ((pTemp[i * 64 + j] / 0x11) & 0x0F) | ((pTemp[i * 64 + j + 1] / 0x11) << 4 & 0xF0);
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatETC1:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight / 2];
-				for (n32 i = 0; i < nMipmapHeight; i += 4)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j += 4)
-					{
-						memcpy(pTemp + (((i / 8) * (nMipmapWidth / 8) + j / 8) * 4 + (i % 8 / 4 * 2 + j % 8 / 4)) * 8, pRGBA + ((i / 4) * (nMipmapWidth / 4) + j / 4) * 8, 8);
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 2 / 8; i++)
-				{
-					for (n32 j = 0; j < 8; j++)
-					{
-						pMipmapBuffer[i * 8 + 7 - j] = pTemp[i * 8 + j];
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		case kTextureFormatETC1_A4:
-			{
-				u8* pTemp = new u8[nMipmapWidth * nMipmapHeight / 2];
-				for (n32 i = 0; i < nMipmapHeight; i += 4)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j += 4)
-					{
-						memcpy(pTemp + (((i / 8) * (nMipmapWidth / 8) + j / 8) * 4 + (i % 8 / 4 * 2 + j % 8 / 4)) * 8, pRGBA + ((i / 4) * (nMipmapWidth / 4) + j / 4) * 8, 8);
-					}
-				}
-				u8* pMipmapBuffer = *a_pBuffer + nCurrentSize;
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 2 / 8; i++)
-				{
-					for (n32 j = 0; j < 8; j++)
-					{
-						pMipmapBuffer[8 + i * 16 + 7 - j] = pTemp[i * 8 + j];
-					}
-				}
-				delete[] pTemp;
-				pTemp = new u8[nMipmapWidth * nMipmapHeight];
-				for (n32 i = 0; i < nMipmapHeight; i++)
-				{
-					for (n32 j = 0; j < nMipmapWidth; j++)
-					{
-						pTemp[(((i / 8) * (nMipmapWidth / 8) + j / 8) * 4 + i % 8 / 4 * 2 + j % 8 / 4) * 16 + i % 4 * 4 + j % 4] = pAlpha[i * nMipmapWidth + j];
-					}
-				}
-				for (n32 i = 0; i < nMipmapWidth * nMipmapHeight / 16; i++)
-				{
-					for (n32 j = 0; j < 4; j++)
-					{
-						pMipmapBuffer[i * 16 + j * 2] = ((pTemp[i * 16 + j] / 0x11) & 0x0F) | ((pTemp[i * 16 + j + 4] / 0x11) << 4 & 0xF0);
-						pMipmapBuffer[i * 16 + j * 2 + 1] = ((pTemp[i * 16 + j + 8] / 0x11) & 0x0F) | ((pTemp[i * 16 + j + 12] / 0x11) << 4 & 0xF0);
-					}
-				}
-				delete[] pTemp;
-			}
-			break;
-		}
-		nCurrentSize += nMipmapWidth * nMipmapHeight * a_nBPP / 8;
-	}
-	delete pPVRTexture;
-	if (a_nFormat == kTextureFormatETC1_A4)
-	{
-		delete pPVRTextureAlpha;
-	}
 }
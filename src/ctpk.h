@@ -1,13 +1,18 @@
 #ifndef CTPK_H_
 #define CTPK_H_
 
-#include <sdw.h>
+#include "ktx.h"
+#include <functional>
 
 namespace pvrtexture
 {
 	class CPVRTexture;
 }
 
+class CArena;
+class CPositionedFile;
+class CThreadPool;
+
 #include SDW_MSC_PUSH_PACKED
 struct SCtpkHeader
 {
@@ -65,11 +70,66 @@ public:
 		kTextureFormatETC1 = 12,
 		kTextureFormatETC1_A4 = 13
 	};
+	enum EStatsStage
+	{
+		kStatsStageRead,
+		kStatsStageDeswizzle,
+		kStatsStageTranscode,
+		kStatsStageMipmap,
+		kStatsStagePngEncode,
+		kStatsStagePngDecode,
+		kStatsStageWrite,
+		kStatsStageCount
+	};
+	struct STextureStats
+	{
+		UString FileName;
+		n32 Format;
+		n32 Width;
+		n32 Height;
+		n32 MipLevel;
+		n64 PixelCount;
+		n64 BytesIn;
+		n64 BytesOut;
+		n64 Time[kStatsStageCount];
+		STextureStats();
+	};
+	struct STextureEntry
+	{
+		UString Name;
+		SCtrTextureInfo Info;
+		STextureShortInfo ShortInfo;
+		n32 Size;
+		STextureEntry();
+	};
 	CCtpk();
 	~CCtpk();
 	void SetFileName(const UString& a_sFileName);
 	void SetDirName(const UString& a_sDirName);
 	void SetVerbose(bool a_bVerbose);
+	void SetJobs(n32 a_nJobs);
+	void SetEtc1Quality(n32 a_nEtc1Quality);
+	void SetIncremental(bool a_bIncremental);
+	void SetPngEffort(n32 a_nPngEffort);
+	void SetKtx(bool a_bKtx);
+	void SetMipmapFilter(n32 a_nMipmapFilter);
+	void SetThreadPool(CThreadPool* a_pThreadPool);
+	void SetOnly(const vector<UString>& a_vOnly);
+	void SetIndex(const vector<n32>& a_vIndex);
+	void SetSyncMode(n32 a_nSyncMode);
+	void SetAtomic(bool a_bAtomic);
+	void SetLog(UString* a_pLog);
+	bool Open(u8* a_pCtpk, n64 a_nCtpkSize);
+	void Close();
+	n32 GetTextureCount() const;
+	const SCtrTextureInfo* GetTextureInfo(n32 a_nIndex) const;
+	UString GetTextureName(n32 a_nIndex) const;
+	u8* GetTexData(n32 a_nIndex) const;
+	bool DecodeTexture(n32 a_nIndex, n32 a_nLevel, u8* a_pRGBA) const;
+	bool EncodeTexture(n32 a_nIndex, n32 a_nLevel, const u8* a_pRGBA);
+	bool ListFile(SCtpkHeader& a_CtpkHeader, vector<STextureEntry>& a_vTextureEntry) const;
+	const vector<STextureStats>& GetStats() const;
+	const UString& GetLastError() const;
 	bool ExportFile();
 	bool ImportFile();
 	bool DecodeFile();
@@ -78,13 +138,98 @@ public:
 	static bool IsCtpkIconFile(const UString& a_sFileName);
 	static const u32 s_uSignature;
 	static const int s_nBPP[];
-	static const int s_nDecodeTransByte[64];
+	static const UChar* s_pManifestFileName;
+	static const char* s_pFormatName[];
+	static const char* s_pStatsStageName[];
 private:
-	static int decode(u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, pvrtexture::CPVRTexture** a_pPVRTexture);
-	static void encode(u8* a_pData, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, n32 a_nMipmapLevel, n32 a_nBPP, u8** a_pBuffer);
+	struct STextureHash
+	{
+		u64 TexData;
+		u64 File;
+		u64 Pixel;
+		bool Imported;
+		STextureHash();
+	};
+	struct STextureTask
+	{
+		n32 Index;
+		n64 Cost;
+		n64 ScratchSize;
+		n32 Jobs;
+		CArena* Arena;
+		UString FileName;
+		UString AlphaFileName;
+		vector<UString> MipmapFileName;
+		UString Log;
+		STextureHash Hash;
+		STextureHash ManifestHash;
+		STextureStats Stats;
+		bool InManifest;
+		bool Changed;
+		bool Result;
+		bool Done;
+		bool Selected;
+		STextureTask();
+	};
+	struct SDirtyRange
+	{
+		n64 Offset;
+		n64 Size;
+		SDirtyRange();
+	};
+	void log(const UString& a_sText) const;
+	void initTextureTask(n32 a_nIndex, bool a_bExport, STextureTask& a_TextureTask) const;
+	void runTextureTask(vector<STextureTask>& a_vTextureTask, const function<void(STextureTask&)>& a_fTask);
+	bool exportTexture(const u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const;
+	bool importTexture(u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const;
+	bool importLevel(u8* a_pTexData, n32 a_nTexDataSize, const SCtrTextureInfo& a_CtrTextureInfo, n32 a_nLevel, n32 a_nMipLevel, bool a_bManifest, STextureTask& a_TextureTask) const;
+	bool exportKtx(const u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const;
+	bool importKtx(u8* a_pTexData, const SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask) const;
+	bool getFileHash(const STextureTask& a_TextureTask, u64& a_uHash) const;
+	bool checkSelection(n32 a_nCount) const;
+	bool isSelected(n32 a_nIndex, const UString& a_sName) const;
+	static bool matchGlob(const UChar* a_pName, const UChar* a_pGlob);
+	static n64 getFileSize(const STextureTask& a_TextureTask);
+	static void getMipmapFileName(const SCtrTextureInfo& a_CtrTextureInfo, const UString& a_sDirName, const UString& a_sBaseName, vector<UString>& a_vMipmapFileName);
+	void loadManifest(vector<STextureTask>& a_vTextureTask, const SCtrTextureInfo* a_pCtrTextureInfo) const;
+	bool saveManifest(const vector<STextureTask>& a_vTextureTask, const SCtrTextureInfo* a_pCtrTextureInfo) const;
+	bool writeBack(const u8* a_pCtpk, vector<SDirtyRange>& a_vDirtyRange, UString& a_sTempFileName) const;
+	bool replaceFile(const UString& a_sTempFileName, bool a_bResult) const;
+	bool checkLevel(n32 a_nIndex, n32 a_nLevel) const;
+	static n32 getLevelOffset(const SCtrTextureInfo& a_CtrTextureInfo, n32 a_nLevel);
+	static n32 getLayoutMipLevel(const SCtrTextureInfo& a_CtrTextureInfo);
+	static void limitMipLevel(SCtrTextureInfo& a_CtrTextureInfo, STextureTask& a_TextureTask);
+	bool checkTextureTable(const SCtpkHeader& a_CtpkHeader, n64 a_nCtpkSize) const;
+	bool checkTextureInfo(const SCtpkHeader& a_CtpkHeader, const SCtrTextureInfo& a_CtrTextureInfo, const STextureShortInfo& a_TextureShortInfo, n32 a_nIndex, n64 a_nCtpkSize) const;
+	static bool readFilePath(const CPositionedFile& a_File, n64 a_nOffset, string& a_sPath);
+	static n32 getTexDataSize(const SCtrTextureInfo& a_CtrTextureInfo);
+	static n64 getExportCost(const SCtrTextureInfo& a_CtrTextureInfo);
+	static n64 getImportCost(const SCtrTextureInfo& a_CtrTextureInfo);
+	static n64 getScratchSize(const SCtrTextureInfo& a_CtrTextureInfo);
+	static int decode(const u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pRGBA);
+	static void encode(const u8* a_pData, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, n32 a_nMipmapLevel, n32 a_nBPP, u8** a_pBuffer, n32 a_nEtc1Quality, n32 a_nMipmapFilter, n32 a_nJobs, CArena& a_Arena, STextureStats* a_pStats);
+	static void deswizzle(const u8* a_pBuffer, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pKtx, u8* a_pAlphaKtx, CArena& a_Arena);
+	static void swizzle(const u8* a_pKtx, const u8* a_pAlphaKtx, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat, u8* a_pBuffer, CArena& a_Arena);
+	static const CKtx::SFormat s_KtxFormat[];
 	UString m_sFileName;
 	UString m_sDirName;
 	bool m_bVerbose;
+	n32 m_nJobs;
+	n32 m_nEtc1Quality;
+	bool m_bIncremental;
+	n32 m_nPngEffort;
+	bool m_bKtx;
+	n32 m_nMipmapFilter;
+	CThreadPool* m_pThreadPool;
+	vector<UString> m_vOnly;
+	vector<n32> m_vIndex;
+	n32 m_nSyncMode;
+	bool m_bAtomic;
+	UString* m_pLog;
+	mutable UString m_sLastError;
+	u8* m_pCtpk;
+	n64 m_nCtpkSize;
+	vector<STextureStats> m_vStats;
 };
 
 #endif	// CTPK_H_
@@ -1,12 +1,38 @@
 #include "ctpktool.h"
 #include "ctpk.h"
+#include "etc1.h"
+#include "mipmap.h"
+#include "pngwriter.h"
+#include "positionedfile.h"
+#include "threadpool.h"
+#include <chrono>
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#endif
 
 CCtpkTool::SOption CCtpkTool::s_Option[] =
 {
 	{ USTR("export"), USTR('e'), USTR("export from the target file") },
 	{ USTR("import"), USTR('i'), USTR("import to the target file") },
+	{ USTR("list"), USTR('l'), USTR("list the textures of the target file from its tables alone, --list=json prints json") },
 	{ USTR("file"), USTR('f'), USTR("the target file") },
 	{ USTR("dir"), USTR('d'), USTR("the dir for the target file") },
+	{ USTR("batch"), 0, USTR("a tree of ctpk files mirrored to --dir, or a list of ctpk<TAB>dir lines, - reads the list from stdin") },
+	{ USTR("only"), 0, USTR("only the textures whose name matches the glob, * and ? as wildcards, may be repeated") },
+	{ USTR("index"), 0, USTR("only the textures at the comma separated indexes, N,M") },
+	{ USTR("jobs"), USTR('j'), USTR("the number of worker threads, or auto, default is 1") },
+	{ USTR("etc1-quality"), 0, USTR("encode etc1 with the built-in encoder, fast, medium or slow, default is the slow perceptual encoder of pvrtexlib") },
+	{ USTR("mipmap-filter"), 0, USTR("the filter that generates missing mipmaps, nearest, box or kaiser, default is box") },
+	{ USTR("png-effort"), 0, USTR("the png compression effort, stored, fast, default or max, default is default") },
+	{ USTR("incremental"), 0, USTR("only export the textures whose data changed since the last export") },
+	{ USTR("ktx"), 0, USTR("export and import the native blocks with every mipmap as ktx instead of png") },
+	{ USTR("fsync"), 0, USTR("flush the import to disk, none, data or full, default is none") },
+	{ USTR("atomic"), 0, USTR("import into a clone of the target file and rename it over the target file") },
+	{ USTR("stats"), 0, USTR("show the time of every stage, the bytes and the throughput per texture and format, --stats=json prints json") },
 	{ USTR("verbose"), USTR('v'), USTR("show the info") },
 	{ USTR("help"), USTR('h'), USTR("show this help") },
 	{ nullptr, 0, nullptr }
@@ -15,6 +41,16 @@ CCtpkTool::SOption CCtpkTool::s_Option[] =
 CCtpkTool::CCtpkTool()
 	: m_eAction(kActionNone)
 	, m_bVerbose(false)
+	, m_nJobs(1)
+	, m_nEtc1Quality(-1)
+	, m_bIncremental(false)
+	, m_nPngEffort(CPngWriter::kEffortDefault)
+	, m_bKtx(false)
+	, m_nMipmapFilter(CMipmap::kFilterBox)
+	, m_nSyncMode(CPositionedFile::kSyncModeNone)
+	, m_bAtomic(false)
+	, m_eStats(kStatsNone)
+	, m_bListJson(false)
 {
 }
 
@@ -55,6 +91,9 @@ int CCtpkTool::ParseOptions(int a_nArgc, UChar* a_pArgv[])
 				case kParseOptionReturnNoArgument:
 					UPrintf(USTR("ERROR: no argument\n\n"));
 					return 1;
+				case kParseOptionReturnUnknownArgument:
+					UPrintf(USTR("ERROR: unknown argument \"%") PRIUS USTR("\"\n\n"), m_sMessage.c_str());
+					return 1;
 				case kParseOptionReturnOptionConflict:
 					UPrintf(USTR("ERROR: option conflict\n\n"));
 					return 1;
@@ -73,6 +112,9 @@ int CCtpkTool::ParseOptions(int a_nArgc, UChar* a_pArgv[])
 			case kParseOptionReturnNoArgument:
 				UPrintf(USTR("ERROR: no argument\n\n"));
 				return 1;
+			case kParseOptionReturnUnknownArgument:
+				UPrintf(USTR("ERROR: unknown argument \"%") PRIUS USTR("\"\n\n"), m_sMessage.c_str());
+				return 1;
 			case kParseOptionReturnOptionConflict:
 				UPrintf(USTR("ERROR: option conflict\n\n"));
 				return 1;
@@ -90,7 +132,37 @@ int CCtpkTool::CheckOptions()
 		UPrintf(USTR("ERROR: nothing to do\n\n"));
 		return 1;
 	}
-	if (m_eAction != kActionHelp)
+	if (m_eAction == kActionList)
+	{
+		if (!m_sBatchName.empty())
+		{
+			UPrintf(USTR("ERROR: --list takes --file, not --batch\n\n"));
+			return 1;
+		}
+		if (m_sFileName.empty())
+		{
+			UPrintf(USTR("ERROR: no --file option\n\n"));
+			return 1;
+		}
+		if (!CCtpk::IsCtpkFile(m_sFileName))
+		{
+			UPrintf(USTR("ERROR: %") PRIUS USTR(" is not a ctpk file\n\n"), m_sFileName.c_str());
+			return 1;
+		}
+	}
+	else if (m_eAction != kActionHelp && !m_sBatchName.empty())
+	{
+		if (!m_sFileName.empty())
+		{
+			UPrintf(USTR("ERROR: --batch and --file are exclusive\n\n"));
+			return 1;
+		}
+		if (!loadBatch())
+		{
+			return 1;
+		}
+	}
+	else if (m_eAction != kActionHelp)
 	{
 		if (m_sFileName.empty())
 		{
@@ -121,6 +193,21 @@ int CCtpkTool::Help()
 	UPrintf(USTR("sample:\n"));
 	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir\n"));
 	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir\n"));
+	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir --jobs auto\n"));
+	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir --incremental\n"));
+	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir --png-effort fast\n"));
+	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir --jobs auto --etc1-quality fast\n"));
+	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir --mipmap-filter kaiser\n"));
+	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir --ktx\n"));
+	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir --ktx\n"));
+	UPrintf(USTR("  ctpktool -evd outputdir --batch romfs --jobs auto\n"));
+	UPrintf(USTR("  ctpktool -iv --batch list.txt --jobs auto\n"));
+	UPrintf(USTR("  ctpktool -evd outputdir --batch romfs --jobs auto --stats=json\n"));
+	UPrintf(USTR("  ctpktool -evfd input.ctpk outputdir --only \"*/ui/*\" --index 3,7\n"));
+	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir --only \"*/ui/title.tga\"\n"));
+	UPrintf(USTR("  ctpktool -ivfd output.ctpk inputdir --atomic --fsync full\n"));
+	UPrintf(USTR("  ctpktool -lf input.ctpk\n"));
+	UPrintf(USTR("  ctpktool -f input.ctpk --list=json\n"));
 	UPrintf(USTR("\n"));
 	UPrintf(USTR("option:\n"));
 	SOption* pOption = s_Option;
@@ -155,27 +242,56 @@ int CCtpkTool::Help()
 
 int CCtpkTool::Action()
 {
-	if (m_eAction == kActionExport)
+	if (m_eAction == kActionHelp)
+	{
+		return Help();
+	}
+	if (m_eAction == kActionList)
 	{
-		if (!exportFile())
+		if (!listFile())
 		{
-			UPrintf(USTR("ERROR: export file failed\n\n"));
+			UPrintf(USTR("ERROR: list file failed\n\n"));
 			return 1;
 		}
+		return 0;
+	}
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	int nResult = 0;
+	if (!m_vBatch.empty())
+	{
+		if (!batch())
+		{
+			UPrintf(USTR("ERROR: batch failed\n\n"));
+			nResult = 1;
+		}
+	}
+	else if (m_eAction == kActionExport)
+	{
+		UString sLog;
+		bool bResult = exportFile(m_sFileName, m_sDirName, nullptr, sLog);
+		UPrintf(USTR("%") PRIUS, sLog.c_str());
+		if (!bResult)
+		{
+			UPrintf(USTR("ERROR: export file failed\n\n"));
+			nResult = 1;
+		}
 	}
-	if (m_eAction == kActionImport)
+	else if (m_eAction == kActionImport)
 	{
-		if (!importFile())
+		UString sLog;
+		bool bResult = importFile(m_sFileName, m_sDirName, nullptr, sLog);
+		UPrintf(USTR("%") PRIUS, sLog.c_str());
+		if (!bResult)
 		{
 			UPrintf(USTR("ERROR: import file failed\n\n"));
-			return 1;
+			nResult = 1;
 		}
 	}
-	if (m_eAction == kActionHelp)
+	if (m_eStats != kStatsNone)
 	{
-		return Help();
+		printStats(chrono::duration<double>(chrono::steady_clock::now() - begin).count());
 	}
-	return 0;
+	return nResult;
 }
 
 CCtpkTool::EParseOptionReturn CCtpkTool::parseOptions(const UChar* a_pName, int& a_nIndex, int a_nArgc, UChar* a_pArgv[])
@@ -202,6 +318,18 @@ CCtpkTool::EParseOptionReturn CCtpkTool::parseOptions(const UChar* a_pName, int&
 			return kParseOptionReturnOptionConflict;
 		}
 	}
+	else if (UCscmp(a_pName, USTR("list")) == 0 || UCscmp(a_pName, USTR("list=json")) == 0)
+	{
+		if (m_eAction == kActionNone)
+		{
+			m_eAction = kActionList;
+		}
+		else if (m_eAction != kActionList && m_eAction != kActionHelp)
+		{
+			return kParseOptionReturnOptionConflict;
+		}
+		m_bListJson = UCscmp(a_pName, USTR("list=json")) == 0;
+	}
 	else if (UCscmp(a_pName, USTR("file")) == 0)
 	{
 		if (a_nIndex + 1 >= a_nArgc)
@@ -218,6 +346,185 @@ CCtpkTool::EParseOptionReturn CCtpkTool::parseOptions(const UChar* a_pName, int&
 		}
 		m_sDirName = a_pArgv[++a_nIndex];
 	}
+	else if (UCscmp(a_pName, USTR("batch")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_sBatchName = a_pArgv[++a_nIndex];
+	}
+	else if (UCscmp(a_pName, USTR("only")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		m_vOnly.push_back(a_pArgv[++a_nIndex]);
+	}
+	else if (UCscmp(a_pName, USTR("index")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sIndex = a_pArgv[++a_nIndex];
+		vector<UString> vIndex = SplitOf(sIndex, USTR(","));
+		for (n32 i = 0; i < static_cast<n32>(vIndex.size()); i++)
+		{
+			if (vIndex[i].empty() || vIndex[i].find_first_not_of(USTR("0123456789")) != UString::npos)
+			{
+				m_sMessage = sIndex;
+				return kParseOptionReturnUnknownArgument;
+			}
+			m_vIndex.push_back(SToN32(vIndex[i]));
+		}
+	}
+	else if (UCscmp(a_pName, USTR("jobs")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sJobs = a_pArgv[++a_nIndex];
+		if (sJobs == USTR("auto"))
+		{
+			m_nJobs = 0;
+		}
+		else
+		{
+			m_nJobs = SToN32(sJobs);
+			if (m_nJobs <= 0)
+			{
+				m_sMessage = sJobs;
+				return kParseOptionReturnUnknownArgument;
+			}
+		}
+	}
+	else if (UCscmp(a_pName, USTR("etc1-quality")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sEtc1Quality = a_pArgv[++a_nIndex];
+		if (sEtc1Quality == USTR("fast"))
+		{
+			m_nEtc1Quality = CEtc1::kQualityFast;
+		}
+		else if (sEtc1Quality == USTR("medium"))
+		{
+			m_nEtc1Quality = CEtc1::kQualityMedium;
+		}
+		else if (sEtc1Quality == USTR("slow"))
+		{
+			m_nEtc1Quality = CEtc1::kQualitySlow;
+		}
+		else
+		{
+			m_sMessage = sEtc1Quality;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("mipmap-filter")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sMipmapFilter = a_pArgv[++a_nIndex];
+		if (sMipmapFilter == USTR("nearest"))
+		{
+			m_nMipmapFilter = CMipmap::kFilterNearest;
+		}
+		else if (sMipmapFilter == USTR("box"))
+		{
+			m_nMipmapFilter = CMipmap::kFilterBox;
+		}
+		else if (sMipmapFilter == USTR("kaiser"))
+		{
+			m_nMipmapFilter = CMipmap::kFilterKaiser;
+		}
+		else
+		{
+			m_sMessage = sMipmapFilter;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("png-effort")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sPngEffort = a_pArgv[++a_nIndex];
+		if (sPngEffort == USTR("stored"))
+		{
+			m_nPngEffort = CPngWriter::kEffortStored;
+		}
+		else if (sPngEffort == USTR("fast"))
+		{
+			m_nPngEffort = CPngWriter::kEffortFast;
+		}
+		else if (sPngEffort == USTR("default"))
+		{
+			m_nPngEffort = CPngWriter::kEffortDefault;
+		}
+		else if (sPngEffort == USTR("max"))
+		{
+			m_nPngEffort = CPngWriter::kEffortMax;
+		}
+		else
+		{
+			m_sMessage = sPngEffort;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("fsync")) == 0)
+	{
+		if (a_nIndex + 1 >= a_nArgc)
+		{
+			return kParseOptionReturnNoArgument;
+		}
+		UString sSyncMode = a_pArgv[++a_nIndex];
+		if (sSyncMode == USTR("none"))
+		{
+			m_nSyncMode = CPositionedFile::kSyncModeNone;
+		}
+		else if (sSyncMode == USTR("data"))
+		{
+			m_nSyncMode = CPositionedFile::kSyncModeData;
+		}
+		else if (sSyncMode == USTR("full"))
+		{
+			m_nSyncMode = CPositionedFile::kSyncModeFull;
+		}
+		else
+		{
+			m_sMessage = sSyncMode;
+			return kParseOptionReturnUnknownArgument;
+		}
+	}
+	else if (UCscmp(a_pName, USTR("atomic")) == 0)
+	{
+		m_bAtomic = true;
+	}
+	else if (UCscmp(a_pName, USTR("incremental")) == 0)
+	{
+		m_bIncremental = true;
+	}
+	else if (UCscmp(a_pName, USTR("ktx")) == 0)
+	{
+		m_bKtx = true;
+	}
+	else if (UCscmp(a_pName, USTR("stats")) == 0)
+	{
+		m_eStats = kStatsText;
+	}
+	else if (UCscmp(a_pName, USTR("stats=json")) == 0)
+	{
+		m_eStats = kStatsJson;
+	}
 	else if (UCscmp(a_pName, USTR("verbose")) == 0)
 	{
 		m_bVerbose = true;
@@ -241,22 +548,474 @@ CCtpkTool::EParseOptionReturn CCtpkTool::parseOptions(int a_nKey, int& a_nIndex,
 	return kParseOptionReturnIllegalOption;
 }
 
-bool CCtpkTool::exportFile()
+bool CCtpkTool::loadBatch()
+{
+	Stat st;
+	if (m_sBatchName != USTR("-") && UStat(m_sBatchName.c_str(), &st) == 0 && (st.st_mode & S_IFDIR) != 0)
+	{
+		if (m_sDirName.empty())
+		{
+			UPrintf(USTR("ERROR: no --dir option\n\n"));
+			return false;
+		}
+		if (!findBatch(m_sBatchName, m_sDirName))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		FILE* fp = m_sBatchName == USTR("-") ? stdin : UFopen(m_sBatchName.c_str(), USTR("rb"));
+		if (fp == nullptr)
+		{
+			UPrintf(USTR("ERROR: open %") PRIUS USTR(" failed\n\n"), m_sBatchName.c_str());
+			return false;
+		}
+		n32 nLine = 0;
+		char szLine[4096] = {};
+		while (fgets(szLine, sizeof(szLine), fp) != nullptr)
+		{
+			nLine++;
+			string sLine = szLine;
+			sLine.erase(sLine.find_last_not_of("\r\n") + 1);
+			if (sLine.empty())
+			{
+				continue;
+			}
+			string::size_type uPos = sLine.find('\t');
+			if (uPos == string::npos)
+			{
+				UPrintf(USTR("ERROR: no dir at line %d of %") PRIUS USTR("\n\n"), nLine, m_sBatchName.c_str());
+				if (fp != stdin)
+				{
+					fclose(fp);
+				}
+				return false;
+			}
+			m_vBatch.push_back(make_pair(U8ToU(sLine.substr(0, uPos)), U8ToU(sLine.substr(uPos + 1))));
+		}
+		if (fp != stdin)
+		{
+			fclose(fp);
+		}
+	}
+	if (m_vBatch.empty())
+	{
+		UPrintf(USTR("ERROR: no ctpk file in %") PRIUS USTR("\n\n"), m_sBatchName.c_str());
+		return false;
+	}
+	return true;
+}
+
+// every ctpk file of the tree gets the dir of the same relative path in the output tree, minus its extension
+bool CCtpkTool::findBatch(const UString& a_sFileName, const UString& a_sDirName)
+{
+	vector<UString> vFileName;
+	vector<UString> vSubDirName;
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	WIN32_FIND_DATAW ffd;
+	HANDLE hFind = FindFirstFileW((a_sFileName + USTR("/*")).c_str(), &ffd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		UPrintf(USTR("ERROR: open dir %") PRIUS USTR(" failed\n\n"), a_sFileName.c_str());
+		return false;
+	}
+	do
+	{
+		UString sName = ffd.cFileName;
+		if (sName == USTR(".") || sName == USTR(".."))
+		{
+			continue;
+		}
+		if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		{
+			vSubDirName.push_back(sName);
+		}
+		else
+		{
+			vFileName.push_back(sName);
+		}
+	} while (FindNextFileW(hFind, &ffd));
+	FindClose(hFind);
+#else
+	DIR* pDir = opendir(a_sFileName.c_str());
+	if (pDir == nullptr)
+	{
+		UPrintf(USTR("ERROR: open dir %") PRIUS USTR(" failed\n\n"), a_sFileName.c_str());
+		return false;
+	}
+	dirent* pDirent = nullptr;
+	while ((pDirent = readdir(pDir)) != nullptr)
+	{
+		UString sName = pDirent->d_name;
+		if (sName == USTR(".") || sName == USTR(".."))
+		{
+			continue;
+		}
+		Stat st;
+		if (UStat((a_sFileName + USTR("/") + sName).c_str(), &st) != 0)
+		{
+			continue;
+		}
+		if ((st.st_mode & S_IFDIR) != 0)
+		{
+			vSubDirName.push_back(sName);
+		}
+		else
+		{
+			vFileName.push_back(sName);
+		}
+	}
+	closedir(pDir);
+#endif
+	sort(vFileName.begin(), vFileName.end());
+	sort(vSubDirName.begin(), vSubDirName.end());
+	for (n32 i = 0; i < static_cast<n32>(vFileName.size()); i++)
+	{
+		UString sFileName = a_sFileName + USTR("/") + vFileName[i];
+		if (!CCtpk::IsCtpkFile(sFileName))
+		{
+			continue;
+		}
+		UString::size_type uPos = vFileName[i].rfind(USTR('.'));
+		m_vBatch.push_back(make_pair(sFileName, a_sDirName + USTR("/") + vFileName[i].substr(0, uPos != 0 ? uPos : UString::npos)));
+	}
+	for (n32 i = 0; i < static_cast<n32>(vSubDirName.size()); i++)
+	{
+		if (!findBatch(a_sFileName + USTR("/") + vSubDirName[i], a_sDirName + USTR("/") + vSubDirName[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// all the archives share one pool, a second archive is mapped, parsed and queued while the workers drain the
+// textures of the one before it, so small archives no longer leave the pool idle between them,
+// the log of each archive is kept until every archive before it is done so that the output stays in batch order
+bool CCtpkTool::batch()
+{
+	CThreadPool threadPool;
+	threadPool.Start(m_nJobs > 0 ? m_nJobs : CThreadPool::GetAutoThreadCount());
+	n32 nDriverCount = threadPool.GetThreadCount() > 1 && m_vBatch.size() > 1 ? 2 : 1;
+	mutex batchMutex;
+	n32 nNext = 0;
+	n32 nFailed = 0;
+	vector<UString> vLog(m_vBatch.size());
+	vector<u8> vDone(m_vBatch.size());
+	n32 nLogIndex = 0;
+	auto fDrive = [this, &threadPool, &batchMutex, &nNext, &nFailed, &vLog, &vDone, &nLogIndex]()
+	{
+		for (;;)
+		{
+			n32 nIndex = 0;
+			{
+				lock_guard<mutex> lock(batchMutex);
+				if (nNext >= static_cast<n32>(m_vBatch.size()))
+				{
+					return;
+				}
+				nIndex = nNext++;
+			}
+			const UString& sFileName = m_vBatch[nIndex].first;
+			const UString& sDirName = m_vBatch[nIndex].second;
+			UString& sLog = vLog[nIndex];
+			bool bResult = false;
+			if (!CCtpk::IsCtpkFile(sFileName) && !CCtpk::IsCtpkIconFile(sFileName))
+			{
+				sLog += USTR("ERROR: ") + sFileName + USTR(" is not a ctpk file\n\n");
+			}
+			else if (m_eAction == kActionExport)
+			{
+				makeParentDir(sDirName);
+				bResult = exportFile(sFileName, sDirName, &threadPool, sLog);
+			}
+			else
+			{
+				bResult = importFile(sFileName, sDirName, &threadPool, sLog);
+			}
+			if (!bResult)
+			{
+				sLog += USTR("ERROR: ") + UString(m_eAction == kActionExport ? USTR("export") : USTR("import")) + USTR(" ") + sFileName + USTR(" failed\n\n");
+			}
+			lock_guard<mutex> lock(batchMutex);
+			if (!bResult)
+			{
+				nFailed++;
+			}
+			vDone[nIndex] = 1;
+			for (; nLogIndex < static_cast<n32>(vLog.size()) && vDone[nLogIndex] != 0; nLogIndex++)
+			{
+				UPrintf(USTR("%") PRIUS, vLog[nLogIndex].c_str());
+				UString().swap(vLog[nLogIndex]);
+			}
+		}
+	};
+	vector<thread> vDriver;
+	for (n32 i = 1; i < nDriverCount; i++)
+	{
+		vDriver.push_back(thread(fDrive));
+	}
+	fDrive();
+	for (n32 i = 0; i < static_cast<n32>(vDriver.size()); i++)
+	{
+		vDriver[i].join();
+	}
+	if (m_bVerbose || nFailed != 0)
+	{
+		UPrintf(USTR("INFO: %d of %d ctpk files done\n"), static_cast<n32>(m_vBatch.size()) - nFailed, static_cast<n32>(m_vBatch.size()));
+	}
+	return nFailed == 0;
+}
+
+bool CCtpkTool::exportFile(const UString& a_sFileName, const UString& a_sDirName, CThreadPool* a_pThreadPool, UString& a_sLog)
 {
 	CCtpk ctpk;
-	ctpk.SetFileName(m_sFileName);
-	ctpk.SetDirName(m_sDirName);
+	ctpk.SetFileName(a_sFileName);
+	ctpk.SetDirName(a_sDirName);
 	ctpk.SetVerbose(m_bVerbose);
-	return ctpk.ExportFile();
+	ctpk.SetJobs(m_nJobs);
+	ctpk.SetIncremental(m_bIncremental);
+	ctpk.SetPngEffort(m_nPngEffort);
+	ctpk.SetKtx(m_bKtx);
+	ctpk.SetThreadPool(a_pThreadPool);
+	ctpk.SetOnly(m_vOnly);
+	ctpk.SetIndex(m_vIndex);
+	ctpk.SetLog(&a_sLog);
+	bool bResult = ctpk.ExportFile();
+	if (!bResult && !ctpk.GetLastError().empty())
+	{
+		a_sLog += USTR("ERROR: ") + ctpk.GetLastError() + USTR("\n\n");
+	}
+	addStats(ctpk);
+	return bResult;
 }
 
-bool CCtpkTool::importFile()
+bool CCtpkTool::importFile(const UString& a_sFileName, const UString& a_sDirName, CThreadPool* a_pThreadPool, UString& a_sLog)
 {
 	CCtpk ctpk;
-	ctpk.SetFileName(m_sFileName);
-	ctpk.SetDirName(m_sDirName);
+	ctpk.SetFileName(a_sFileName);
+	ctpk.SetDirName(a_sDirName);
 	ctpk.SetVerbose(m_bVerbose);
-	return ctpk.ImportFile();
+	ctpk.SetJobs(m_nJobs);
+	ctpk.SetEtc1Quality(m_nEtc1Quality);
+	ctpk.SetMipmapFilter(m_nMipmapFilter);
+	ctpk.SetKtx(m_bKtx);
+	ctpk.SetThreadPool(a_pThreadPool);
+	ctpk.SetOnly(m_vOnly);
+	ctpk.SetIndex(m_vIndex);
+	ctpk.SetSyncMode(m_nSyncMode);
+	ctpk.SetAtomic(m_bAtomic);
+	ctpk.SetLog(&a_sLog);
+	bool bResult = ctpk.ImportFile();
+	if (!bResult && !ctpk.GetLastError().empty())
+	{
+		a_sLog += USTR("ERROR: ") + ctpk.GetLastError() + USTR("\n\n");
+	}
+	addStats(ctpk);
+	return bResult;
+}
+
+bool CCtpkTool::listFile()
+{
+	CCtpk ctpk;
+	ctpk.SetFileName(m_sFileName);
+	SCtpkHeader ctpkHeader;
+	vector<CCtpk::STextureEntry> vTextureEntry;
+	if (!ctpk.ListFile(ctpkHeader, vTextureEntry))
+	{
+		UPrintf(USTR("ERROR: %") PRIUS USTR("\n\n"), ctpk.GetLastError().c_str());
+		return false;
+	}
+	if (m_bListJson)
+	{
+		string sJson = Format("{\n\t\"file\": \"%s\",\n\t\"version\": %d,\n\t\"count\": %d,\n\t\"texture_offset\": %u,\n\t\"texture_size\": %u,\n\t\"hash_offset\": %u,\n\t\"texture_short_info_offset\": %u,\n\t\"textures\": [", escapeJson(UToU8(m_sFileName)).c_str(), ctpkHeader.Version, ctpkHeader.Count, ctpkHeader.TextureOffset, ctpkHeader.TextureSize, ctpkHeader.HashOffset, ctpkHeader.TextureShortInfoOffset);
+		for (n32 i = 0; i < static_cast<n32>(vTextureEntry.size()); i++)
+		{
+			const CCtpk::STextureEntry& textureEntry = vTextureEntry[i];
+			const SCtrTextureInfo& ctrTextureInfo = textureEntry.Info;
+			sJson += Format("%s\n\t\t{ \"index\": %d, \"name\": \"%s\", \"format\": \"%s\", \"width\": %d, \"height\": %d, \"mip_level\": %d, \"type\": %d, \"cube_dir\": %d, \"file_path_offset\": %u, \"tex_data_offset\": %u, \"tex_data_size\": %u, \"computed_size\": %d, \"bitmap_size_offset\": %u, \"src_file_time\": %u", i == 0 ? "" : ",", i, escapeJson(UToU8(textureEntry.Name)).c_str(), CCtpk::s_pFormatName[ctrTextureInfo.TexFormat], ctrTextureInfo.Width, ctrTextureInfo.Height, ctrTextureInfo.MipLevel, ctrTextureInfo.Type, ctrTextureInfo.CubeDir, ctrTextureInfo.FilePathOffset, ctrTextureInfo.TexDataOffset, ctrTextureInfo.TexDataSize, textureEntry.Size, ctrTextureInfo.BitmapSizeOffset, ctrTextureInfo.SrcFileTime);
+			sJson += Format(", \"short_info\": { \"format\": %d, \"mip_level\": %d, \"compression\": %d, \"compression_method\": %d } }", textureEntry.ShortInfo.TextFormat, textureEntry.ShortInfo.MipLevel, textureEntry.ShortInfo.Compression, textureEntry.ShortInfo.CompressionMethod);
+		}
+		sJson += vTextureEntry.empty() ? "]\n}\n" : "\n\t]\n}\n";
+		UPrintf(USTR("%") PRIUS, U8ToU(sJson).c_str());
+		return true;
+	}
+	UPrintf(USTR("file: %") PRIUS USTR(", version: %d, count: %d, texture offset: 0x%X, texture size: 0x%X, hash offset: 0x%X, short info offset: 0x%X\n"), m_sFileName.c_str(), ctpkHeader.Version, ctpkHeader.Count, ctpkHeader.TextureOffset, ctpkHeader.TextureSize, ctpkHeader.HashOffset, ctpkHeader.TextureShortInfoOffset);
+	UPrintf(USTR("%5") PRIUS USTR(" %-8") PRIUS USTR(" %11") PRIUS USTR(" %3") PRIUS USTR(" %10") PRIUS USTR(" %10") PRIUS USTR(" %10") PRIUS USTR(" %4") PRIUS USTR(" %10") PRIUS USTR("  %") PRIUS USTR("\n"), USTR("index"), USTR("format"), USTR("size"), USTR("mip"), USTR("offset"), USTR("data size"), USTR("computed"), USTR("cube"), USTR("src time"), USTR("name"));
+	for (n32 i = 0; i < static_cast<n32>(vTextureEntry.size()); i++)
+	{
+		const CCtpk::STextureEntry& textureEntry = vTextureEntry[i];
+		const SCtrTextureInfo& ctrTextureInfo = textureEntry.Info;
+		// a TexDataSize that does not hold the mipmap chain exactly is flagged, like the checksize info of export
+		UPrintf(USTR("%5d %-8") PRIUS USTR(" %5dx%-5d %3d 0x%08X 0x%08X%c0x%08X %4d 0x%08X  %") PRIUS USTR("\n"), i, AToU(CCtpk::s_pFormatName[ctrTextureInfo.TexFormat]).c_str(), ctrTextureInfo.Width, ctrTextureInfo.Height, ctrTextureInfo.MipLevel, ctrTextureInfo.TexDataOffset, ctrTextureInfo.TexDataSize, static_cast<n32>(ctrTextureInfo.TexDataSize) == textureEntry.Size ? USTR(' ') : USTR('!'), textureEntry.Size, ctrTextureInfo.CubeDir, ctrTextureInfo.SrcFileTime, textureEntry.Name.c_str());
+	}
+	return true;
+}
+
+void CCtpkTool::addStats(const CCtpk& a_Ctpk)
+{
+	if (m_eStats == kStatsNone)
+	{
+		return;
+	}
+	const vector<CCtpk::STextureStats>& vStats = a_Ctpk.GetStats();
+	lock_guard<mutex> lock(m_StatsMutex);
+	m_vStats.insert(m_vStats.end(), vStats.begin(), vStats.end());
+}
+
+// times are the sum over every worker, so with --jobs the stages add up to more than the wall time
+void CCtpkTool::printStats(double a_fSeconds) const
+{
+	CCtpk::STextureStats formatStats[CCtpk::kTextureFormatETC1_A4 + 1];
+	n32 nFormatCount[CCtpk::kTextureFormatETC1_A4 + 1] = {};
+	CCtpk::STextureStats totalStats;
+	for (n32 i = 0; i < static_cast<n32>(m_vStats.size()); i++)
+	{
+		const CCtpk::STextureStats& stats = m_vStats[i];
+		CCtpk::STextureStats* pStats[2] = { &formatStats[stats.Format], &totalStats };
+		for (n32 j = 0; j < 2; j++)
+		{
+			pStats[j]->PixelCount += stats.PixelCount;
+			pStats[j]->BytesIn += stats.BytesIn;
+			pStats[j]->BytesOut += stats.BytesOut;
+			for (n32 k = 0; k < CCtpk::kStatsStageCount; k++)
+			{
+				pStats[j]->Time[k] += stats.Time[k];
+			}
+		}
+		nFormatCount[stats.Format]++;
+	}
+	double fMPix = totalStats.PixelCount / 1000000.0;
+	double fMPixPerSecond = a_fSeconds > 0 ? fMPix / a_fSeconds : 0;
+	n64 nPeakRss = getPeakRss();
+	if (m_eStats == kStatsJson)
+	{
+		string sJson = "{\n\t\"textures\": [";
+		for (n32 i = 0; i < static_cast<n32>(m_vStats.size()); i++)
+		{
+			const CCtpk::STextureStats& stats = m_vStats[i];
+			sJson += Format("%s\n\t\t{ \"file\": \"%s\", \"format\": \"%s\", \"width\": %d, \"height\": %d, \"mip_level\": %d, \"pixels\": %lld, \"bytes_in\": %lld, \"bytes_out\": %lld", i == 0 ? "" : ",", escapeJson(UToU8(stats.FileName)).c_str(), CCtpk::s_pFormatName[stats.Format], stats.Width, stats.Height, stats.MipLevel, stats.PixelCount, stats.BytesIn, stats.BytesOut);
+			for (n32 j = 0; j < CCtpk::kStatsStageCount; j++)
+			{
+				sJson += Format(", \"%s_us\": %lld", CCtpk::s_pStatsStageName[j], stats.Time[j]);
+			}
+			sJson += " }";
+		}
+		sJson += "\n\t],\n\t\"formats\": [";
+		bool bFirst = true;
+		for (n32 i = 0; i <= CCtpk::kTextureFormatETC1_A4; i++)
+		{
+			const CCtpk::STextureStats& stats = formatStats[i];
+			if (nFormatCount[i] == 0)
+			{
+				continue;
+			}
+			sJson += Format("%s\n\t\t{ \"format\": \"%s\", \"textures\": %d, \"pixels\": %lld, \"bytes_in\": %lld, \"bytes_out\": %lld", bFirst ? "" : ",", CCtpk::s_pFormatName[i], nFormatCount[i], stats.PixelCount, stats.BytesIn, stats.BytesOut);
+			for (n32 j = 0; j < CCtpk::kStatsStageCount; j++)
+			{
+				sJson += Format(", \"%s_us\": %lld", CCtpk::s_pStatsStageName[j], stats.Time[j]);
+			}
+			sJson += " }";
+			bFirst = false;
+		}
+		sJson += Format("\n\t],\n\t\"total\": { \"textures\": %d, \"pixels\": %lld, \"bytes_in\": %lld, \"bytes_out\": %lld, \"seconds\": %.6f, \"mpix_per_second\": %.3f, \"peak_rss\": %lld", static_cast<n32>(m_vStats.size()), totalStats.PixelCount, totalStats.BytesIn, totalStats.BytesOut, a_fSeconds, fMPixPerSecond, nPeakRss);
+		for (n32 i = 0; i < CCtpk::kStatsStageCount; i++)
+		{
+			sJson += Format(", \"%s_us\": %lld", CCtpk::s_pStatsStageName[i], totalStats.Time[i]);
+		}
+		sJson += " }\n}\n";
+		UPrintf(USTR("%") PRIUS, U8ToU(sJson).c_str());
+		return;
+	}
+	UString sStageHeader;
+	for (n32 i = 0; i < CCtpk::kStatsStageCount; i++)
+	{
+		UString sStageName = AToU(CCtpk::s_pStatsStageName[i]);
+		sStageHeader += UString(sStageName.size() < 11 ? 11 - sStageName.size() : 1, USTR(' ')) + sStageName;
+	}
+	UPrintf(USTR("stats: time in ms\n"));
+	UPrintf(USTR("%-8") PRIUS USTR(" %11") PRIUS USTR(" %3") PRIUS USTR("%") PRIUS USTR(" %10") PRIUS USTR(" %10") PRIUS USTR("  %") PRIUS USTR("\n"), USTR("format"), USTR("size"), USTR("mip"), sStageHeader.c_str(), USTR("in"), USTR("out"), USTR("file"));
+	for (n32 i = 0; i < static_cast<n32>(m_vStats.size()); i++)
+	{
+		const CCtpk::STextureStats& stats = m_vStats[i];
+		UPrintf(USTR("%-8") PRIUS USTR(" %5dx%-5d %3d"), AToU(CCtpk::s_pFormatName[stats.Format]).c_str(), stats.Width, stats.Height, stats.MipLevel);
+		for (n32 j = 0; j < CCtpk::kStatsStageCount; j++)
+		{
+			UPrintf(USTR(" %10.3f"), stats.Time[j] / 1000.0);
+		}
+		UPrintf(USTR(" %10lld %10lld  %") PRIUS USTR("\n"), stats.BytesIn, stats.BytesOut, stats.FileName.c_str());
+	}
+	UPrintf(USTR("\n%-8") PRIUS USTR(" %8") PRIUS USTR(" %8") PRIUS USTR("%") PRIUS USTR(" %10") PRIUS USTR(" %10") PRIUS USTR("\n"), USTR("format"), USTR("textures"), USTR("MPix"), sStageHeader.c_str(), USTR("in"), USTR("out"));
+	for (n32 i = 0; i <= CCtpk::kTextureFormatETC1_A4; i++)
+	{
+		const CCtpk::STextureStats& stats = formatStats[i];
+		if (nFormatCount[i] == 0)
+		{
+			continue;
+		}
+		UPrintf(USTR("%-8") PRIUS USTR(" %8d %8.3f"), AToU(CCtpk::s_pFormatName[i]).c_str(), nFormatCount[i], stats.PixelCount / 1000000.0);
+		for (n32 j = 0; j < CCtpk::kStatsStageCount; j++)
+		{
+			UPrintf(USTR(" %10.3f"), stats.Time[j] / 1000.0);
+		}
+		UPrintf(USTR(" %10lld %10lld\n"), stats.BytesIn, stats.BytesOut);
+	}
+	UPrintf(USTR("\ntotal: %d textures, %.3f MPix in %.3f s, %.3f MPix/s, %lld bytes in, %lld bytes out, peak rss %.1f MB\n"), static_cast<n32>(m_vStats.size()), fMPix, a_fSeconds, fMPixPerSecond, totalStats.BytesIn, totalStats.BytesOut, nPeakRss / 1048576.0);
+}
+
+void CCtpkTool::makeParentDir(const UString& a_sDirName)
+{
+	for (UString::size_type uPos = a_sDirName.find_first_of(USTR("/\\"), 1); uPos != UString::npos; uPos = a_sDirName.find_first_of(USTR("/\\"), uPos + 1))
+	{
+		UMkdir(a_sDirName.substr(0, uPos).c_str());
+	}
+}
+
+n64 CCtpkTool::getPeakRss()
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	PROCESS_MEMORY_COUNTERS processMemoryCounters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &processMemoryCounters, sizeof(processMemoryCounters)))
+	{
+		return 0;
+	}
+	return processMemoryCounters.PeakWorkingSetSize;
+#else
+	struct rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#if SDW_PLATFORM == SDW_PLATFORM_MACOS
+	return usage.ru_maxrss;
+#else
+	return static_cast<n64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+string CCtpkTool::escapeJson(const string& a_sString)
+{
+	string sEscape;
+	for (string::const_iterator it = a_sString.begin(); it != a_sString.end(); ++it)
+	{
+		u8 uChar = static_cast<u8>(*it);
+		if (uChar == '"' || uChar == '\\')
+		{
+			sEscape += '\\';
+			sEscape += *it;
+		}
+		else if (uChar < 0x20)
+		{
+			sEscape += Format("\\u%04X", uChar);
+		}
+		else
+		{
+			sEscape += *it;
+		}
+	}
+	return sEscape;
 }
 
 int UMain(int argc, UChar* argv[])
@@ -2,6 +2,10 @@
 #define CTPKTOOL_H_
 
 #include <sdw.h>
+#include "ctpk.h"
+#include <mutex>
+
+class CThreadPool;
 
 class CCtpkTool
 {
@@ -11,6 +15,7 @@ public:
 		kParseOptionReturnSuccess,
 		kParseOptionReturnIllegalOption,
 		kParseOptionReturnNoArgument,
+		kParseOptionReturnUnknownArgument,
 		kParseOptionReturnOptionConflict
 	};
 	enum EAction
@@ -18,8 +23,15 @@ public:
 		kActionNone,
 		kActionExport,
 		kActionImport,
+		kActionList,
 		kActionHelp
 	};
+	enum EStats
+	{
+		kStatsNone,
+		kStatsText,
+		kStatsJson
+	};
 	struct SOption
 	{
 		const UChar* Name;
@@ -36,12 +48,38 @@ public:
 private:
 	EParseOptionReturn parseOptions(const UChar* a_pName, int& a_nIndex, int a_nArgc, UChar* a_pArgv[]);
 	EParseOptionReturn parseOptions(int a_nKey, int& a_nIndex, int a_nArgc, UChar* a_pArgv[]);
-	bool exportFile();
-	bool importFile();
+	bool loadBatch();
+	bool findBatch(const UString& a_sFileName, const UString& a_sDirName);
+	bool batch();
+	bool exportFile(const UString& a_sFileName, const UString& a_sDirName, CThreadPool* a_pThreadPool, UString& a_sLog);
+	bool importFile(const UString& a_sFileName, const UString& a_sDirName, CThreadPool* a_pThreadPool, UString& a_sLog);
+	bool listFile();
+	void addStats(const CCtpk& a_Ctpk);
+	void printStats(double a_fSeconds) const;
+	static void makeParentDir(const UString& a_sDirName);
+	static n64 getPeakRss();
+	static string escapeJson(const string& a_sString);
 	EAction m_eAction;
 	UString m_sFileName;
 	UString m_sDirName;
+	UString m_sBatchName;
 	bool m_bVerbose;
+	n32 m_nJobs;
+	n32 m_nEtc1Quality;
+	bool m_bIncremental;
+	n32 m_nPngEffort;
+	bool m_bKtx;
+	n32 m_nMipmapFilter;
+	n32 m_nSyncMode;
+	bool m_bAtomic;
+	EStats m_eStats;
+	bool m_bListJson;
+	UString m_sMessage;
+	vector<pair<UString, UString>> m_vBatch;
+	vector<UString> m_vOnly;
+	vector<n32> m_vIndex;
+	vector<CCtpk::STextureStats> m_vStats;
+	mutex m_StatsMutex;
 };
 
 #endif	// CTPKTOOL_H_
@@ -0,0 +1,472 @@
+#include "etc1.h"
+#include "swizzle.h"
+#include "threadpool.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ETC1_X86
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#define ETC1_TARGET(x)
+#else
+#define ETC1_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+// indexed by the table codeword and then by the 2 bit pixel index, msb selects the negative side
+const n32 CEtc1::s_nModifierTable[8][4] =
+{
+	{ 2, 8, -2, -8 },
+	{ 5, 17, -5, -17 },
+	{ 9, 29, -9, -29 },
+	{ 13, 42, -13, -42 },
+	{ 18, 60, -18, -60 },
+	{ 24, 80, -24, -80 },
+	{ 33, 106, -33, -106 },
+	{ 47, 183, -47, -183 }
+};
+
+static inline u8 clamp255(n32 a_nValue)
+{
+	return static_cast<u8>(a_nValue < 0 ? 0 : (a_nValue > 255 ? 255 : a_nValue));
+}
+
+static inline n32 clamp(n32 a_nValue, n32 a_nMin, n32 a_nMax)
+{
+	return a_nValue < a_nMin ? a_nMin : (a_nValue > a_nMax ? a_nMax : a_nValue);
+}
+
+// the error of a half block for each of the 8 tables, every pixel taking its closest of the 4 modified colors
+static void getTableError(const n16* a_pR, const n16* a_pG, const n16* a_pB, const n32* a_pColor, n32* a_pError)
+{
+	for (n32 t = 0; t < 8; t++)
+	{
+		n32 nError = 0;
+		for (n32 i = 0; i < 8; i++)
+		{
+			n32 nMinError = 0x7FFFFFFF;
+			for (n32 k = 0; k < 4; k++)
+			{
+				n32 nModifier = CEtc1::s_nModifierTable[t][k];
+				n32 nR = a_pR[i] - clamp255(a_pColor[0] + nModifier);
+				n32 nG = a_pG[i] - clamp255(a_pColor[1] + nModifier);
+				n32 nB = a_pB[i] - clamp255(a_pColor[2] + nModifier);
+				n32 nPixelError = nR * nR + nG * nG + nB * nB;
+				if (nPixelError < nMinError)
+				{
+					nMinError = nPixelError;
+				}
+			}
+			nError += nMinError;
+		}
+		a_pError[t] = nError;
+	}
+}
+
+#if defined(ETC1_X86)
+ETC1_TARGET("sse2")
+static inline __m128i min32SSE2(__m128i a_Left, __m128i a_Right)
+{
+	__m128i mask = _mm_cmpgt_epi32(a_Left, a_Right);
+	return _mm_or_si128(_mm_and_si128(mask, a_Right), _mm_andnot_si128(mask, a_Left));
+}
+
+// the 8 pixels sit in 16 bit lanes, madd squares and sums r/g and b/0 pairs into one 32 bit error per pixel
+ETC1_TARGET("sse2")
+static void getTableErrorSSE2(const n16* a_pR, const n16* a_pG, const n16* a_pB, const n32* a_pColor, n32* a_pError)
+{
+	__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pR));
+	__m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pG));
+	__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pB));
+	__m128i zero = _mm_setzero_si128();
+	for (n32 t = 0; t < 8; t++)
+	{
+		__m128i minLo = _mm_set1_epi32(0x7FFFFFFF);
+		__m128i minHi = minLo;
+		for (n32 k = 0; k < 4; k++)
+		{
+			n32 nModifier = CEtc1::s_nModifierTable[t][k];
+			__m128i deltaR = _mm_sub_epi16(r, _mm_set1_epi16(clamp255(a_pColor[0] + nModifier)));
+			__m128i deltaG = _mm_sub_epi16(g, _mm_set1_epi16(clamp255(a_pColor[1] + nModifier)));
+			__m128i deltaB = _mm_sub_epi16(b, _mm_set1_epi16(clamp255(a_pColor[2] + nModifier)));
+			__m128i rgLo = _mm_unpacklo_epi16(deltaR, deltaG);
+			__m128i rgHi = _mm_unpackhi_epi16(deltaR, deltaG);
+			__m128i bLo = _mm_unpacklo_epi16(deltaB, zero);
+			__m128i bHi = _mm_unpackhi_epi16(deltaB, zero);
+			minLo = min32SSE2(minLo, _mm_add_epi32(_mm_madd_epi16(rgLo, rgLo), _mm_madd_epi16(bLo, bLo)));
+			minHi = min32SSE2(minHi, _mm_add_epi32(_mm_madd_epi16(rgHi, rgHi), _mm_madd_epi16(bHi, bHi)));
+		}
+		__m128i sum = _mm_add_epi32(minLo, minHi);
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		a_pError[t] = _mm_cvtsi128_si32(sum);
+	}
+}
+#endif
+
+void CEtc1::DecodeBlock(u64 a_uBlock, u8* a_pDest, n32 a_nStride)
+{
+	n32 nBase[2][3];
+	if ((a_uBlock >> 33 & 1) == 0)
+	{
+		for (n32 i = 0; i < 3; i++)
+		{
+			nBase[0][i] = (a_uBlock >> (60 - i * 8) & 0x0F) * 0x11;
+			nBase[1][i] = (a_uBlock >> (56 - i * 8) & 0x0F) * 0x11;
+		}
+	}
+	else
+	{
+		for (n32 i = 0; i < 3; i++)
+		{
+			n32 nColor = a_uBlock >> (59 - i * 8) & 0x1F;
+			n32 nDelta = static_cast<n32>(a_uBlock >> (56 - i * 8) & 0x07);
+			n32 nColor2 = (nColor + (nDelta >= 4 ? nDelta - 8 : nDelta)) & 0x1F;
+			nBase[0][i] = nColor << 3 | nColor >> 2;
+			nBase[1][i] = nColor2 << 3 | nColor2 >> 2;
+		}
+	}
+	const n32* pModifier[2] = { s_nModifierTable[a_uBlock >> 37 & 7], s_nModifierTable[a_uBlock >> 34 & 7] };
+	bool bFlip = (a_uBlock >> 32 & 1) != 0;
+	for (n32 nX = 0; nX < 4; nX++)
+	{
+		for (n32 nY = 0; nY < 4; nY++)
+		{
+			// pixels are numbered column by column
+			n32 nPixel = nX * 4 + nY;
+			n32 nSubBlock = bFlip ? nY / 2 : nX / 2;
+			n32 nIndex = static_cast<n32>((a_uBlock >> (nPixel + 16) & 1) << 1 | (a_uBlock >> nPixel & 1));
+			n32 nModifier = pModifier[nSubBlock][nIndex];
+			u8* pPixel = a_pDest + nY * a_nStride + nX * 4;
+			pPixel[0] = clamp255(nBase[nSubBlock][0] + nModifier);
+			pPixel[1] = clamp255(nBase[nSubBlock][1] + nModifier);
+			pPixel[2] = clamp255(nBase[nSubBlock][2] + nModifier);
+		}
+	}
+}
+
+void CEtc1::Decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha)
+{
+	// ctpk keeps 2x2 blocks per 8x8 tile, each block a little endian u64, optionally preceded by 8 bytes of 4 bit alpha
+	n32 nBlockSize = a_bAlpha ? 16 : 8;
+	n32 nStride = a_nWidth * 4;
+	const u8* pBlock = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				u8* pDest = a_pRGBA + (nTileY * 8 + i / 2 * 4) * nStride + (nTileX * 8 + i % 2 * 4) * 4;
+				const u8* pColor = pBlock + nBlockSize - 8;
+				u64 uBlock = 0;
+				for (n32 j = 7; j >= 0; j--)
+				{
+					uBlock = uBlock << 8 | pColor[j];
+				}
+				DecodeBlock(uBlock, pDest, nStride);
+				for (n32 nY = 0; nY < 4; nY++)
+				{
+					u8* pPixel = pDest + nY * nStride + 3;
+					for (n32 nX = 0; nX < 4; nX++)
+					{
+						pPixel[nX * 4] = a_bAlpha ? (pBlock[nX * 2 + nY / 2] >> (nY % 2 * 4) & 0x0F) * 0x11 : 0xFF;
+					}
+				}
+				pBlock += nBlockSize;
+			}
+		}
+	}
+}
+
+u64 CEtc1::EncodeBlock(const u8* a_pSrc, n32 a_nStride, EQuality a_eQuality)
+{
+	SCandidate candidate[2][32];
+	SCandidate best[2];
+	bool bBestDiff = false;
+	bool bBestFlip = false;
+	n32 nBestError = 0x7FFFFFFF;
+	for (n32 nFlip = 0; nFlip < 2 && nBestError != 0; nFlip++)
+	{
+		SSubBlock subBlock[2];
+		getSubBlock(a_pSrc, a_nStride, nFlip != 0, subBlock);
+		// individual mode, both halves are free to pick their own 4 bit color
+		SCandidate individual[2];
+		for (n32 s = 0; s < 2; s++)
+		{
+			n32 nCount = getCandidate(subBlock[s], 4, a_eQuality, candidate[s]);
+			individual[s] = candidate[s][0];
+			for (n32 i = 1; i < nCount; i++)
+			{
+				if (candidate[s][i].Error < individual[s].Error)
+				{
+					individual[s] = candidate[s][i];
+				}
+			}
+		}
+		if (individual[0].Error + individual[1].Error < nBestError)
+		{
+			nBestError = individual[0].Error + individual[1].Error;
+			best[0] = individual[0];
+			best[1] = individual[1];
+			bBestDiff = false;
+			bBestFlip = nFlip != 0;
+		}
+		// differential mode, the second 5 bit color has to stay within -4..3 of the first
+		n32 nCount[2];
+		for (n32 s = 0; s < 2; s++)
+		{
+			nCount[s] = getCandidate(subBlock[s], 5, a_eQuality, candidate[s]);
+		}
+		for (n32 i = 0; i < nCount[0]; i++)
+		{
+			const SCandidate& first = candidate[0][i];
+			if (first.Error >= nBestError)
+			{
+				continue;
+			}
+			for (n32 j = 0; j < nCount[1]; j++)
+			{
+				const SCandidate& second = candidate[1][j];
+				bool bInRange = true;
+				for (n32 c = 0; c < 3; c++)
+				{
+					n32 nDelta = second.Color[c] - first.Color[c];
+					bInRange = bInRange && nDelta >= -4 && nDelta <= 3;
+				}
+				if (bInRange && first.Error + second.Error < nBestError)
+				{
+					nBestError = first.Error + second.Error;
+					best[0] = first;
+					best[1] = second;
+					bBestDiff = true;
+					bBestFlip = nFlip != 0;
+				}
+			}
+			// the closest color the second half can still reach from this first color
+			SCandidate second = candidate[1][0];
+			for (n32 c = 0; c < 3; c++)
+			{
+				second.Color[c] = clamp(second.Color[c], first.Color[c] - 4, first.Color[c] + 3);
+			}
+			evaluateCandidate(subBlock[1], 5, second);
+			if (first.Error + second.Error < nBestError)
+			{
+				nBestError = first.Error + second.Error;
+				best[0] = first;
+				best[1] = second;
+				bBestDiff = true;
+				bBestFlip = nFlip != 0;
+			}
+		}
+	}
+	u64 uBlock = 0;
+	for (n32 c = 0; c < 3; c++)
+	{
+		if (bBestDiff)
+		{
+			uBlock |= static_cast<u64>(best[0].Color[c]) << (59 - c * 8) | static_cast<u64>((best[1].Color[c] - best[0].Color[c]) & 7) << (56 - c * 8);
+		}
+		else
+		{
+			uBlock |= static_cast<u64>(best[0].Color[c]) << (60 - c * 8) | static_cast<u64>(best[1].Color[c]) << (56 - c * 8);
+		}
+	}
+	uBlock |= static_cast<u64>(best[0].Table) << 37 | static_cast<u64>(best[1].Table) << 34;
+	uBlock |= static_cast<u64>(bBestDiff ? 1 : 0) << 33 | static_cast<u64>(bBestFlip ? 1 : 0) << 32;
+	n32 nBits = bBestDiff ? 5 : 4;
+	for (n32 nX = 0; nX < 4; nX++)
+	{
+		for (n32 nY = 0; nY < 4; nY++)
+		{
+			const SCandidate& subBlockBest = best[bBestFlip ? nY / 2 : nX / 2];
+			const u8* pPixel = a_pSrc + nY * a_nStride + nX * 4;
+			n32 nIndex = 0;
+			n32 nMinError = 0x7FFFFFFF;
+			for (n32 k = 0; k < 4; k++)
+			{
+				n32 nModifier = s_nModifierTable[subBlockBest.Table][k];
+				n32 nError = 0;
+				for (n32 c = 0; c < 3; c++)
+				{
+					n32 nDelta = pPixel[c] - clamp255(expand(subBlockBest.Color[c], nBits) + nModifier);
+					nError += nDelta * nDelta;
+				}
+				if (nError < nMinError)
+				{
+					nMinError = nError;
+					nIndex = k;
+				}
+			}
+			n32 nPixel = nX * 4 + nY;
+			uBlock |= static_cast<u64>(nIndex >> 1) << (nPixel + 16) | static_cast<u64>(nIndex & 1) << nPixel;
+		}
+	}
+	return uBlock;
+}
+
+void CEtc1::Encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha, EQuality a_eQuality, CThreadPool& a_ThreadPool)
+{
+	n32 nBlockSize = a_bAlpha ? 16 : 8;
+	n32 nStride = a_nWidth * 4;
+	CTaskGroup taskGroup(a_ThreadPool);
+	// every row of tiles owns its own slice of the destination, so the rows are encoded independently
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		taskGroup.Push([=]()
+		{
+			u8* pBlock = a_pDest + nTileY * (a_nWidth / 8) * 4 * nBlockSize;
+			for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+			{
+				for (n32 i = 0; i < 4; i++)
+				{
+					const u8* pSrc = a_pRGBA + (nTileY * 8 + i / 2 * 4) * nStride + (nTileX * 8 + i % 2 * 4) * 4;
+					if (a_bAlpha)
+					{
+						encodeAlphaBlock(pSrc, nStride, pBlock);
+					}
+					u64 uBlock = EncodeBlock(pSrc, nStride, a_eQuality);
+					u8* pColor = pBlock + nBlockSize - 8;
+					for (n32 j = 0; j < 8; j++)
+					{
+						pColor[j] = static_cast<u8>(uBlock >> (j * 8));
+					}
+					pBlock += nBlockSize;
+				}
+			}
+		});
+	}
+	taskGroup.Wait();
+}
+
+void CEtc1::EncodeAlpha(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	n32 nStride = a_nWidth * 4;
+	u8* pBlock = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				encodeAlphaBlock(a_pRGBA + (nTileY * 8 + i / 2 * 4) * nStride + (nTileX * 8 + i % 2 * 4) * 4, nStride, pBlock);
+				pBlock += 16;
+			}
+		}
+	}
+}
+
+void CEtc1::encodeAlphaBlock(const u8* a_pSrc, n32 a_nStride, u8* a_pBlock)
+{
+	for (n32 nX = 0; nX < 4; nX++)
+	{
+		a_pBlock[nX * 2] = ((a_pSrc[nX * 4 + 3] / 0x11) & 0x0F) | ((a_pSrc[a_nStride + nX * 4 + 3] / 0x11) << 4 & 0xF0);
+		a_pBlock[nX * 2 + 1] = ((a_pSrc[a_nStride * 2 + nX * 4 + 3] / 0x11) & 0x0F) | ((a_pSrc[a_nStride * 3 + nX * 4 + 3] / 0x11) << 4 & 0xF0);
+	}
+}
+
+void CEtc1::getSubBlock(const u8* a_pSrc, n32 a_nStride, bool a_bFlip, SSubBlock* a_pSubBlock)
+{
+	n32 nSum[2][3] = {};
+	n32 nCount[2] = {};
+	for (n32 nY = 0; nY < 4; nY++)
+	{
+		for (n32 nX = 0; nX < 4; nX++)
+		{
+			n32 s = a_bFlip ? nY / 2 : nX / 2;
+			const u8* pPixel = a_pSrc + nY * a_nStride + nX * 4;
+			SSubBlock& subBlock = a_pSubBlock[s];
+			subBlock.R[nCount[s]] = pPixel[0];
+			subBlock.G[nCount[s]] = pPixel[1];
+			subBlock.B[nCount[s]] = pPixel[2];
+			nCount[s]++;
+			for (n32 c = 0; c < 3; c++)
+			{
+				nSum[s][c] += pPixel[c];
+			}
+		}
+	}
+	for (n32 s = 0; s < 2; s++)
+	{
+		for (n32 c = 0; c < 3; c++)
+		{
+			a_pSubBlock[s].Average[c] = (nSum[s][c] + 4) / 8;
+		}
+	}
+}
+
+// fast only tries the quantized average, medium also walks it along the gray axis, slow adds every +-1 step per channel
+n32 CEtc1::getCandidate(const SSubBlock& a_SubBlock, n32 a_nBits, EQuality a_eQuality, SCandidate* a_pCandidate)
+{
+	n32 nMax = (1 << a_nBits) - 1;
+	n32 nBase[3];
+	for (n32 c = 0; c < 3; c++)
+	{
+		nBase[c] = (a_SubBlock.Average[c] * nMax + 127) / 255;
+	}
+	n32 nCube = a_eQuality == kQualitySlow ? 1 : 0;
+	n32 nLuminance = a_eQuality == kQualityFast ? 0 : (a_eQuality == kQualityMedium ? 2 : 3);
+	n32 nCount = 0;
+	for (n32 nR = -nCube; nR <= nCube; nR++)
+	{
+		for (n32 nG = -nCube; nG <= nCube; nG++)
+		{
+			for (n32 nB = -nCube; nB <= nCube; nB++)
+			{
+				SCandidate& candidate = a_pCandidate[nCount++];
+				candidate.Color[0] = clamp(nBase[0] + nR, 0, nMax);
+				candidate.Color[1] = clamp(nBase[1] + nG, 0, nMax);
+				candidate.Color[2] = clamp(nBase[2] + nB, 0, nMax);
+			}
+		}
+	}
+	for (n32 nDelta = -nLuminance; nDelta <= nLuminance; nDelta++)
+	{
+		if (nDelta >= -nCube && nDelta <= nCube)
+		{
+			continue;
+		}
+		SCandidate& candidate = a_pCandidate[nCount++];
+		for (n32 c = 0; c < 3; c++)
+		{
+			candidate.Color[c] = clamp(nBase[c] + nDelta, 0, nMax);
+		}
+	}
+	for (n32 i = 0; i < nCount; i++)
+	{
+		evaluateCandidate(a_SubBlock, a_nBits, a_pCandidate[i]);
+	}
+	return nCount;
+}
+
+void CEtc1::evaluateCandidate(const SSubBlock& a_SubBlock, n32 a_nBits, SCandidate& a_Candidate)
+{
+	n32 nColor[3];
+	for (n32 c = 0; c < 3; c++)
+	{
+		nColor[c] = expand(a_Candidate.Color[c], a_nBits);
+	}
+	n32 nError[8];
+#if defined(ETC1_X86)
+	if (CSwizzle::GetSimdLevel() >= CSwizzle::kSimdLevelSSE2)
+	{
+		getTableErrorSSE2(a_SubBlock.R, a_SubBlock.G, a_SubBlock.B, nColor, nError);
+	}
+	else
+#endif
+	{
+		getTableError(a_SubBlock.R, a_SubBlock.G, a_SubBlock.B, nColor, nError);
+	}
+	a_Candidate.Table = 0;
+	for (n32 t = 1; t < 8; t++)
+	{
+		if (nError[t] < nError[a_Candidate.Table])
+		{
+			a_Candidate.Table = t;
+		}
+	}
+	a_Candidate.Error = nError[a_Candidate.Table];
+}
+
+n32 CEtc1::expand(n32 a_nValue, n32 a_nBits)
+{
+	return a_nBits == 4 ? a_nValue * 0x11 : (a_nValue << 3 | a_nValue >> 2);
+}
@@ -0,0 +1,44 @@
+#ifndef ETC1_H_
+#define ETC1_H_
+
+#include <sdw.h>
+
+class CThreadPool;
+
+class CEtc1
+{
+public:
+	enum EQuality
+	{
+		kQualityFast,
+		kQualityMedium,
+		kQualitySlow
+	};
+	static void DecodeBlock(u64 a_uBlock, u8* a_pDest, n32 a_nStride);
+	static void Decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha);
+	static u64 EncodeBlock(const u8* a_pSrc, n32 a_nStride, EQuality a_eQuality);
+	static void Encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha, EQuality a_eQuality, CThreadPool& a_ThreadPool);
+	static void EncodeAlpha(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static const n32 s_nModifierTable[8][4];
+private:
+	struct SSubBlock
+	{
+		n16 R[8];
+		n16 G[8];
+		n16 B[8];
+		n32 Average[3];
+	};
+	struct SCandidate
+	{
+		n32 Color[3];
+		n32 Table;
+		n32 Error;
+	};
+	static void encodeAlphaBlock(const u8* a_pSrc, n32 a_nStride, u8* a_pBlock);
+	static void getSubBlock(const u8* a_pSrc, n32 a_nStride, bool a_bFlip, SSubBlock* a_pSubBlock);
+	static n32 getCandidate(const SSubBlock& a_SubBlock, n32 a_nBits, EQuality a_eQuality, SCandidate* a_pCandidate);
+	static void evaluateCandidate(const SSubBlock& a_SubBlock, n32 a_nBits, SCandidate& a_Candidate);
+	static n32 expand(n32 a_nValue, n32 a_nBits);
+};
+
+#endif	// ETC1_H_
@@ -0,0 +1,132 @@
+#include "hash.h"
+
+// xxhash64, whole buffers go through Hash64 and streams like the rows of a png through Update
+const u64 CHash::s_uPrime[5] =
+{
+	0x9E3779B185EBCA87ULL,
+	0xC2B2AE3D27D4EB4FULL,
+	0x165667B19E3779F9ULL,
+	0x85EBCA77C2B2AE63ULL,
+	0x27D4EB2F165667C5ULL
+};
+
+static inline u64 rotl64(u64 a_uValue, n32 a_nShift)
+{
+	return a_uValue << a_nShift | a_uValue >> (64 - a_nShift);
+}
+
+CHash::CHash(u64 a_uSeed /* = 0 */)
+	: m_uSeed(a_uSeed)
+	, m_nBufferSize(0)
+	, m_nTotalSize(0)
+{
+	m_uAcc[0] = a_uSeed + s_uPrime[0] + s_uPrime[1];
+	m_uAcc[1] = a_uSeed + s_uPrime[1];
+	m_uAcc[2] = a_uSeed;
+	m_uAcc[3] = a_uSeed - s_uPrime[0];
+	memset(m_uBuffer, 0, sizeof(m_uBuffer));
+}
+
+void CHash::Update(const void* a_pData, n64 a_nSize)
+{
+	const u8* pData = static_cast<const u8*>(a_pData);
+	const u8* pEnd = pData + a_nSize;
+	m_nTotalSize += a_nSize;
+	if (m_nBufferSize + a_nSize < 32)
+	{
+		memcpy(m_uBuffer + m_nBufferSize, pData, static_cast<size_t>(a_nSize));
+		m_nBufferSize += static_cast<n32>(a_nSize);
+		return;
+	}
+	if (m_nBufferSize != 0)
+	{
+		memcpy(m_uBuffer + m_nBufferSize, pData, 32 - m_nBufferSize);
+		pData += 32 - m_nBufferSize;
+		for (n32 i = 0; i < 4; i++)
+		{
+			m_uAcc[i] = round(m_uAcc[i], read64(m_uBuffer + i * 8));
+		}
+		m_nBufferSize = 0;
+	}
+	for (; pData + 32 <= pEnd; pData += 32)
+	{
+		for (n32 i = 0; i < 4; i++)
+		{
+			m_uAcc[i] = round(m_uAcc[i], read64(pData + i * 8));
+		}
+	}
+	m_nBufferSize = static_cast<n32>(pEnd - pData);
+	memcpy(m_uBuffer, pData, m_nBufferSize);
+}
+
+u64 CHash::Digest() const
+{
+	const u8* pData = m_uBuffer;
+	const u8* pEnd = pData + m_nBufferSize;
+	u64 uHash = 0;
+	if (m_nTotalSize >= 32)
+	{
+		uHash = rotl64(m_uAcc[0], 1) + rotl64(m_uAcc[1], 7) + rotl64(m_uAcc[2], 12) + rotl64(m_uAcc[3], 18);
+		for (n32 i = 0; i < 4; i++)
+		{
+			uHash = mergeRound(uHash, m_uAcc[i]);
+		}
+	}
+	else
+	{
+		uHash = m_uSeed + s_uPrime[4];
+	}
+	uHash += static_cast<u64>(m_nTotalSize);
+	for (; pData + 8 <= pEnd; pData += 8)
+	{
+		uHash ^= round(0, read64(pData));
+		uHash = rotl64(uHash, 27) * s_uPrime[0] + s_uPrime[3];
+	}
+	if (pData + 4 <= pEnd)
+	{
+		uHash ^= read32(pData) * s_uPrime[0];
+		uHash = rotl64(uHash, 23) * s_uPrime[1] + s_uPrime[2];
+		pData += 4;
+	}
+	for (; pData < pEnd; pData++)
+	{
+		uHash ^= *pData * s_uPrime[4];
+		uHash = rotl64(uHash, 11) * s_uPrime[0];
+	}
+	uHash ^= uHash >> 33;
+	uHash *= s_uPrime[1];
+	uHash ^= uHash >> 29;
+	uHash *= s_uPrime[2];
+	uHash ^= uHash >> 32;
+	return uHash;
+}
+
+u64 CHash::Hash64(const void* a_pData, n64 a_nSize, u64 a_uSeed /* = 0 */)
+{
+	CHash hash(a_uSeed);
+	hash.Update(a_pData, a_nSize);
+	return hash.Digest();
+}
+
+u64 CHash::round(u64 a_uAcc, u64 a_uInput)
+{
+	a_uAcc += a_uInput * s_uPrime[1];
+	a_uAcc = rotl64(a_uAcc, 31);
+	return a_uAcc * s_uPrime[0];
+}
+
+u64 CHash::mergeRound(u64 a_uAcc, u64 a_uValue)
+{
+	a_uAcc ^= round(0, a_uValue);
+	return a_uAcc * s_uPrime[0] + s_uPrime[3];
+}
+
+u64 CHash::read64(const u8* a_pData)
+{
+	return static_cast<u64>(read32(a_pData)) | static_cast<u64>(read32(a_pData + 4)) << 32;
+}
+
+u32 CHash::read32(const u8* a_pData)
+{
+	return a_pData[0] | a_pData[1] << 8 | a_pData[2] << 16 | static_cast<u32>(a_pData[3]) << 24;
+}
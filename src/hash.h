@@ -0,0 +1,26 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <sdw.h>
+
+class CHash
+{
+public:
+	CHash(u64 a_uSeed = 0);
+	void Update(const void* a_pData, n64 a_nSize);
+	u64 Digest() const;
+	static u64 Hash64(const void* a_pData, n64 a_nSize, u64 a_uSeed = 0);
+private:
+	static u64 round(u64 a_uAcc, u64 a_uInput);
+	static u64 mergeRound(u64 a_uAcc, u64 a_uValue);
+	static u64 read64(const u8* a_pData);
+	static u32 read32(const u8* a_pData);
+	static const u64 s_uPrime[5];
+	u64 m_uSeed;
+	u64 m_uAcc[4];
+	u8 m_uBuffer[32];
+	n32 m_nBufferSize;
+	n64 m_nTotalSize;
+};
+
+#endif	// HASH_H_
@@ -0,0 +1,147 @@
+#include "ktx.h"
+#include "mappedfile.h"
+
+const u8 CKtx::s_uIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const u32 CKtx::s_uEndianness = 0x04030201;
+// the rows are stored top down like the png export
+const char CKtx::s_szOrientationKeyValue[] = "KTXorientation\0S=r,T=d";
+
+bool CKtx::Write(const UString& a_sFileName, const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, const u8* a_pData)
+{
+	FILE* fp = UFopen(a_sFileName.c_str(), USTR("wb"));
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	static const u8 c_uPadding[4] = {};
+	u32 uKeyValueSize = sizeof(s_szOrientationKeyValue);
+	u32 uKeyValuePadding = (4 - uKeyValueSize % 4) % 4;
+	SKtxHeader ktxHeader;
+	memcpy(ktxHeader.Identifier, s_uIdentifier, sizeof(s_uIdentifier));
+	ktxHeader.Endianness = s_uEndianness;
+	ktxHeader.GlType = a_Format.GlType;
+	ktxHeader.GlTypeSize = a_Format.GlTypeSize;
+	ktxHeader.GlFormat = a_Format.GlFormat;
+	ktxHeader.GlInternalFormat = a_Format.GlInternalFormat;
+	ktxHeader.GlBaseInternalFormat = a_Format.GlBaseInternalFormat;
+	ktxHeader.PixelWidth = a_nWidth;
+	ktxHeader.PixelHeight = a_nHeight;
+	ktxHeader.PixelDepth = 0;
+	ktxHeader.NumberOfArrayElements = 0;
+	ktxHeader.NumberOfFaces = 1;
+	ktxHeader.NumberOfMipmapLevels = a_nMipLevel;
+	ktxHeader.BytesOfKeyValueData = static_cast<u32>(sizeof(uKeyValueSize)) + uKeyValueSize + uKeyValuePadding;
+	bool bResult = fwrite(&ktxHeader, sizeof(ktxHeader), 1, fp) == 1;
+	bResult = bResult && fwrite(&uKeyValueSize, sizeof(uKeyValueSize), 1, fp) == 1;
+	bResult = bResult && fwrite(s_szOrientationKeyValue, 1, uKeyValueSize, fp) == uKeyValueSize;
+	bResult = bResult && fwrite(c_uPadding, 1, uKeyValuePadding, fp) == uKeyValuePadding;
+	for (n32 l = 0; bResult && l < a_nMipLevel; l++)
+	{
+		n32 nWidth = a_nWidth >> l;
+		n32 nHeight = a_nHeight >> l;
+		u32 uImageSize = static_cast<u32>(getImageSize(a_Format, nWidth, nHeight));
+		u32 uMipPadding = (4 - uImageSize % 4) % 4;
+		bResult = fwrite(&uImageSize, sizeof(uImageSize), 1, fp) == 1;
+		if (a_Format.GlType == 0)
+		{
+			bResult = bResult && fwrite(a_pData, 1, uImageSize, fp) == uImageSize;
+		}
+		else
+		{
+			// every row of an uncompressed level is padded to GL_UNPACK_ALIGNMENT
+			n32 nRowSize = nWidth * a_Format.BPP / 8;
+			n32 nRowPadding = getRowSize(a_Format, nWidth) - nRowSize;
+			for (n32 nY = 0; bResult && nY < nHeight; nY++)
+			{
+				bResult = fwrite(a_pData + nY * nRowSize, 1, nRowSize, fp) == static_cast<size_t>(nRowSize);
+				bResult = bResult && fwrite(c_uPadding, 1, nRowPadding, fp) == static_cast<size_t>(nRowPadding);
+			}
+		}
+		bResult = bResult && fwrite(c_uPadding, 1, uMipPadding, fp) == uMipPadding;
+		a_pData += GetSize(a_Format, nWidth, nHeight, 1);
+	}
+	fclose(fp);
+	return bResult;
+}
+
+bool CKtx::Read(const UString& a_sFileName, const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, u8* a_pData)
+{
+	CMappedFile mappedFile;
+	if (!mappedFile.Open(a_sFileName, CMappedFile::kMapModeRead) || mappedFile.GetSize() < static_cast<n64>(sizeof(SKtxHeader)))
+	{
+		return false;
+	}
+	const u8* pKtx = mappedFile.GetData();
+	n64 nKtxSize = mappedFile.GetSize();
+	const SKtxHeader* pKtxHeader = reinterpret_cast<const SKtxHeader*>(pKtx);
+	// only what the export writes is taken back, anything else would not swizzle into the same TexData
+	if (memcmp(pKtxHeader->Identifier, s_uIdentifier, sizeof(s_uIdentifier)) != 0
+		|| pKtxHeader->Endianness != s_uEndianness
+		|| pKtxHeader->GlType != a_Format.GlType
+		|| pKtxHeader->GlFormat != a_Format.GlFormat
+		|| pKtxHeader->GlInternalFormat != a_Format.GlInternalFormat
+		|| pKtxHeader->PixelWidth != static_cast<u32>(a_nWidth)
+		|| pKtxHeader->PixelHeight != static_cast<u32>(a_nHeight)
+		|| pKtxHeader->PixelDepth > 1
+		|| pKtxHeader->NumberOfArrayElements > 1
+		|| pKtxHeader->NumberOfFaces != 1
+		|| pKtxHeader->NumberOfMipmapLevels != static_cast<u32>(a_nMipLevel))
+	{
+		return false;
+	}
+	n64 nOffset = sizeof(SKtxHeader) + static_cast<n64>(pKtxHeader->BytesOfKeyValueData);
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		n32 nWidth = a_nWidth >> l;
+		n32 nHeight = a_nHeight >> l;
+		n32 nImageSize = getImageSize(a_Format, nWidth, nHeight);
+		if (nOffset + 4 + nImageSize > nKtxSize || *reinterpret_cast<const u32*>(pKtx + nOffset) != static_cast<u32>(nImageSize))
+		{
+			return false;
+		}
+		if (a_Format.GlType == 0)
+		{
+			memcpy(a_pData, pKtx + nOffset + 4, nImageSize);
+		}
+		else
+		{
+			// the padding at the end of each row is dropped, the data is packed like the export took it
+			n32 nRowSize = nWidth * a_Format.BPP / 8;
+			n32 nRowPitch = getRowSize(a_Format, nWidth);
+			for (n32 nY = 0; nY < nHeight; nY++)
+			{
+				memcpy(a_pData + nY * nRowSize, pKtx + nOffset + 4 + nY * nRowPitch, nRowSize);
+			}
+		}
+		a_pData += GetSize(a_Format, nWidth, nHeight, 1);
+		nOffset += 4 + (nImageSize + 3) / 4 * 4;
+	}
+	return true;
+}
+
+// the size of the packed data that Write takes and Read gives back, without the padding of the file
+n32 CKtx::GetSize(const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel)
+{
+	n32 nSize = 0;
+	for (n32 l = 0; l < a_nMipLevel; l++)
+	{
+		nSize += (a_nWidth >> l) * (a_nHeight >> l) * a_Format.BPP / 8;
+	}
+	return nSize;
+}
+
+// the bytes of one row in the file, padded to the 4 byte GL_UNPACK_ALIGNMENT that ktx assumes for uncompressed data
+n32 CKtx::getRowSize(const SFormat& a_Format, n32 a_nWidth)
+{
+	return (a_nWidth * a_Format.BPP / 8 + 3) / 4 * 4;
+}
+
+// the imageSize of a level, the compressed formats have no rows to pad
+n32 CKtx::getImageSize(const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight)
+{
+	if (a_Format.GlType == 0)
+	{
+		return GetSize(a_Format, a_nWidth, a_nHeight, 1);
+	}
+	return getRowSize(a_Format, a_nWidth) * a_nHeight;
+}
@@ -0,0 +1,49 @@
+#ifndef KTX_H_
+#define KTX_H_
+
+#include <sdw.h>
+
+#include SDW_MSC_PUSH_PACKED
+struct SKtxHeader
+{
+	u8 Identifier[12];
+	u32 Endianness;
+	u32 GlType;
+	u32 GlTypeSize;
+	u32 GlFormat;
+	u32 GlInternalFormat;
+	u32 GlBaseInternalFormat;
+	u32 PixelWidth;
+	u32 PixelHeight;
+	u32 PixelDepth;
+	u32 NumberOfArrayElements;
+	u32 NumberOfFaces;
+	u32 NumberOfMipmapLevels;
+	u32 BytesOfKeyValueData;
+} SDW_GNUC_PACKED;
+#include SDW_MSC_POP_PACKED
+
+class CKtx
+{
+public:
+	struct SFormat
+	{
+		u32 GlType;
+		u32 GlTypeSize;
+		u32 GlFormat;
+		u32 GlInternalFormat;
+		u32 GlBaseInternalFormat;
+		n32 BPP;
+	};
+	static bool Write(const UString& a_sFileName, const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, const u8* a_pData);
+	static bool Read(const UString& a_sFileName, const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, u8* a_pData);
+	static n32 GetSize(const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel);
+	static const u8 s_uIdentifier[12];
+	static const u32 s_uEndianness;
+private:
+	static n32 getRowSize(const SFormat& a_Format, n32 a_nWidth);
+	static n32 getImageSize(const SFormat& a_Format, n32 a_nWidth, n32 a_nHeight);
+	static const char s_szOrientationKeyValue[];
+};
+
+#endif	// KTX_H_
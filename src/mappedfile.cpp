@@ -0,0 +1,120 @@
+#include "mappedfile.h"
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile()
+	: m_pData(nullptr)
+	, m_nSize(0)
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	, m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(nullptr)
+#else
+	, m_nFd(-1)
+#endif
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Open(const UString& a_sFileName, EMapMode a_eMapMode)
+{
+	Close();
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	m_hFile = CreateFileW(a_sFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart <= 0)
+	{
+		Close();
+		return false;
+	}
+	m_nSize = fileSize.QuadPart;
+	m_hMapping = CreateFileMappingW(m_hFile, nullptr, a_eMapMode == kMapModeCopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+	if (m_hMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_pData = static_cast<u8*>(MapViewOfFile(m_hMapping, a_eMapMode == kMapModeCopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+	if (m_pData == nullptr)
+	{
+		Close();
+		return false;
+	}
+#else
+	m_nFd = open(a_sFileName.c_str(), O_RDONLY);
+	if (m_nFd == -1)
+	{
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(m_nFd, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+	m_nSize = fileStat.st_size;
+	void* pData = mmap(nullptr, static_cast<size_t>(m_nSize), a_eMapMode == kMapModeCopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, m_nFd, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_pData = static_cast<u8*>(pData);
+#endif
+	return true;
+}
+
+void CMappedFile::Close()
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_hMapping != nullptr)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pData != nullptr)
+	{
+		munmap(m_pData, static_cast<size_t>(m_nSize));
+	}
+	if (m_nFd != -1)
+	{
+		close(m_nFd);
+		m_nFd = -1;
+	}
+#endif
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+
+u8* CMappedFile::GetData() const
+{
+	return m_pData;
+}
+
+n64 CMappedFile::GetSize() const
+{
+	return m_nSize;
+}
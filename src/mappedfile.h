@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <sdw.h>
+
+class CMappedFile
+{
+public:
+	enum EMapMode
+	{
+		kMapModeRead,
+		kMapModeCopyOnWrite
+	};
+	CMappedFile();
+	~CMappedFile();
+	bool Open(const UString& a_sFileName, EMapMode a_eMapMode);
+	void Close();
+	u8* GetData() const;
+	n64 GetSize() const;
+private:
+	CMappedFile(const CMappedFile&);
+	CMappedFile& operator=(const CMappedFile&);
+	u8* m_pData;
+	n64 m_nSize;
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	void* m_hFile;
+	void* m_hMapping;
+#else
+	int m_nFd;
+#endif
+};
+
+#endif	// MAPPEDFILE_H_
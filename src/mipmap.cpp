@@ -0,0 +1,181 @@
+#include "mipmap.h"
+#include "arena.h"
+#include "swizzle.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MIPMAP_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define MIPMAP_TARGET(x)
+#else
+#define MIPMAP_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+// the taps 0.5, 1.5, 2.5 and 3.5 source pixels away from the center of a destination pixel, a normalized sinc under a kaiser window with beta 4
+const float CMipmap::s_fKaiserWeight[4] = { 0.438498f, 0.116920f, -0.042995f, -0.012423f };
+
+#if defined(MIPMAP_X86)
+// 2 source pixels per channel are summed as u16 in each row, the two rows added, and the 2x2 sums rounded back to u8
+
+MIPMAP_TARGET("sse2")
+static inline __m128i boxSSE2(__m128i a_Row0, __m128i a_Row1)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a_Row0, zero), _mm_unpacklo_epi8(a_Row1, zero));
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a_Row0, zero), _mm_unpackhi_epi8(a_Row1, zero));
+	__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+MIPMAP_TARGET("sse2")
+static n32 downsampleBoxSSE2(const u8* a_pRow0, const u8* a_pRow1, u8* a_pDest, n32 a_nWidth)
+{
+	n32 nX = 0;
+	for (; nX + 4 <= a_nWidth; nX += 4)
+	{
+		__m128i left = boxSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pRow0 + nX * 8)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pRow1 + nX * 8)));
+		__m128i right = boxSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pRow0 + nX * 8 + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pRow1 + nX * 8 + 16)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(a_pDest + nX * 4), _mm_packus_epi16(left, right));
+	}
+	return nX;
+}
+
+MIPMAP_TARGET("avx2")
+static inline __m256i boxAVX2(__m256i a_Row0, __m256i a_Row1)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a_Row0, zero), _mm256_unpacklo_epi8(a_Row1, zero));
+	__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a_Row0, zero), _mm256_unpackhi_epi8(a_Row1, zero));
+	__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+MIPMAP_TARGET("avx2")
+static n32 downsampleBoxAVX2(const u8* a_pRow0, const u8* a_pRow1, u8* a_pDest, n32 a_nWidth)
+{
+	n32 nX = 0;
+	for (; nX + 8 <= a_nWidth; nX += 8)
+	{
+		__m256i left = boxAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_pRow0 + nX * 8)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_pRow1 + nX * 8)));
+		__m256i right = boxAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_pRow0 + nX * 8 + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_pRow1 + nX * 8 + 32)));
+		// the pack works per 128 bit lane, which leaves the 4 pairs of destination pixels in the order 0, 2, 1, 3
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(a_pDest + nX * 4), _mm256_permute4x64_epi64(_mm256_packus_epi16(left, right), 0xD8));
+	}
+	return nX;
+}
+#endif
+
+// a_pDest receives the levels from 1 on one after another, each half the size of the one before like the levels in TexData
+void CMipmap::Generate(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, EFilter a_eFilter, CArena& a_Arena)
+{
+	u8** pLevel = a_Arena.Alloc<u8*>(a_nMipLevel);
+	n32 nCurrentSize = 0;
+	for (n32 l = 1; l < a_nMipLevel; l++)
+	{
+		pLevel[l] = a_pDest + nCurrentSize;
+		nCurrentSize += (a_nWidth >> l) * (a_nHeight >> l) * 4;
+	}
+	if (a_eFilter == kFilterKaiser)
+	{
+		// the float rows of the first level are the largest, every later level reuses them
+		float* pRow = a_Arena.Alloc<float>(static_cast<n64>(a_nWidth >> 1) * a_nHeight * 4);
+		for (n32 l = 1; l < a_nMipLevel; l++)
+		{
+			downsampleKaiser(l == 1 ? a_pRGBA : pLevel[l - 1], pLevel[l], a_nWidth >> (l - 1), a_nHeight >> (l - 1), pRow);
+		}
+		return;
+	}
+	// a row is made as soon as its two source rows exist, so the whole chain streams through the cache once
+	for (n32 nRow = 0; a_nMipLevel > 1 && nRow < a_nHeight >> 1; nRow++)
+	{
+		downsampleRow(a_pRGBA + nRow * 2 * a_nWidth * 4, a_pRGBA + (nRow * 2 + 1) * a_nWidth * 4, pLevel[1] + nRow * (a_nWidth >> 1) * 4, a_nWidth >> 1, a_eFilter);
+		for (n32 l = 2, nSrcRow = nRow; l < a_nMipLevel && nSrcRow % 2 == 1 && nSrcRow >> 1 < a_nHeight >> l; l++, nSrcRow >>= 1)
+		{
+			n32 nSrcWidth = a_nWidth >> (l - 1);
+			downsampleRow(pLevel[l - 1] + (nSrcRow - 1) * nSrcWidth * 4, pLevel[l - 1] + nSrcRow * nSrcWidth * 4, pLevel[l] + (nSrcRow >> 1) * (nSrcWidth >> 1) * 4, nSrcWidth >> 1, a_eFilter);
+		}
+	}
+}
+
+// what Generate takes from the arena, the level table and the float rows of the kaiser filter, each padded to a block
+n64 CMipmap::GetScratchSize(n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, EFilter a_eFilter)
+{
+	n64 nSize = a_nMipLevel * static_cast<n64>(sizeof(u8*)) + CArena::s_nAlignment;
+	if (a_eFilter == kFilterKaiser)
+	{
+		nSize += static_cast<n64>(a_nWidth >> 1) * a_nHeight * 4 * static_cast<n64>(sizeof(float)) + CArena::s_nAlignment;
+	}
+	return nSize;
+}
+
+// a_nWidth destination pixels from the source rows a_pRow0 and a_pRow1, which are always at least twice as wide
+void CMipmap::downsampleRow(const u8* a_pRow0, const u8* a_pRow1, u8* a_pDest, n32 a_nWidth, EFilter a_eFilter)
+{
+	n32 nX = 0;
+	if (a_eFilter == kFilterNearest)
+	{
+		for (; nX < a_nWidth; nX++)
+		{
+			memcpy(a_pDest + nX * 4, a_pRow0 + nX * 8, 4);
+		}
+		return;
+	}
+#if defined(MIPMAP_X86)
+	if (CSwizzle::GetSimdLevel() >= CSwizzle::kSimdLevelAVX2)
+	{
+		nX = downsampleBoxAVX2(a_pRow0, a_pRow1, a_pDest, a_nWidth);
+	}
+	else if (CSwizzle::GetSimdLevel() >= CSwizzle::kSimdLevelSSE2)
+	{
+		nX = downsampleBoxSSE2(a_pRow0, a_pRow1, a_pDest, a_nWidth);
+	}
+#endif
+	for (; nX < a_nWidth; nX++)
+	{
+		for (n32 i = 0; i < 4; i++)
+		{
+			a_pDest[nX * 4 + i] = static_cast<u8>((a_pRow0[nX * 8 + i] + a_pRow0[nX * 8 + 4 + i] + a_pRow1[nX * 8 + i] + a_pRow1[nX * 8 + 4 + i] + 2) >> 2);
+		}
+	}
+}
+
+// separable, the source is clamped at the edges and the horizontal pass is kept in float in a_pRow for the vertical one
+void CMipmap::downsampleKaiser(const u8* a_pSrc, u8* a_pDest, n32 a_nSrcWidth, n32 a_nSrcHeight, float* a_pRow)
+{
+	n32 nWidth = a_nSrcWidth >> 1;
+	n32 nHeight = a_nSrcHeight >> 1;
+	for (n32 nY = 0; nY < a_nSrcHeight; nY++)
+	{
+		const u8* pSrc = a_pSrc + nY * a_nSrcWidth * 4;
+		float* pRow = a_pRow + nY * nWidth * 4;
+		for (n32 nX = 0; nX < nWidth; nX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				float fValue = 0.0f;
+				for (n32 k = 0; k < 4; k++)
+				{
+					n32 nLeft = nX * 2 - k < 0 ? 0 : nX * 2 - k;
+					n32 nRight = nX * 2 + 1 + k >= a_nSrcWidth ? a_nSrcWidth - 1 : nX * 2 + 1 + k;
+					fValue += s_fKaiserWeight[k] * (pSrc[nLeft * 4 + i] + pSrc[nRight * 4 + i]);
+				}
+				pRow[nX * 4 + i] = fValue;
+			}
+		}
+	}
+	for (n32 nY = 0; nY < nHeight; nY++)
+	{
+		for (n32 nX = 0; nX < nWidth * 4; nX++)
+		{
+			float fValue = 0.0f;
+			for (n32 k = 0; k < 4; k++)
+			{
+				n32 nTop = nY * 2 - k < 0 ? 0 : nY * 2 - k;
+				n32 nBottom = nY * 2 + 1 + k >= a_nSrcHeight ? a_nSrcHeight - 1 : nY * 2 + 1 + k;
+				fValue += s_fKaiserWeight[k] * (a_pRow[nTop * nWidth * 4 + nX] + a_pRow[nBottom * nWidth * 4 + nX]);
+			}
+			n32 nValue = static_cast<n32>(floor(fValue + 0.5f));
+			a_pDest[nY * nWidth * 4 + nX] = static_cast<u8>(nValue < 0 ? 0 : (nValue > 0xFF ? 0xFF : nValue));
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef MIPMAP_H_
+#define MIPMAP_H_
+
+#include <sdw.h>
+
+class CArena;
+
+class CMipmap
+{
+public:
+	enum EFilter
+	{
+		kFilterNearest,
+		kFilterBox,
+		kFilterKaiser
+	};
+	static void Generate(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, EFilter a_eFilter, CArena& a_Arena);
+	static n64 GetScratchSize(n32 a_nWidth, n32 a_nHeight, n32 a_nMipLevel, EFilter a_eFilter);
+private:
+	static void downsampleRow(const u8* a_pRow0, const u8* a_pRow1, u8* a_pDest, n32 a_nWidth, EFilter a_eFilter);
+	static void downsampleKaiser(const u8* a_pSrc, u8* a_pDest, n32 a_nSrcWidth, n32 a_nSrcHeight, float* a_pRow);
+	static const float s_fKaiserWeight[4];
+};
+
+#endif	// MIPMAP_H_
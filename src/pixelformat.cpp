@@ -0,0 +1,319 @@
+#include "pixelformat.h"
+#include "ctpk.h"
+#include "swizzle.h"
+
+// n bit channel to 8 bit with rounding, the same values the normalized float path produced
+template<n32 Bits>
+static inline u8 expand(n32 a_nValue)
+{
+	return static_cast<u8>((a_nValue * 255 + ((1 << Bits) - 1) / 2) / ((1 << Bits) - 1));
+}
+
+// one texel in ctpk byte order to rgba8, the switch folds away for each instantiation
+template<n32 Format, n32 BytesPerPixel>
+static inline void decodeTexel(const u8* a_pTexel, u8* a_pRGBA)
+{
+	n32 nValue = BytesPerPixel == 2 ? a_pTexel[0] | a_pTexel[BytesPerPixel - 1] << 8 : 0;
+	switch (Format)
+	{
+	case CCtpk::kTextureFormatRGB888:
+		a_pRGBA[0] = a_pTexel[2];
+		a_pRGBA[1] = a_pTexel[1];
+		a_pRGBA[2] = a_pTexel[0];
+		a_pRGBA[3] = 0xFF;
+		break;
+	case CCtpk::kTextureFormatRGBA5551:
+		a_pRGBA[0] = expand<5>(nValue >> 11 & 0x1F);
+		a_pRGBA[1] = expand<5>(nValue >> 6 & 0x1F);
+		a_pRGBA[2] = expand<5>(nValue >> 1 & 0x1F);
+		a_pRGBA[3] = (nValue & 1) != 0 ? 0xFF : 0;
+		break;
+	case CCtpk::kTextureFormatRGB565:
+		a_pRGBA[0] = expand<5>(nValue >> 11 & 0x1F);
+		a_pRGBA[1] = expand<6>(nValue >> 5 & 0x3F);
+		a_pRGBA[2] = expand<5>(nValue & 0x1F);
+		a_pRGBA[3] = 0xFF;
+		break;
+	case CCtpk::kTextureFormatRGBA4444:
+		a_pRGBA[0] = (nValue >> 12 & 0x0F) * 0x11;
+		a_pRGBA[1] = (nValue >> 8 & 0x0F) * 0x11;
+		a_pRGBA[2] = (nValue >> 4 & 0x0F) * 0x11;
+		a_pRGBA[3] = (nValue & 0x0F) * 0x11;
+		break;
+	case CCtpk::kTextureFormatLA88:
+		a_pRGBA[0] = a_pTexel[1];
+		a_pRGBA[1] = a_pTexel[1];
+		a_pRGBA[2] = a_pTexel[1];
+		a_pRGBA[3] = a_pTexel[0];
+		break;
+	case CCtpk::kTextureFormatHL8:
+		a_pRGBA[0] = a_pTexel[1];
+		a_pRGBA[1] = a_pTexel[0];
+		a_pRGBA[2] = 0;
+		a_pRGBA[3] = 0xFF;
+		break;
+	case CCtpk::kTextureFormatL8:
+		a_pRGBA[0] = a_pTexel[0];
+		a_pRGBA[1] = a_pTexel[0];
+		a_pRGBA[2] = a_pTexel[0];
+		a_pRGBA[3] = 0xFF;
+		break;
+	case CCtpk::kTextureFormatA8:
+		a_pRGBA[0] = 0;
+		a_pRGBA[1] = 0;
+		a_pRGBA[2] = 0;
+		a_pRGBA[3] = a_pTexel[0];
+		break;
+	case CCtpk::kTextureFormatLA44:
+		a_pRGBA[0] = (a_pTexel[0] >> 4) * 0x11;
+		a_pRGBA[1] = (a_pTexel[0] >> 4) * 0x11;
+		a_pRGBA[2] = (a_pTexel[0] >> 4) * 0x11;
+		a_pRGBA[3] = (a_pTexel[0] & 0x0F) * 0x11;
+		break;
+	}
+}
+
+// 8 bit channel to n bit with rounding
+template<n32 Bits>
+static inline n32 quantize(n32 a_nValue)
+{
+	return (a_nValue * ((1 << Bits) - 1) + 127) / 255;
+}
+
+// bt.601 luma, exact for gray input
+static inline n32 luminance(const u8* a_pRGBA)
+{
+	return (a_pRGBA[0] * 77 + a_pRGBA[1] * 150 + a_pRGBA[2] * 29 + 128) >> 8;
+}
+
+// the inverse of decodeTexel
+template<n32 Format, n32 BytesPerPixel>
+static inline void encodeTexel(const u8* a_pRGBA, u8* a_pTexel)
+{
+	n32 nValue = 0;
+	switch (Format)
+	{
+	case CCtpk::kTextureFormatRGB888:
+		a_pTexel[0] = a_pRGBA[2];
+		a_pTexel[1] = a_pRGBA[1];
+		a_pTexel[2] = a_pRGBA[0];
+		break;
+	case CCtpk::kTextureFormatRGBA5551:
+		nValue = quantize<5>(a_pRGBA[0]) << 11 | quantize<5>(a_pRGBA[1]) << 6 | quantize<5>(a_pRGBA[2]) << 1 | quantize<1>(a_pRGBA[3]);
+		break;
+	case CCtpk::kTextureFormatRGB565:
+		nValue = quantize<5>(a_pRGBA[0]) << 11 | quantize<6>(a_pRGBA[1]) << 5 | quantize<5>(a_pRGBA[2]);
+		break;
+	case CCtpk::kTextureFormatRGBA4444:
+		nValue = quantize<4>(a_pRGBA[0]) << 12 | quantize<4>(a_pRGBA[1]) << 8 | quantize<4>(a_pRGBA[2]) << 4 | quantize<4>(a_pRGBA[3]);
+		break;
+	case CCtpk::kTextureFormatLA88:
+		a_pTexel[0] = a_pRGBA[3];
+		a_pTexel[1] = static_cast<u8>(luminance(a_pRGBA));
+		break;
+	case CCtpk::kTextureFormatHL8:
+		a_pTexel[0] = a_pRGBA[1];
+		a_pTexel[1] = a_pRGBA[0];
+		break;
+	case CCtpk::kTextureFormatL8:
+		a_pTexel[0] = static_cast<u8>(luminance(a_pRGBA));
+		break;
+	case CCtpk::kTextureFormatA8:
+		a_pTexel[0] = a_pRGBA[3];
+		break;
+	case CCtpk::kTextureFormatLA44:
+		a_pTexel[0] = static_cast<u8>(quantize<4>(luminance(a_pRGBA)) << 4 | quantize<4>(a_pRGBA[3]));
+		break;
+	}
+	if (Format == CCtpk::kTextureFormatRGBA5551 || Format == CCtpk::kTextureFormatRGB565 || Format == CCtpk::kTextureFormatRGBA4444)
+	{
+		a_pTexel[0] = static_cast<u8>(nValue);
+		a_pTexel[BytesPerPixel - 1] = static_cast<u8>(nValue >> 8);
+	}
+}
+
+bool CPixelFormat::Decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat)
+{
+	switch (a_nFormat)
+	{
+	case CCtpk::kTextureFormatRGBA8888:
+		CSwizzle::Deswizzle(a_pSrc, a_pRGBA, a_nWidth, a_nHeight, 4, true);
+		break;
+	case CCtpk::kTextureFormatRGB888:
+		decode<CCtpk::kTextureFormatRGB888, 3>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGBA5551:
+		decode<CCtpk::kTextureFormatRGBA5551, 2>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGB565:
+		decode<CCtpk::kTextureFormatRGB565, 2>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGBA4444:
+		decode<CCtpk::kTextureFormatRGBA4444, 2>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatLA88:
+		decode<CCtpk::kTextureFormatLA88, 2>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatHL8:
+		decode<CCtpk::kTextureFormatHL8, 2>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatL8:
+		decode<CCtpk::kTextureFormatL8, 1>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatA8:
+		decode<CCtpk::kTextureFormatA8, 1>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatLA44:
+		decode<CCtpk::kTextureFormatLA44, 1>(a_pSrc, a_pRGBA, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatL4:
+		decodeNibble(a_pSrc, a_pRGBA, a_nWidth, a_nHeight, false);
+		break;
+	case CCtpk::kTextureFormatA4:
+		decodeNibble(a_pSrc, a_pRGBA, a_nWidth, a_nHeight, true);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool CPixelFormat::Encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat)
+{
+	switch (a_nFormat)
+	{
+	case CCtpk::kTextureFormatRGBA8888:
+		CSwizzle::Swizzle(a_pRGBA, a_pDest, a_nWidth, a_nHeight, 4, true);
+		break;
+	case CCtpk::kTextureFormatRGB888:
+		encode<CCtpk::kTextureFormatRGB888, 3>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGBA5551:
+		encode<CCtpk::kTextureFormatRGBA5551, 2>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGB565:
+		encode<CCtpk::kTextureFormatRGB565, 2>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatRGBA4444:
+		encode<CCtpk::kTextureFormatRGBA4444, 2>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatLA88:
+		encode<CCtpk::kTextureFormatLA88, 2>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatHL8:
+		encode<CCtpk::kTextureFormatHL8, 2>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatL8:
+		encode<CCtpk::kTextureFormatL8, 1>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatA8:
+		encode<CCtpk::kTextureFormatA8, 1>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatLA44:
+		encode<CCtpk::kTextureFormatLA44, 1>(a_pRGBA, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case CCtpk::kTextureFormatL4:
+		encodeNibble(a_pRGBA, a_pDest, a_nWidth, a_nHeight, false);
+		break;
+	case CCtpk::kTextureFormatA4:
+		encodeNibble(a_pRGBA, a_pDest, a_nWidth, a_nHeight, true);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+template<n32 Format, n32 BytesPerPixel>
+void CPixelFormat::decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight)
+{
+	// the same tile walk as CSwizzle::Deswizzle, expanding each texel as it is scattered
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				u8* pRow = a_pRGBA + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * 4;
+				for (n32 j = 0; j < 8; j++)
+				{
+					decodeTexel<Format, BytesPerPixel>(pTile + CSwizzle::s_nDecodeTransByte[i * 8 + j] * BytesPerPixel, pRow + j * 4);
+				}
+			}
+			pTile += 64 * BytesPerPixel;
+		}
+	}
+}
+
+void CPixelFormat::decodeNibble(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha)
+{
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				u8* pRow = a_pRGBA + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * 4;
+				for (n32 j = 0; j < 8; j++)
+				{
+					n32 nIndex = CSwizzle::s_nDecodeTransByte[i * 8 + j];
+					u8 uValue = (pTile[nIndex / 2] >> (nIndex % 2 * 4) & 0x0F) * 0x11;
+					u8* pPixel = pRow + j * 4;
+					pPixel[0] = a_bAlpha ? 0 : uValue;
+					pPixel[1] = a_bAlpha ? 0 : uValue;
+					pPixel[2] = a_bAlpha ? 0 : uValue;
+					pPixel[3] = a_bAlpha ? uValue : 0xFF;
+				}
+			}
+			pTile += 32;
+		}
+	}
+}
+
+template<n32 Format, n32 BytesPerPixel>
+void CPixelFormat::encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	// each tile is written sequentially, quantizing the texels as they are gathered
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				const u8* pRow = a_pRGBA + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * 4;
+				for (n32 j = 0; j < 8; j++)
+				{
+					encodeTexel<Format, BytesPerPixel>(pRow + j * 4, pTile + CSwizzle::s_nDecodeTransByte[i * 8 + j] * BytesPerPixel);
+				}
+			}
+			pTile += 64 * BytesPerPixel;
+		}
+	}
+}
+
+void CPixelFormat::encodeNibble(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				const u8* pRow = a_pRGBA + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * 4;
+				for (n32 j = 0; j < 8; j++)
+				{
+					// truncating like the 8 bit to nibble packing in CSwizzle::SwizzleNibble
+					n32 nIndex = CSwizzle::s_nDecodeTransByte[i * 8 + j];
+					n32 nValue = (a_bAlpha ? pRow[j * 4 + 3] : luminance(pRow + j * 4)) / 0x11;
+					u8& uByte = pTile[nIndex / 2];
+					uByte = static_cast<u8>(nIndex % 2 == 0 ? (uByte & 0xF0) | nValue : (uByte & 0x0F) | nValue << 4);
+				}
+			}
+			pTile += 32;
+		}
+	}
+}
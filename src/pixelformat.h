@@ -0,0 +1,20 @@
+#ifndef PIXELFORMAT_H_
+#define PIXELFORMAT_H_
+
+#include <sdw.h>
+
+class CPixelFormat
+{
+public:
+	static bool Decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat);
+	static bool Encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nFormat);
+private:
+	template<n32 Format, n32 BytesPerPixel>
+	static void decode(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight);
+	template<n32 Format, n32 BytesPerPixel>
+	static void encode(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static void decodeNibble(const u8* a_pSrc, u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha);
+	static void encodeNibble(const u8* a_pRGBA, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bAlpha);
+};
+
+#endif	// PIXELFORMAT_H_
@@ -0,0 +1,273 @@
+#include "pngwriter.h"
+#include "arena.h"
+#include "threadpool.h"
+#include <zlib.h>
+
+struct SDeflateMemory
+{
+	u8* Data;
+	n64 Size;
+	n64 Offset;
+};
+
+// raw scanline bytes per deflate chunk, large enough that the restarted match window costs little
+const n32 CPngWriter::s_nChunkSize = 256 * 1024;
+const n32 CPngWriter::s_nDictionarySize = 32 * 1024;
+// zlib documents (1 << 17) + (1 << 17) for windowBits 15 and memLevel 8, the rest covers its state, the padding of each block and the larger hash table of zlib-ng
+const n32 CPngWriter::s_nDeflateMemorySize = 384 * 1024;
+
+static inline void writeBigEndian32(u8* a_pDest, u32 a_uValue)
+{
+	a_pDest[0] = static_cast<u8>(a_uValue >> 24);
+	a_pDest[1] = static_cast<u8>(a_uValue >> 16);
+	a_pDest[2] = static_cast<u8>(a_uValue >> 8);
+	a_pDest[3] = static_cast<u8>(a_uValue);
+}
+
+// the window, hash chains and pending buffer of a stream come from its arena slice, only a zlib that wants more than the slice goes to the heap
+static voidpf deflateAlloc(voidpf a_pOpaque, uInt a_uItems, uInt a_uSize)
+{
+	SDeflateMemory* pMemory = static_cast<SDeflateMemory*>(a_pOpaque);
+	n64 nSize = (static_cast<n64>(a_uItems) * a_uSize + CArena::s_nAlignment - 1) / CArena::s_nAlignment * CArena::s_nAlignment;
+	if (pMemory->Offset + nSize <= pMemory->Size)
+	{
+		u8* pData = pMemory->Data + pMemory->Offset;
+		pMemory->Offset += nSize;
+		return pData;
+	}
+	return new (nothrow) u8[static_cast<size_t>(nSize)];
+}
+
+static void deflateFree(voidpf a_pOpaque, voidpf a_pAddress)
+{
+	SDeflateMemory* pMemory = static_cast<SDeflateMemory*>(a_pOpaque);
+	u8* pData = static_cast<u8*>(a_pAddress);
+	if (pData < pMemory->Data || pData >= pMemory->Data + pMemory->Size)
+	{
+		delete[] pData;
+	}
+}
+
+static inline u8 paeth(u8 a_uLeft, u8 a_uUp, u8 a_uUpLeft)
+{
+	n32 nP = a_uLeft + a_uUp - a_uUpLeft;
+	n32 nLeft = nP > a_uLeft ? nP - a_uLeft : a_uLeft - nP;
+	n32 nUp = nP > a_uUp ? nP - a_uUp : a_uUp - nP;
+	n32 nUpLeft = nP > a_uUpLeft ? nP - a_uUpLeft : a_uUpLeft - nP;
+	if (nLeft <= nUp && nLeft <= nUpLeft)
+	{
+		return a_uLeft;
+	}
+	return nUp <= nUpLeft ? a_uUp : a_uUpLeft;
+}
+
+// the idat stream is cut into row aligned chunks that are filtered and deflated on their own, pigz style:
+// every chunk but the last ends on a sync flush, starts from the previous 32k as its dictionary,
+// and the zlib adler32 is stitched together from the chunk checksums
+bool CPngWriter::Write(FILE* a_fp, const u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, EEffort a_eEffort, EFilter a_eFilter, CThreadPool& a_ThreadPool, CArena& a_Arena)
+{
+	static const n32 c_nLevel[] = { 0, 1, 6, 9 };
+	n32 nLevel = c_nLevel[a_eEffort];
+	n32 nRowSize = a_nWidth * 4;
+	n32 nFilteredRowSize = nRowSize + 1;
+	n32 nRowsPerChunk = s_nChunkSize / nFilteredRowSize;
+	if (nRowsPerChunk < 1)
+	{
+		nRowsPerChunk = 1;
+	}
+	n32 nChunkCount = (a_nHeight + nRowsPerChunk - 1) / nRowsPerChunk;
+	// every chunk deflates into its own slice with room for the zlib header in front and the adler32 behind
+	n32 nIdatCapacity = 2 + getDeflateBound(nRowsPerChunk * nFilteredRowSize) + 4;
+	u8* pFiltered = a_Arena.Alloc<u8>(static_cast<n64>(a_nHeight) * nFilteredRowSize);
+	u8* pIdat = a_Arena.Alloc<u8>(static_cast<n64>(nChunkCount) * nIdatCapacity);
+	n32* pIdatSize = a_Arena.Alloc<n32>(nChunkCount);
+	uLong* pAdler = a_Arena.Alloc<uLong>(nChunkCount);
+	u8* pResult = a_Arena.Alloc<u8>(nChunkCount);
+	// no more streams than workers are ever open at once, each takes a free slice and hands it back when it is done
+	n32 nSlotCount = min<n32>(nChunkCount, a_ThreadPool.GetThreadCount());
+	u8* pDeflateMemory = a_Arena.Alloc<u8>(static_cast<n64>(nSlotCount) * s_nDeflateMemorySize);
+	n32* pFreeSlot = a_Arena.Alloc<n32>(nSlotCount);
+	for (n32 i = 0; i < nSlotCount; i++)
+	{
+		pFreeSlot[i] = i;
+	}
+	n32 nFreeSlotCount = nSlotCount;
+	n32* pFreeSlotCount = &nFreeSlotCount;
+	mutex slotMutex;
+	mutex* pSlotMutex = &slotMutex;
+	{
+		CTaskGroup taskGroup(a_ThreadPool);
+		for (n32 i = 0; i < nChunkCount; i++)
+		{
+			taskGroup.Push([=]()
+			{
+				for (n32 nY = i * nRowsPerChunk; nY < (i + 1) * nRowsPerChunk && nY < a_nHeight; nY++)
+				{
+					filterRow(a_pRGBA + nY * nRowSize, nY > 0 ? a_pRGBA + (nY - 1) * nRowSize : nullptr, pFiltered + static_cast<size_t>(nY) * nFilteredRowSize, nRowSize, a_eFilter);
+				}
+			});
+		}
+		taskGroup.Wait();
+		// the dictionary of a chunk is the tail of the one before it, so deflate only starts once every row is filtered
+		for (n32 i = 0; i < nChunkCount; i++)
+		{
+			taskGroup.Push([=]()
+			{
+				size_t uOffset = static_cast<size_t>(i) * nRowsPerChunk * nFilteredRowSize;
+				n32 nSize = ((i + 1) * nRowsPerChunk < a_nHeight ? nRowsPerChunk : a_nHeight - i * nRowsPerChunk) * nFilteredRowSize;
+				n32 nDictionarySize = uOffset < static_cast<size_t>(s_nDictionarySize) ? static_cast<n32>(uOffset) : s_nDictionarySize;
+				pAdler[i] = adler32(adler32(0, nullptr, 0), pFiltered + uOffset, nSize);
+				n32 nSlot = 0;
+				{
+					lock_guard<mutex> lock(*pSlotMutex);
+					nSlot = pFreeSlot[--*pFreeSlotCount];
+				}
+				pResult[i] = deflateChunk(pFiltered + uOffset, nSize, pFiltered + uOffset - nDictionarySize, nDictionarySize, nLevel, i == nChunkCount - 1, pIdat + static_cast<size_t>(i) * nIdatCapacity + 2, nIdatCapacity - 6, pIdatSize[i], pDeflateMemory + static_cast<size_t>(nSlot) * s_nDeflateMemorySize) ? 1 : 0;
+				lock_guard<mutex> lock(*pSlotMutex);
+				pFreeSlot[(*pFreeSlotCount)++] = nSlot;
+			});
+		}
+		taskGroup.Wait();
+	}
+	for (n32 i = 0; i < nChunkCount; i++)
+	{
+		if (pResult[i] == 0)
+		{
+			return false;
+		}
+	}
+	static const u8 c_uSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (fwrite(c_uSignature, 1, sizeof(c_uSignature), a_fp) != sizeof(c_uSignature))
+	{
+		return false;
+	}
+	u8 uHeader[13] = {};
+	writeBigEndian32(uHeader, a_nWidth);
+	writeBigEndian32(uHeader + 4, a_nHeight);
+	uHeader[8] = 8;
+	uHeader[9] = 6;
+	if (!writeChunk(a_fp, "IHDR", uHeader, sizeof(uHeader)))
+	{
+		return false;
+	}
+	uLong uAdler = adler32(0, nullptr, 0);
+	for (n32 i = 0; i < nChunkCount; i++)
+	{
+		uAdler = adler32_combine(uAdler, pAdler[i], static_cast<z_off_t>(i == nChunkCount - 1 ? (a_nHeight - i * nRowsPerChunk) * nFilteredRowSize : nRowsPerChunk * nFilteredRowSize));
+	}
+	static const u8 c_uZlibFlag[] = { 0x01, 0x01, 0x9C, 0xDA };
+	for (n32 i = 0; i < nChunkCount; i++)
+	{
+		u8* pData = pIdat + static_cast<size_t>(i) * nIdatCapacity + 2;
+		n32 nSize = pIdatSize[i];
+		if (i == 0)
+		{
+			pData -= 2;
+			nSize += 2;
+			pData[0] = 0x78;
+			pData[1] = c_uZlibFlag[a_eEffort];
+		}
+		if (i == nChunkCount - 1)
+		{
+			writeBigEndian32(pData + nSize, static_cast<u32>(uAdler));
+			nSize += 4;
+		}
+		if (!writeChunk(a_fp, "IDAT", pData, static_cast<u32>(nSize)))
+		{
+			return false;
+		}
+	}
+	return writeChunk(a_fp, "IEND", nullptr, 0);
+}
+
+// what Write takes from the arena, the filtered rows, the deflate slices, the per chunk results
+// and the zlib memory of as many streams as there are chunks, the most that can be open at once, each padded to a block
+n64 CPngWriter::GetScratchSize(n32 a_nWidth, n32 a_nHeight)
+{
+	n32 nFilteredRowSize = a_nWidth * 4 + 1;
+	n32 nRowsPerChunk = s_nChunkSize / nFilteredRowSize;
+	if (nRowsPerChunk < 1)
+	{
+		nRowsPerChunk = 1;
+	}
+	n32 nChunkCount = (a_nHeight + nRowsPerChunk - 1) / nRowsPerChunk;
+	n64 nIdatCapacity = 2 + getDeflateBound(nRowsPerChunk * nFilteredRowSize) + 4;
+	return static_cast<n64>(a_nHeight) * nFilteredRowSize + nChunkCount * (nIdatCapacity + static_cast<n64>(sizeof(n32) + sizeof(uLong) + 1) + s_nDeflateMemorySize + static_cast<n64>(sizeof(n32))) + 7 * CArena::s_nAlignment;
+}
+
+void CPngWriter::filterRow(const u8* a_pRow, const u8* a_pPrevRow, u8* a_pDest, n32 a_nRowSize, EFilter a_eFilter)
+{
+	a_pDest[0] = static_cast<u8>(a_eFilter);
+	u8* pDest = a_pDest + 1;
+	for (n32 i = 0; i < a_nRowSize; i++)
+	{
+		u8 uLeft = i >= 4 ? a_pRow[i - 4] : 0;
+		u8 uUp = a_pPrevRow != nullptr ? a_pPrevRow[i] : 0;
+		u8 uUpLeft = a_pPrevRow != nullptr && i >= 4 ? a_pPrevRow[i - 4] : 0;
+		switch (a_eFilter)
+		{
+		case kFilterNone:
+			pDest[i] = a_pRow[i];
+			break;
+		case kFilterSub:
+			pDest[i] = static_cast<u8>(a_pRow[i] - uLeft);
+			break;
+		case kFilterUp:
+			pDest[i] = static_cast<u8>(a_pRow[i] - uUp);
+			break;
+		case kFilterAverage:
+			pDest[i] = static_cast<u8>(a_pRow[i] - ((uLeft + uUp) >> 1));
+			break;
+		case kFilterPaeth:
+			pDest[i] = static_cast<u8>(a_pRow[i] - paeth(uLeft, uUp, uUpLeft));
+			break;
+		}
+	}
+}
+
+// the bound zlib gives without a stream covers stored blocks, plus the few bytes of the sync flush marker
+n32 CPngWriter::getDeflateBound(n32 a_nSize)
+{
+	return static_cast<n32>(deflateBound(nullptr, a_nSize)) + 16;
+}
+
+bool CPngWriter::deflateChunk(const u8* a_pData, n32 a_nSize, const u8* a_pDictionary, n32 a_nDictionarySize, n32 a_nLevel, bool a_bLast, u8* a_pDeflate, n32 a_nDeflateCapacity, n32& a_nDeflateSize, u8* a_pMemory)
+{
+	SDeflateMemory memory = { a_pMemory, s_nDeflateMemorySize, 0 };
+	z_stream stream = {};
+	stream.zalloc = deflateAlloc;
+	stream.zfree = deflateFree;
+	stream.opaque = &memory;
+	if (deflateInit2(&stream, a_nLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return false;
+	}
+	if (a_nDictionarySize != 0 && a_nLevel != 0 && deflateSetDictionary(&stream, a_pDictionary, a_nDictionarySize) != Z_OK)
+	{
+		deflateEnd(&stream);
+		return false;
+	}
+	stream.next_in = const_cast<Bytef*>(a_pData);
+	stream.avail_in = a_nSize;
+	stream.next_out = a_pDeflate;
+	stream.avail_out = static_cast<uInt>(a_nDeflateCapacity);
+	int nResult = deflate(&stream, a_bLast ? Z_FINISH : Z_SYNC_FLUSH);
+	a_nDeflateSize = a_nDeflateCapacity - static_cast<n32>(stream.avail_out);
+	bool bDone = stream.avail_in == 0 && stream.avail_out != 0;
+	deflateEnd(&stream);
+	return bDone && (a_bLast ? nResult == Z_STREAM_END : nResult == Z_OK);
+}
+
+bool CPngWriter::writeChunk(FILE* a_fp, const char* a_pType, const u8* a_pData, u32 a_uSize)
+{
+	u8 uLength[4] = {};
+	writeBigEndian32(uLength, a_uSize);
+	uLong uCrc = crc32(0, reinterpret_cast<const Bytef*>(a_pType), 4);
+	if (a_uSize != 0)
+	{
+		uCrc = crc32(uCrc, a_pData, a_uSize);
+	}
+	u8 uCrcBytes[4] = {};
+	writeBigEndian32(uCrcBytes, static_cast<u32>(uCrc));
+	return fwrite(uLength, 1, 4, a_fp) == 4 && fwrite(a_pType, 1, 4, a_fp) == 4 && (a_uSize == 0 || fwrite(a_pData, 1, a_uSize, a_fp) == a_uSize) && fwrite(uCrcBytes, 1, 4, a_fp) == 4;
+}
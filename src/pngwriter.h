@@ -0,0 +1,39 @@
+#ifndef PNGWRITER_H_
+#define PNGWRITER_H_
+
+#include <sdw.h>
+
+class CArena;
+class CThreadPool;
+
+class CPngWriter
+{
+public:
+	enum EEffort
+	{
+		kEffortStored,
+		kEffortFast,
+		kEffortDefault,
+		kEffortMax
+	};
+	enum EFilter
+	{
+		kFilterNone,
+		kFilterSub,
+		kFilterUp,
+		kFilterAverage,
+		kFilterPaeth
+	};
+	static bool Write(FILE* a_fp, const u8* a_pRGBA, n32 a_nWidth, n32 a_nHeight, EEffort a_eEffort, EFilter a_eFilter, CThreadPool& a_ThreadPool, CArena& a_Arena);
+	static n64 GetScratchSize(n32 a_nWidth, n32 a_nHeight);
+private:
+	static void filterRow(const u8* a_pRow, const u8* a_pPrevRow, u8* a_pDest, n32 a_nRowSize, EFilter a_eFilter);
+	static n32 getDeflateBound(n32 a_nSize);
+	static bool deflateChunk(const u8* a_pData, n32 a_nSize, const u8* a_pDictionary, n32 a_nDictionarySize, n32 a_nLevel, bool a_bLast, u8* a_pDeflate, n32 a_nDeflateCapacity, n32& a_nDeflateSize, u8* a_pMemory);
+	static bool writeChunk(FILE* a_fp, const char* a_pType, const u8* a_pData, u32 a_uSize);
+	static const n32 s_nChunkSize;
+	static const n32 s_nDictionarySize;
+	static const n32 s_nDeflateMemorySize;
+};
+
+#endif	// PNGWRITER_H_
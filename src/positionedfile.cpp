@@ -0,0 +1,317 @@
+#include "positionedfile.h"
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if SDW_PLATFORM == SDW_PLATFORM_MACOS
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#elif SDW_PLATFORM == SDW_PLATFORM_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define POSITIONEDFILE_COPY_FILE_RANGE
+#endif
+#endif
+#endif
+
+CPositionedFile::CPositionedFile()
+	: m_nSize(0)
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	, m_hFile(INVALID_HANDLE_VALUE)
+#else
+	, m_nFd(-1)
+#endif
+{
+}
+
+CPositionedFile::~CPositionedFile()
+{
+	Close();
+}
+
+bool CPositionedFile::Open(const UString& a_sFileName, EOpenMode a_eOpenMode)
+{
+	Close();
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	m_hFile = CreateFileW(a_sFileName.c_str(), a_eOpenMode == kOpenModeReadWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	m_nSize = fileSize.QuadPart;
+#else
+	m_nFd = open(a_sFileName.c_str(), a_eOpenMode == kOpenModeReadWrite ? O_RDWR : O_RDONLY);
+	if (m_nFd == -1)
+	{
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(m_nFd, &fileStat) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_nSize = fileStat.st_size;
+#endif
+	return true;
+}
+
+void CPositionedFile::Close()
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_nFd != -1)
+	{
+		close(m_nFd);
+		m_nFd = -1;
+	}
+#endif
+	m_nSize = 0;
+}
+
+n64 CPositionedFile::GetSize() const
+{
+	return m_nSize;
+}
+
+// the file position is never used, so the reads neither seek nor touch anything outside the range
+bool CPositionedFile::Read(n64 a_nOffset, void* a_pData, n64 a_nSize) const
+{
+	if (a_nOffset < 0 || a_nSize < 0 || a_nOffset + a_nSize > m_nSize)
+	{
+		return false;
+	}
+	u8* pData = static_cast<u8*>(a_pData);
+	while (a_nSize > 0)
+	{
+		n32 nSize = a_nSize > 0x40000000 ? 0x40000000 : static_cast<n32>(a_nSize);
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(a_nOffset);
+		overlapped.OffsetHigh = static_cast<DWORD>(a_nOffset >> 32);
+		DWORD uRead = 0;
+		if (!ReadFile(m_hFile, pData, static_cast<DWORD>(nSize), &uRead, &overlapped) || uRead == 0)
+		{
+			return false;
+		}
+		n64 nRead = uRead;
+#else
+		ssize_t nRead = pread(m_nFd, pData, static_cast<size_t>(nSize), static_cast<off_t>(a_nOffset));
+		if (nRead <= 0)
+		{
+			return false;
+		}
+#endif
+		pData += nRead;
+		a_nOffset += nRead;
+		a_nSize -= nRead;
+	}
+	return true;
+}
+
+bool CPositionedFile::Write(n64 a_nOffset, const void* a_pData, n64 a_nSize)
+{
+	if (a_nOffset < 0 || a_nSize < 0)
+	{
+		return false;
+	}
+	const u8* pData = static_cast<const u8*>(a_pData);
+	while (a_nSize > 0)
+	{
+		n32 nSize = a_nSize > 0x40000000 ? 0x40000000 : static_cast<n32>(a_nSize);
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(a_nOffset);
+		overlapped.OffsetHigh = static_cast<DWORD>(a_nOffset >> 32);
+		DWORD uWritten = 0;
+		if (!WriteFile(m_hFile, pData, static_cast<DWORD>(nSize), &uWritten, &overlapped) || uWritten == 0)
+		{
+			return false;
+		}
+		n64 nWritten = uWritten;
+#else
+		ssize_t nWritten = pwrite(m_nFd, pData, static_cast<size_t>(nSize), static_cast<off_t>(a_nOffset));
+		if (nWritten <= 0)
+		{
+			return false;
+		}
+#endif
+		pData += nWritten;
+		a_nOffset += nWritten;
+		a_nSize -= nWritten;
+	}
+	if (a_nOffset > m_nSize)
+	{
+		m_nSize = a_nOffset;
+	}
+	return true;
+}
+
+// data only flushes what a later read needs, full also flushes the metadata and on macos the drive cache
+bool CPositionedFile::Sync(ESyncMode a_eSyncMode)
+{
+	if (a_eSyncMode == kSyncModeNone)
+	{
+		return true;
+	}
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return FlushFileBuffers(m_hFile) != 0;
+#elif SDW_PLATFORM == SDW_PLATFORM_MACOS
+	if (a_eSyncMode == kSyncModeFull && fcntl(m_nFd, F_FULLFSYNC) == 0)
+	{
+		return true;
+	}
+	return fsync(m_nFd) == 0;
+#elif SDW_PLATFORM == SDW_PLATFORM_LINUX
+	return (a_eSyncMode == kSyncModeFull ? fsync(m_nFd) : fdatasync(m_nFd)) == 0;
+#else
+	return fsync(m_nFd) == 0;
+#endif
+}
+
+// the copy shares the extents of the original where the file system can, so only the pages written later are new
+bool CPositionedFile::Clone(const UString& a_sFileName, const UString& a_sNewFileName)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return CopyFileW(a_sFileName.c_str(), a_sNewFileName.c_str(), FALSE) != 0;
+#elif SDW_PLATFORM == SDW_PLATFORM_MACOS
+	Remove(a_sNewFileName);
+	if (clonefile(a_sFileName.c_str(), a_sNewFileName.c_str(), 0) == 0)
+	{
+		return true;
+	}
+	return copyfile(a_sFileName.c_str(), a_sNewFileName.c_str(), nullptr, COPYFILE_DATA | COPYFILE_STAT) == 0;
+#else
+	int nFd = open(a_sFileName.c_str(), O_RDONLY);
+	if (nFd == -1)
+	{
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(nFd, &fileStat) != 0)
+	{
+		close(nFd);
+		return false;
+	}
+	int nNewFd = open(a_sNewFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, fileStat.st_mode & 07777);
+	if (nNewFd == -1)
+	{
+		close(nFd);
+		return false;
+	}
+	bool bResult = false;
+#if defined(FICLONE)
+	bResult = ioctl(nNewFd, FICLONE, nFd) == 0;
+#endif
+	if (!bResult)
+	{
+		bResult = copy(nFd, nNewFd, fileStat.st_size);
+	}
+	close(nNewFd);
+	close(nFd);
+	if (!bResult)
+	{
+		Remove(a_sNewFileName);
+	}
+	return bResult;
+#endif
+}
+
+// the new file takes the name of the old one in a single rename, a crash leaves one or the other but never a mix
+bool CPositionedFile::Replace(const UString& a_sFileName, const UString& a_sNewFileName, ESyncMode a_eSyncMode)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return MoveFileExW(a_sNewFileName.c_str(), a_sFileName.c_str(), a_eSyncMode == kSyncModeFull ? MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH : MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	if (rename(a_sNewFileName.c_str(), a_sFileName.c_str()) != 0)
+	{
+		return false;
+	}
+	if (a_eSyncMode != kSyncModeFull)
+	{
+		return true;
+	}
+	// the rename itself only lasts once the directory that holds the name is on disk
+	UString sDirName = USTR(".");
+	UString::size_type uPos = a_sFileName.find_last_of(USTR("/"));
+	if (uPos != UString::npos)
+	{
+		sDirName = uPos == 0 ? USTR("/") : a_sFileName.substr(0, uPos);
+	}
+	int nDirFd = open(sDirName.c_str(), O_RDONLY);
+	if (nDirFd == -1)
+	{
+		return false;
+	}
+	bool bResult = fsync(nDirFd) == 0;
+	close(nDirFd);
+	return bResult;
+#endif
+}
+
+bool CPositionedFile::Remove(const UString& a_sFileName)
+{
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	return DeleteFileW(a_sFileName.c_str()) != 0;
+#else
+	return unlink(a_sFileName.c_str()) == 0;
+#endif
+}
+
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+bool CPositionedFile::copy(int a_nFd, int a_nNewFd, n64 a_nSize)
+{
+	n64 nOffset = 0;
+#if defined(POSITIONEDFILE_COPY_FILE_RANGE)
+	// the kernel moves the bytes without a trip through userspace, and shares the extents itself on nfs, xfs and btrfs
+	while (nOffset < a_nSize)
+	{
+		size_t uSize = a_nSize - nOffset > 0x40000000 ? 0x40000000 : static_cast<size_t>(a_nSize - nOffset);
+		loff_t nInOffset = nOffset;
+		loff_t nOutOffset = nOffset;
+		ssize_t nCopied = copy_file_range(a_nFd, &nInOffset, a_nNewFd, &nOutOffset, uSize, 0);
+		if (nCopied <= 0)
+		{
+			break;
+		}
+		nOffset += nCopied;
+	}
+#endif
+	const n32 nBufferSize = 1024 * 1024;
+	u8* pBuffer = nullptr;
+	bool bResult = true;
+	while (bResult && nOffset < a_nSize)
+	{
+		if (pBuffer == nullptr)
+		{
+			pBuffer = new u8[nBufferSize];
+		}
+		size_t uSize = a_nSize - nOffset > nBufferSize ? nBufferSize : static_cast<size_t>(a_nSize - nOffset);
+		ssize_t nRead = pread(a_nFd, pBuffer, uSize, static_cast<off_t>(nOffset));
+		bResult = nRead > 0;
+		for (ssize_t nWritten = 0; bResult && nWritten < nRead; )
+		{
+			ssize_t nSize = pwrite(a_nNewFd, pBuffer + nWritten, static_cast<size_t>(nRead - nWritten), static_cast<off_t>(nOffset + nWritten));
+			bResult = nSize > 0;
+			nWritten += nSize;
+		}
+		nOffset += nRead;
+	}
+	delete[] pBuffer;
+	return bResult;
+}
+#endif
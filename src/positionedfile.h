@@ -0,0 +1,45 @@
+#ifndef POSITIONEDFILE_H_
+#define POSITIONEDFILE_H_
+
+#include <sdw.h>
+
+class CPositionedFile
+{
+public:
+	enum EOpenMode
+	{
+		kOpenModeRead,
+		kOpenModeReadWrite
+	};
+	enum ESyncMode
+	{
+		kSyncModeNone,
+		kSyncModeData,
+		kSyncModeFull
+	};
+	CPositionedFile();
+	~CPositionedFile();
+	bool Open(const UString& a_sFileName, EOpenMode a_eOpenMode);
+	void Close();
+	n64 GetSize() const;
+	bool Read(n64 a_nOffset, void* a_pData, n64 a_nSize) const;
+	bool Write(n64 a_nOffset, const void* a_pData, n64 a_nSize);
+	bool Sync(ESyncMode a_eSyncMode);
+	static bool Clone(const UString& a_sFileName, const UString& a_sNewFileName);
+	static bool Replace(const UString& a_sFileName, const UString& a_sNewFileName, ESyncMode a_eSyncMode);
+	static bool Remove(const UString& a_sFileName);
+private:
+	CPositionedFile(const CPositionedFile&);
+	CPositionedFile& operator=(const CPositionedFile&);
+#if SDW_PLATFORM != SDW_PLATFORM_WINDOWS
+	static bool copy(int a_nFd, int a_nNewFd, n64 a_nSize);
+#endif
+	n64 m_nSize;
+#if SDW_PLATFORM == SDW_PLATFORM_WINDOWS
+	void* m_hFile;
+#else
+	int m_nFd;
+#endif
+};
+
+#endif	// POSITIONEDFILE_H_
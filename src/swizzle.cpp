@@ -0,0 +1,862 @@
+#include "swizzle.h"
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SWIZZLE_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SWIZZLE_TARGET(x)
+#else
+#define SWIZZLE_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+const int CSwizzle::s_nDecodeTransByte[64] =
+{
+	 0,  1,  4,  5, 16, 17, 20, 21,
+	 2,  3,  6,  7, 18, 19, 22, 23,
+	 8,  9, 12, 13, 24, 25, 28, 29,
+	10, 11, 14, 15, 26, 27, 30, 31,
+	32, 33, 36, 37, 48, 49, 52, 53,
+	34, 35, 38, 39, 50, 51, 54, 55,
+	40, 41, 44, 45, 56, 57, 60, 61,
+	42, 43, 46, 47, 58, 59, 62, 63
+};
+
+CSwizzle::ESimdLevel CSwizzle::s_eSimdLevel = CSwizzle::detectSimdLevel();
+
+#if defined(SWIZZLE_X86)
+// the 16 bytes loaded from a tile are 4 pixels of 4 bytes, 8 of 2 bytes or 16 of 1 byte in morton order,
+// so every load covers 2 rows (or 4 rows for 1 byte) and the shuffles below only rearrange within a load
+
+SWIZZLE_TARGET("sse2")
+static inline __m128i reverse32SSE2(__m128i a_Value)
+{
+	a_Value = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a_Value, 0xB1), 0xB1);
+	return _mm_or_si128(_mm_slli_epi16(a_Value, 8), _mm_srli_epi16(a_Value, 8));
+}
+
+SWIZZLE_TARGET("sse2")
+static inline __m128i reverse16SSE2(__m128i a_Value)
+{
+	return _mm_or_si128(_mm_slli_epi16(a_Value, 8), _mm_srli_epi16(a_Value, 8));
+}
+
+SWIZZLE_TARGET("sse2")
+static void deswizzle32SSE2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			for (n32 i = 0; i < 16; i += 2)
+			{
+				__m128i left = reverse32SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16)));
+				__m128i right = reverse32SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16 + 16)));
+				u8* pRow = pDest + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4 + (i >> 2 & 1) * 16;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow), _mm_unpacklo_epi64(left, right));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + a_nWidth * 4), _mm_unpackhi_epi64(left, right));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("sse2")
+static void swizzle32SSE2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			for (n32 i = 0; i < 16; i += 2)
+			{
+				const u8* pRow = pSrc + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4 + (i >> 2 & 1) * 16;
+				__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow));
+				__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + a_nWidth * 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16), reverse32SSE2(_mm_unpacklo_epi64(top, bottom)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16 + 16), reverse32SSE2(_mm_unpackhi_epi64(top, bottom)));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void deswizzle32SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			for (n32 i = 0; i < 16; i += 2)
+			{
+				__m128i left = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16)), reverse);
+				__m128i right = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16 + 16)), reverse);
+				u8* pRow = pDest + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4 + (i >> 2 & 1) * 16;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow), _mm_unpacklo_epi64(left, right));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + a_nWidth * 4), _mm_unpackhi_epi64(left, right));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void swizzle32SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			for (n32 i = 0; i < 16; i += 2)
+			{
+				const u8* pRow = pSrc + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4 + (i >> 2 & 1) * 16;
+				__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow));
+				__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + a_nWidth * 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16), _mm_shuffle_epi8(_mm_unpacklo_epi64(top, bottom), reverse));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16 + 16), _mm_shuffle_epi8(_mm_unpackhi_epi64(top, bottom), reverse));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("avx2")
+static void deswizzle32AVX2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			// loads i and i + 4 hold the left and right halves of the same 2 rows
+			for (n32 i = 0; i < 16; i += (i & 2) != 0 ? 6 : 2)
+			{
+				__m256i left = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pTile + i * 16)), reverse);
+				__m256i right = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pTile + i * 16 + 64)), reverse);
+				left = _mm256_permute4x64_epi64(left, 0xD8);
+				right = _mm256_permute4x64_epi64(right, 0xD8);
+				u8* pRow = pDest + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4;
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pRow), _mm256_permute2x128_si256(left, right, 0x20));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pRow + a_nWidth * 4), _mm256_permute2x128_si256(left, right, 0x31));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("avx2")
+static void swizzle32AVX2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + (nTileY * 8 * a_nWidth + nTileX * 8) * 4;
+			for (n32 i = 0; i < 16; i += (i & 2) != 0 ? 6 : 2)
+			{
+				const u8* pRow = pSrc + ((i >> 1 & 1) * 2 + (i >> 3 & 1) * 4) * a_nWidth * 4;
+				__m256i top = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow));
+				__m256i bottom = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow + a_nWidth * 4));
+				__m256i left = _mm256_permute4x64_epi64(_mm256_permute2x128_si256(top, bottom, 0x20), 0xD8);
+				__m256i right = _mm256_permute4x64_epi64(_mm256_permute2x128_si256(top, bottom, 0x31), 0xD8);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pTile + i * 16), _mm256_shuffle_epi8(left, reverse));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pTile + i * 16 + 64), _mm256_shuffle_epi8(right, reverse));
+			}
+			pTile += 256;
+		}
+	}
+}
+
+SWIZZLE_TARGET("sse2")
+static void deswizzle16SSE2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bReverse)
+{
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + (nTileY * 8 * a_nWidth + nTileX * 8) * 2;
+			// loads i and i + 2 hold the left and right halves of the same 2 rows
+			for (n32 i = 0; i < 8; i += (i & 1) != 0 ? 3 : 1)
+			{
+				__m128i left = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16)), 0xD8);
+				__m128i right = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16 + 32)), 0xD8);
+				if (a_bReverse)
+				{
+					left = reverse16SSE2(left);
+					right = reverse16SSE2(right);
+				}
+				u8* pRow = pDest + ((i & 1) * 2 + (i >> 2 & 1) * 4) * a_nWidth * 2;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow), _mm_unpacklo_epi64(left, right));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + a_nWidth * 2), _mm_unpackhi_epi64(left, right));
+			}
+			pTile += 128;
+		}
+	}
+}
+
+SWIZZLE_TARGET("sse2")
+static void swizzle16SSE2(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, bool a_bReverse)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + (nTileY * 8 * a_nWidth + nTileX * 8) * 2;
+			for (n32 i = 0; i < 8; i += (i & 1) != 0 ? 3 : 1)
+			{
+				const u8* pRow = pSrc + ((i & 1) * 2 + (i >> 2 & 1) * 4) * a_nWidth * 2;
+				__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow));
+				__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + a_nWidth * 2));
+				__m128i left = _mm_shuffle_epi32(_mm_unpacklo_epi64(top, bottom), 0xD8);
+				__m128i right = _mm_shuffle_epi32(_mm_unpackhi_epi64(top, bottom), 0xD8);
+				if (a_bReverse)
+				{
+					left = reverse16SSE2(left);
+					right = reverse16SSE2(right);
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16), left);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16 + 32), right);
+			}
+			pTile += 128;
+		}
+	}
+}
+
+// 16 morton ordered bytes to a 4x4 block in row order, and back
+SWIZZLE_TARGET("ssse3")
+static inline void deswizzle8TileSSSE3(__m128i a_Left, __m128i a_Right, u8* a_pDest, n32 a_nStride)
+{
+	const __m128i order = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+	a_Left = _mm_shuffle_epi8(a_Left, order);
+	a_Right = _mm_shuffle_epi8(a_Right, order);
+	__m128i top = _mm_unpacklo_epi32(a_Left, a_Right);
+	__m128i bottom = _mm_unpackhi_epi32(a_Left, a_Right);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(a_pDest), top);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(a_pDest + a_nStride), _mm_srli_si128(top, 8));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(a_pDest + a_nStride * 2), bottom);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(a_pDest + a_nStride * 3), _mm_srli_si128(bottom, 8));
+}
+
+SWIZZLE_TARGET("ssse3")
+static inline void swizzle8TileSSSE3(const u8* a_pSrc, n32 a_nStride, __m128i& a_Left, __m128i& a_Right)
+{
+	const __m128i order = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+	__m128i top = _mm_shuffle_epi32(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a_pSrc)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a_pSrc + a_nStride))), 0xD8);
+	__m128i bottom = _mm_shuffle_epi32(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a_pSrc + a_nStride * 2)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a_pSrc + a_nStride * 3))), 0xD8);
+	a_Left = _mm_shuffle_epi8(_mm_unpacklo_epi64(top, bottom), order);
+	a_Right = _mm_shuffle_epi8(_mm_unpackhi_epi64(top, bottom), order);
+}
+
+SWIZZLE_TARGET("ssse3")
+static void deswizzle8SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + nTileY * 8 * a_nWidth + nTileX * 8;
+			deswizzle8TileSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + 16)), pDest, a_nWidth);
+			deswizzle8TileSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + 32)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + 48)), pDest + a_nWidth * 4, a_nWidth);
+			pTile += 64;
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void swizzle8SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + nTileY * 8 * a_nWidth + nTileX * 8;
+			for (n32 i = 0; i < 2; i++)
+			{
+				__m128i left;
+				__m128i right;
+				swizzle8TileSSSE3(pSrc + i * 4 * a_nWidth, a_nWidth, left, right);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 32), left);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 32 + 16), right);
+			}
+			pTile += 64;
+		}
+	}
+}
+
+// 4 bit values to bytes times 0x11, low nibble first
+SWIZZLE_TARGET("sse2")
+static inline void unpackNibbleSSE2(__m128i a_Value, __m128i& a_Low, __m128i& a_High)
+{
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	__m128i low = _mm_and_si128(a_Value, mask);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(a_Value, 4), mask);
+	a_Low = _mm_unpacklo_epi8(low, high);
+	a_High = _mm_unpackhi_epi8(low, high);
+	a_Low = _mm_or_si128(a_Low, _mm_slli_epi16(a_Low, 4));
+	a_High = _mm_or_si128(a_High, _mm_slli_epi16(a_High, 4));
+}
+
+// bytes divided by 0x11 and packed in pairs, low nibble first
+SWIZZLE_TARGET("sse2")
+static inline __m128i packNibbleSSE2(__m128i a_Low, __m128i a_High)
+{
+	const __m128i zero = _mm_setzero_si128();
+	// (x * 241) >> 12 is x / 17 for every byte
+	const __m128i reciprocal = _mm_set1_epi16(241 << 4);
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	__m128i low = _mm_packus_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(a_Low, zero), reciprocal), _mm_mulhi_epu16(_mm_unpackhi_epi8(a_Low, zero), reciprocal));
+	__m128i high = _mm_packus_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(a_High, zero), reciprocal), _mm_mulhi_epu16(_mm_unpackhi_epi8(a_High, zero), reciprocal));
+	low = _mm_and_si128(_mm_or_si128(low, _mm_srli_epi16(low, 4)), mask);
+	high = _mm_and_si128(_mm_or_si128(high, _mm_srli_epi16(high, 4)), mask);
+	return _mm_packus_epi16(low, high);
+}
+
+SWIZZLE_TARGET("ssse3")
+static void deswizzleNibbleSSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pDest = a_pDest + nTileY * 8 * a_nWidth + nTileX * 8;
+			for (n32 i = 0; i < 2; i++)
+			{
+				__m128i left;
+				__m128i right;
+				unpackNibbleSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i * 16)), left, right);
+				deswizzle8TileSSSE3(left, right, pDest + i * 4 * a_nWidth, a_nWidth);
+			}
+			pTile += 32;
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void swizzleNibbleSSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pSrc = a_pSrc + nTileY * 8 * a_nWidth + nTileX * 8;
+			__m128i value[4];
+			swizzle8TileSSSE3(pSrc, a_nWidth, value[0], value[1]);
+			swizzle8TileSSSE3(pSrc + a_nWidth * 4, a_nWidth, value[2], value[3]);
+			for (n32 i = 0; i < 2; i++)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pTile + i * 16), packNibbleSSE2(value[i * 2], value[i * 2 + 1]));
+			}
+			pTile += 32;
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void deswizzleEtc1SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize)
+{
+	const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const u8* pBlock = a_pSrc + a_nBlockSize - 8;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			// blocks 0, 1 and 2, 3 of a tile are neighbours in the linear block order
+			for (n32 i = 0; i < 2; i++)
+			{
+				__m128i block = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pBlock)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pBlock + a_nBlockSize)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(a_pDest + ((nTileY * 2 + i) * (a_nWidth / 4) + nTileX * 2) * 8), _mm_shuffle_epi8(block, reverse));
+				pBlock += a_nBlockSize * 2;
+			}
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void swizzleEtc1SSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize)
+{
+	const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	u8* pBlock = a_pDest + a_nBlockSize - 8;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 2; i++)
+			{
+				__m128i block = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_pSrc + ((nTileY * 2 + i) * (a_nWidth / 4) + nTileX * 2) * 8)), reverse);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pBlock), block);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pBlock + a_nBlockSize), _mm_srli_si128(block, 8));
+				pBlock += a_nBlockSize * 2;
+			}
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void deswizzleEtc1AlphaSSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	// the nibbles of a block are column major, transpose them to rows
+	const __m128i transpose = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const u8* pBlock = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 2; i++)
+			{
+				__m128i left;
+				__m128i right;
+				unpackNibbleSSE2(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pBlock)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pBlock + 16))), left, right);
+				left = _mm_shuffle_epi8(left, transpose);
+				right = _mm_shuffle_epi8(right, transpose);
+				__m128i top = _mm_unpacklo_epi32(left, right);
+				__m128i bottom = _mm_unpackhi_epi32(left, right);
+				u8* pDest = a_pDest + (nTileY * 8 + i * 4) * a_nWidth + nTileX * 8;
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDest), top);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDest + a_nWidth), _mm_srli_si128(top, 8));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDest + a_nWidth * 2), bottom);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDest + a_nWidth * 3), _mm_srli_si128(bottom, 8));
+				pBlock += 32;
+			}
+		}
+	}
+}
+
+SWIZZLE_TARGET("ssse3")
+static void swizzleEtc1AlphaSSSE3(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	const __m128i transpose = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	u8* pBlock = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 2; i++)
+			{
+				const u8* pSrc = a_pSrc + (nTileY * 8 + i * 4) * a_nWidth + nTileX * 8;
+				__m128i top = _mm_shuffle_epi32(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc + a_nWidth))), 0xD8);
+				__m128i bottom = _mm_shuffle_epi32(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc + a_nWidth * 2)), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc + a_nWidth * 3))), 0xD8);
+				__m128i left = _mm_shuffle_epi8(_mm_unpacklo_epi64(top, bottom), transpose);
+				__m128i right = _mm_shuffle_epi8(_mm_unpackhi_epi64(top, bottom), transpose);
+				__m128i block = packNibbleSSE2(left, right);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pBlock), block);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pBlock + 16), _mm_srli_si128(block, 8));
+				pBlock += 32;
+			}
+		}
+	}
+}
+#endif
+
+CSwizzle::ESimdLevel CSwizzle::GetSimdLevel()
+{
+	return s_eSimdLevel;
+}
+
+void CSwizzle::SetSimdLevel(ESimdLevel a_eSimdLevel)
+{
+	// never go above what the cpu supports, kSimdLevelNone selects the scalar reference code
+	ESimdLevel eSimdLevel = detectSimdLevel();
+	s_eSimdLevel = a_eSimdLevel < eSimdLevel ? a_eSimdLevel : eSimdLevel;
+}
+
+void CSwizzle::Deswizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBytesPerPixel, bool a_bReverse)
+{
+#if defined(SWIZZLE_X86)
+	if (a_nBytesPerPixel == 4 && a_bReverse && s_eSimdLevel >= kSimdLevelSSE2)
+	{
+		if (s_eSimdLevel >= kSimdLevelAVX2)
+		{
+			deswizzle32AVX2(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		else if (s_eSimdLevel >= kSimdLevelSSSE3)
+		{
+			deswizzle32SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		else
+		{
+			deswizzle32SSE2(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		return;
+	}
+	if (a_nBytesPerPixel == 2 && s_eSimdLevel >= kSimdLevelSSE2)
+	{
+		deswizzle16SSE2(a_pSrc, a_pDest, a_nWidth, a_nHeight, a_bReverse);
+		return;
+	}
+	if (a_nBytesPerPixel == 1 && s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		deswizzle8SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	switch (a_nBytesPerPixel * 2 + (a_bReverse ? 1 : 0))
+	{
+	case 2:
+	case 3:
+		deswizzle<1, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 4:
+		deswizzle<2, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 5:
+		deswizzle<2, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 6:
+		deswizzle<3, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 7:
+		deswizzle<3, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 8:
+		deswizzle<4, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 9:
+		deswizzle<4, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	}
+}
+
+void CSwizzle::Swizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBytesPerPixel, bool a_bReverse)
+{
+#if defined(SWIZZLE_X86)
+	if (a_nBytesPerPixel == 4 && a_bReverse && s_eSimdLevel >= kSimdLevelSSE2)
+	{
+		if (s_eSimdLevel >= kSimdLevelAVX2)
+		{
+			swizzle32AVX2(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		else if (s_eSimdLevel >= kSimdLevelSSSE3)
+		{
+			swizzle32SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		else
+		{
+			swizzle32SSE2(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		}
+		return;
+	}
+	if (a_nBytesPerPixel == 2 && s_eSimdLevel >= kSimdLevelSSE2)
+	{
+		swizzle16SSE2(a_pSrc, a_pDest, a_nWidth, a_nHeight, a_bReverse);
+		return;
+	}
+	if (a_nBytesPerPixel == 1 && s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		swizzle8SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	switch (a_nBytesPerPixel * 2 + (a_bReverse ? 1 : 0))
+	{
+	case 2:
+	case 3:
+		swizzle<1, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 4:
+		swizzle<2, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 5:
+		swizzle<2, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 6:
+		swizzle<3, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 7:
+		swizzle<3, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 8:
+		swizzle<4, false>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	case 9:
+		swizzle<4, true>(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		break;
+	}
+}
+
+void CSwizzle::DeswizzleNibble(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		deswizzleNibbleSSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			const u8* pTile = a_pSrc + (nTileY * (a_nWidth / 8) + nTileX) * 32;
+			for (n32 i = 0; i < 8; i++)
+			{
+				u8* pRow = a_pDest + (nTileY * 8 + i) * a_nWidth + nTileX * 8;
+				for (n32 j = 0; j < 8; j += 2)
+				{
+					u8 uByte = pTile[s_nDecodeTransByte[i * 8 + j] / 2];
+					pRow[j] = (uByte & 0x0F) * 0x11;
+					pRow[j + 1] = (uByte >> 4 & 0x0F) * 0x11;
+				}
+			}
+		}
+	}
+}
+
+void CSwizzle::SwizzleNibble(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		swizzleNibbleSSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			u8* pTile = a_pDest + (nTileY * (a_nWidth / 8) + nTileX) * 32;
+			for (n32 i = 0; i < 8; i++)
+			{
+				const u8* pRow = a_pSrc + (nTileY * 8 + i) * a_nWidth + nTileX * 8;
+				for (n32 j = 0; j < 8; j += 2)
+				{
+					pTile[s_nDecodeTransByte[i * 8 + j] / 2] = ((pRow[j] / 0x11) & 0x0F) | ((pRow[j + 1] / 0x11) << 4 & 0xF0);
+				}
+			}
+		}
+	}
+}
+
+void CSwizzle::DeswizzleEtc1(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		deswizzleEtc1SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight, a_nBlockSize);
+		return;
+	}
+#endif
+	// every 8x8 tile holds 2x2 blocks in row order, each block stored as a little endian u64
+	const u8* pBlock = a_pSrc + a_nBlockSize - 8;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				u8* pDest = a_pDest + ((nTileY * 2 + i / 2) * (a_nWidth / 4) + nTileX * 2 + i % 2) * 8;
+				for (n32 j = 0; j < 8; j++)
+				{
+					pDest[j] = pBlock[7 - j];
+				}
+				pBlock += a_nBlockSize;
+			}
+		}
+	}
+}
+
+void CSwizzle::SwizzleEtc1(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		swizzleEtc1SSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight, a_nBlockSize);
+		return;
+	}
+#endif
+	u8* pBlock = a_pDest + a_nBlockSize - 8;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				const u8* pSrc = a_pSrc + ((nTileY * 2 + i / 2) * (a_nWidth / 4) + nTileX * 2 + i % 2) * 8;
+				for (n32 j = 0; j < 8; j++)
+				{
+					pBlock[7 - j] = pSrc[j];
+				}
+				pBlock += a_nBlockSize;
+			}
+		}
+	}
+}
+
+void CSwizzle::DeswizzleEtc1Alpha(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		deswizzleEtc1AlphaSSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	// the 4 bit alpha of a block goes column by column, two rows per byte, low nibble first
+	const u8* pBlock = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				u8* pDest = a_pDest + (nTileY * 8 + i / 2 * 4) * a_nWidth + nTileX * 8 + i % 2 * 4;
+				for (n32 nY = 0; nY < 4; nY++)
+				{
+					for (n32 nX = 0; nX < 4; nX++)
+					{
+						pDest[nY * a_nWidth + nX] = (pBlock[nX * 2 + nY / 2] >> (nY % 2 * 4) & 0x0F) * 0x11;
+					}
+				}
+				pBlock += 16;
+			}
+		}
+	}
+}
+
+void CSwizzle::SwizzleEtc1Alpha(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+#if defined(SWIZZLE_X86)
+	if (s_eSimdLevel >= kSimdLevelSSSE3)
+	{
+		swizzleEtc1AlphaSSSE3(a_pSrc, a_pDest, a_nWidth, a_nHeight);
+		return;
+	}
+#endif
+	u8* pBlock = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 4; i++)
+			{
+				const u8* pSrc = a_pSrc + (nTileY * 8 + i / 2 * 4) * a_nWidth + nTileX * 8 + i % 2 * 4;
+				for (n32 nX = 0; nX < 4; nX++)
+				{
+					pBlock[nX * 2] = ((pSrc[nX] / 0x11) & 0x0F) | ((pSrc[a_nWidth + nX] / 0x11) << 4 & 0xF0);
+					pBlock[nX * 2 + 1] = ((pSrc[a_nWidth * 2 + nX] / 0x11) & 0x0F) | ((pSrc[a_nWidth * 3 + nX] / 0x11) << 4 & 0xF0);
+				}
+				pBlock += 16;
+			}
+		}
+	}
+}
+
+CSwizzle::ESimdLevel CSwizzle::detectSimdLevel()
+{
+#if defined(SWIZZLE_X86)
+#if defined(_MSC_VER)
+	int nInfo[4] = {};
+	__cpuid(nInfo, 0);
+	int nMaxId = nInfo[0];
+	__cpuid(nInfo, 1);
+	if ((nInfo[3] & (1 << 26)) == 0)
+	{
+		return kSimdLevelNone;
+	}
+	if ((nInfo[2] & (1 << 9)) == 0)
+	{
+		return kSimdLevelSSE2;
+	}
+	// avx2 also needs the os to save the ymm registers
+	bool bOSXSave = (nInfo[2] & (1 << 27)) != 0 && (nInfo[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	if (bOSXSave && nMaxId >= 7)
+	{
+		__cpuidex(nInfo, 7, 0);
+		if ((nInfo[1] & (1 << 5)) != 0)
+		{
+			return kSimdLevelAVX2;
+		}
+	}
+	return kSimdLevelSSSE3;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return kSimdLevelAVX2;
+	}
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		return kSimdLevelSSSE3;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return kSimdLevelSSE2;
+	}
+	return kSimdLevelNone;
+#endif
+#else
+	return kSimdLevelNone;
+#endif
+}
+
+template<n32 BytesPerPixel, bool Reverse>
+void CSwizzle::deswizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	// one 8x8 tile is read sequentially and scattered straight into its 8 destination rows
+	const u8* pTile = a_pSrc;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				u8* pRow = a_pDest + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * BytesPerPixel;
+				for (n32 j = 0; j < 8; j++)
+				{
+					const u8* pPixel = pTile + s_nDecodeTransByte[i * 8 + j] * BytesPerPixel;
+					for (n32 k = 0; k < BytesPerPixel; k++)
+					{
+						pRow[j * BytesPerPixel + k] = pPixel[Reverse ? BytesPerPixel - 1 - k : k];
+					}
+				}
+			}
+			pTile += 64 * BytesPerPixel;
+		}
+	}
+}
+
+template<n32 BytesPerPixel, bool Reverse>
+void CSwizzle::swizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight)
+{
+	u8* pTile = a_pDest;
+	for (n32 nTileY = 0; nTileY < a_nHeight / 8; nTileY++)
+	{
+		for (n32 nTileX = 0; nTileX < a_nWidth / 8; nTileX++)
+		{
+			for (n32 i = 0; i < 8; i++)
+			{
+				const u8* pRow = a_pSrc + ((nTileY * 8 + i) * a_nWidth + nTileX * 8) * BytesPerPixel;
+				for (n32 j = 0; j < 8; j++)
+				{
+					u8* pPixel = pTile + s_nDecodeTransByte[i * 8 + j] * BytesPerPixel;
+					for (n32 k = 0; k < BytesPerPixel; k++)
+					{
+						pPixel[Reverse ? BytesPerPixel - 1 - k : k] = pRow[j * BytesPerPixel + k];
+					}
+				}
+			}
+			pTile += 64 * BytesPerPixel;
+		}
+	}
+}
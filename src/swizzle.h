@@ -0,0 +1,36 @@
+#ifndef SWIZZLE_H_
+#define SWIZZLE_H_
+
+#include <sdw.h>
+
+class CSwizzle
+{
+public:
+	enum ESimdLevel
+	{
+		kSimdLevelNone,
+		kSimdLevelSSE2,
+		kSimdLevelSSSE3,
+		kSimdLevelAVX2
+	};
+	static ESimdLevel GetSimdLevel();
+	static void SetSimdLevel(ESimdLevel a_eSimdLevel);
+	static void Deswizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBytesPerPixel, bool a_bReverse);
+	static void Swizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBytesPerPixel, bool a_bReverse);
+	static void DeswizzleNibble(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static void SwizzleNibble(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static void DeswizzleEtc1(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize);
+	static void SwizzleEtc1(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight, n32 a_nBlockSize);
+	static void DeswizzleEtc1Alpha(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static void SwizzleEtc1Alpha(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	static const int s_nDecodeTransByte[64];
+private:
+	static ESimdLevel detectSimdLevel();
+	static ESimdLevel s_eSimdLevel;
+	template<n32 BytesPerPixel, bool Reverse>
+	static void deswizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+	template<n32 BytesPerPixel, bool Reverse>
+	static void swizzle(const u8* a_pSrc, u8* a_pDest, n32 a_nWidth, n32 a_nHeight);
+};
+
+#endif	// SWIZZLE_H_
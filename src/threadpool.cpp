@@ -0,0 +1,194 @@
+#include "threadpool.h"
+#if SDW_PLATFORM == SDW_PLATFORM_LINUX
+#include <sched.h>
+#endif
+
+CThreadPool::CThreadPool()
+	: m_bStop(false)
+{
+}
+
+CThreadPool::~CThreadPool()
+{
+	Stop();
+}
+
+void CThreadPool::Start(n32 a_nThreadCount)
+{
+	Stop();
+	m_bStop = false;
+	// a single worker would only add a hop, so run the tasks on the caller instead
+	if (a_nThreadCount <= 1)
+	{
+		return;
+	}
+	for (n32 i = 0; i < a_nThreadCount; i++)
+	{
+		m_vThread.push_back(thread(&CThreadPool::work, this));
+	}
+}
+
+void CThreadPool::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_Condition.notify_all();
+	for (n32 i = 0; i < static_cast<n32>(m_vThread.size()); i++)
+	{
+		m_vThread[i].join();
+	}
+	m_vThread.clear();
+}
+
+n32 CThreadPool::GetThreadCount() const
+{
+	return m_vThread.empty() ? 1 : static_cast<n32>(m_vThread.size());
+}
+
+void CThreadPool::Push(const function<void()>& a_Task)
+{
+	if (m_vThread.empty())
+	{
+		a_Task();
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_dTask.push_back(a_Task);
+	}
+	m_Condition.notify_one();
+}
+
+n32 CThreadPool::GetAutoThreadCount()
+{
+	n32 nCount = static_cast<n32>(thread::hardware_concurrency());
+#if SDW_PLATFORM == SDW_PLATFORM_LINUX
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+	{
+		nCount = CPU_COUNT(&cpuSet);
+	}
+	// honor the cfs quota of the container, cgroup v2 first and then v1
+	n64 nQuota = -1;
+	n64 nPeriod = 0;
+	FILE* fp = fopen("/sys/fs/cgroup/cpu.max", "rb");
+	if (fp != nullptr)
+	{
+		char szQuota[32] = {};
+		long long nCgroupPeriod = 0;
+		if (fscanf(fp, "%31s %lld", szQuota, &nCgroupPeriod) == 2 && strcmp(szQuota, "max") != 0)
+		{
+			nQuota = strtoll(szQuota, nullptr, 10);
+			nPeriod = nCgroupPeriod;
+		}
+		fclose(fp);
+	}
+	else
+	{
+		long long nCgroupQuota = -1;
+		long long nCgroupPeriod = 0;
+		fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "rb");
+		if (fp != nullptr)
+		{
+			if (fscanf(fp, "%lld", &nCgroupQuota) != 1)
+			{
+				nCgroupQuota = -1;
+			}
+			fclose(fp);
+		}
+		fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "rb");
+		if (fp != nullptr)
+		{
+			if (fscanf(fp, "%lld", &nCgroupPeriod) != 1)
+			{
+				nCgroupPeriod = 0;
+			}
+			fclose(fp);
+		}
+		nQuota = nCgroupQuota;
+		nPeriod = nCgroupPeriod;
+	}
+	if (nQuota > 0 && nPeriod > 0)
+	{
+		n32 nQuotaCount = static_cast<n32>((nQuota + nPeriod - 1) / nPeriod);
+		if (nQuotaCount < nCount)
+		{
+			nCount = nQuotaCount;
+		}
+	}
+#endif
+	return nCount > 0 ? nCount : 1;
+}
+
+// the pool of the calling thread for the codecs inside one texture, kept across textures and restarted only when the thread count changes
+CThreadPool& CThreadPool::GetThreadPool(n32 a_nThreadCount)
+{
+	static thread_local CThreadPool s_ThreadPool;
+	if (s_ThreadPool.GetThreadCount() != (a_nThreadCount > 1 ? a_nThreadCount : 1))
+	{
+		s_ThreadPool.Start(a_nThreadCount);
+	}
+	return s_ThreadPool;
+}
+
+void CThreadPool::work()
+{
+	for (;;)
+	{
+		function<void()> task;
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			while (!m_bStop && m_dTask.empty())
+			{
+				m_Condition.wait(lock);
+			}
+			if (m_dTask.empty())
+			{
+				return;
+			}
+			task = m_dTask.front();
+			m_dTask.pop_front();
+		}
+		task();
+	}
+}
+
+CTaskGroup::CTaskGroup(CThreadPool& a_ThreadPool)
+	: m_ThreadPool(a_ThreadPool)
+	, m_nPending(0)
+{
+}
+
+CTaskGroup::~CTaskGroup()
+{
+	Wait();
+}
+
+void CTaskGroup::push(const function<void()>& a_Task)
+{
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_nPending++;
+	}
+	m_ThreadPool.Push([this, a_Task]()
+	{
+		a_Task();
+		lock_guard<mutex> lock(m_Mutex);
+		if (--m_nPending == 0)
+		{
+			m_Condition.notify_all();
+		}
+	});
+}
+
+void CTaskGroup::Wait()
+{
+	unique_lock<mutex> lock(m_Mutex);
+	while (m_nPending != 0)
+	{
+		m_Condition.wait(lock);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <sdw.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class CThreadPool
+{
+public:
+	CThreadPool();
+	~CThreadPool();
+	void Start(n32 a_nThreadCount);
+	void Stop();
+	n32 GetThreadCount() const;
+	void Push(const function<void()>& a_Task);
+	static n32 GetAutoThreadCount();
+	static CThreadPool& GetThreadPool(n32 a_nThreadCount);
+private:
+	CThreadPool(const CThreadPool&);
+	CThreadPool& operator=(const CThreadPool&);
+	void work();
+	vector<thread> m_vThread;
+	deque<function<void()>> m_dTask;
+	mutex m_Mutex;
+	condition_variable m_Condition;
+	bool m_bStop;
+};
+
+class CTaskGroup
+{
+public:
+	CTaskGroup(CThreadPool& a_ThreadPool);
+	~CTaskGroup();
+	template<typename T>
+	void Push(const T& a_Task);
+	void Wait();
+private:
+	CTaskGroup(const CTaskGroup&);
+	CTaskGroup& operator=(const CTaskGroup&);
+	void push(const function<void()>& a_Task);
+	CThreadPool& m_ThreadPool;
+	n32 m_nPending;
+	mutex m_Mutex;
+	condition_variable m_Condition;
+};
+
+// without workers the task runs right here, which also spares it the heap copy into a function
+template<typename T>
+void CTaskGroup::Push(const T& a_Task)
+{
+	if (m_ThreadPool.GetThreadCount() == 1)
+	{
+		a_Task();
+		return;
+	}
+	push(a_Task);
+}
+
+#endif	// THREADPOOL_H_